@@ -0,0 +1,138 @@
+# 输出比对测试，由 ctest 以脚本模式调用，CASE 为：
+#   bytecode vm_2 -c 编译 IMAGE.s（IMAGE 为 builtin 时为内置程序）得到的字节码，
+#            在栈式解释器、-r、-O 和 -O -r 下的输出与直接执行相同
+#   reject   操作数栈溢出和下溢的程序在 vm_2 -c 时被校验拒绝
+#   engines  IMAGE 在各引擎下的输出与默认引擎相同，DELAY 不为 0 时输入在这么多秒后才到达
+#   batch    -batch 的输出与逐行输入分别执行的输出相同
+#   guest    -trap=guest 经 os.obj 的例程执行 IMAGE，输出与宿主机完成 TRAP 时相同
+#   watch    观察点在各引擎和 AOT 下报告的访问相同
+#   aot      AOT 翻译的可执行文件与解释执行的输出相同
+#   session  lc3_embed 以会话模式同时执行两个客户机，各自停机且输出与 vm_lc_3 相同
+# 任何一次执行失败、超时或输出不同时测试失败
+
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+set(input "${WORK_DIR}/input.txt")
+file(WRITE "${input}" "hi.\n")
+
+set(engine_args "" -e=decode -pretranslate -jit -jit=2 -tier -tier=1:2)
+
+# 执行一次，合并标准输出和标准错误存入 out
+function(run out)
+  if(DELAY)
+    execute_process(COMMAND sh -c "sleep ${DELAY}; cat '${input}'"
+      COMMAND ${ARGN}
+      RESULT_VARIABLE result
+      OUTPUT_VARIABLE output
+      ERROR_VARIABLE output
+      TIMEOUT 60)
+  else()
+    execute_process(COMMAND ${ARGN}
+      RESULT_VARIABLE result
+      OUTPUT_VARIABLE output
+      ERROR_VARIABLE output
+      INPUT_FILE "${input}"
+      TIMEOUT 60)
+  endif()
+
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "run failed (${result}): ${ARGN}\n${output}")
+  endif()
+
+  set(${out} "${output}" PARENT_SCOPE)
+endfunction()
+
+function(expect expected actual what)
+  if(NOT expected STREQUAL actual)
+    message(FATAL_ERROR "${what}\n--- expected\n${expected}\n--- actual\n${actual}")
+  endif()
+endfunction()
+
+set(image "${PROGRAMS}/${IMAGE}.obj")
+
+if(CASE STREQUAL "bytecode")
+  set(bytecode "${WORK_DIR}/${IMAGE}.vm2")
+
+  if(IMAGE STREQUAL "builtin")
+    run(ignored "${VM_2}" -c "${bytecode}")
+    run(expected "${VM_2}")
+  else()
+    run(ignored "${VM_2}" -c "${bytecode}" "${PROGRAMS}/${IMAGE}.s")
+    run(expected "${VM_2}" "${bytecode}")
+  endif()
+
+  foreach(mode IN ITEMS "" -r -O "-O -r")
+    separate_arguments(args UNIX_COMMAND "${mode}")
+    run(actual "${VM_2}" ${args} "${bytecode}")
+
+    # 优化和翻译的统计不属于程序的输出
+    string(REGEX REPLACE "(optimizer removed|translated|program not translatable)[^\n]*\n" "" actual "${actual}")
+    expect("${expected}" "${actual}" "${IMAGE} differs under vm_2 ${mode}")
+  endforeach()
+elseif(CASE STREQUAL "reject")
+  set(overflow "")
+  foreach(i RANGE 400)
+    string(APPEND overflow "PSH 1\n")
+  endforeach()
+
+  file(WRITE "${WORK_DIR}/overflow.s" "${overflow}HLT\n")
+  file(WRITE "${WORK_DIR}/underflow.s" "POP\nPOP\nPOP\nADD\nHLT\n")
+
+  foreach(name overflow underflow)
+    execute_process(COMMAND "${VM_2}" -c "${WORK_DIR}/${name}.vm2" "${WORK_DIR}/${name}.s"
+      RESULT_VARIABLE result
+      OUTPUT_VARIABLE output
+      ERROR_VARIABLE output
+      TIMEOUT 60)
+
+    if(result EQUAL 0 OR NOT output MATCHES "stack ${name}")
+      message(FATAL_ERROR "${name}.s accepted by vm_2 -c (${result})\n${output}")
+    endif()
+  endforeach()
+elseif(CASE STREQUAL "engines")
+  run(expected "${VM_LC_3}" "${image}")
+  foreach(engine IN LISTS engine_args)
+    run(actual "${VM_LC_3}" ${engine} "${image}")
+    expect("${expected}" "${actual}" "${IMAGE} differs under ${engine}")
+  endforeach()
+elseif(CASE STREQUAL "batch")
+  file(STRINGS "${PROGRAMS}/${IMAGE}.txt" lines)
+  set(expected "")
+  set(guest 0)
+  foreach(line IN LISTS lines)
+    file(WRITE "${input}" "${line}\n")
+    run(output "${VM_LC_3}" "${image}")
+    string(APPEND expected "== guest ${guest} ==\n${output}")
+    math(EXPR guest "${guest} + 1")
+  endforeach()
+
+  run(actual "${VM_LC_3}" "-batch=${PROGRAMS}/${IMAGE}.txt" "${image}")
+  expect("${expected}" "${actual}" "${IMAGE} differs under -batch")
+elseif(CASE STREQUAL "guest")
+  run(expected "${VM_LC_3}" "${image}")
+  foreach(engine IN LISTS engine_args)
+    run(actual "${VM_LC_3}" ${engine} -trap=guest "${PROGRAMS}/os.obj" "${image}")
+    expect("${expected}" "${actual}" "${IMAGE} differs under -trap=guest ${engine}")
+  endforeach()
+elseif(CASE STREQUAL "watch")
+  run(expected "${VM_LC_3}" ${WATCH} "${image}")
+  foreach(engine IN LISTS engine_args)
+    run(actual "${VM_LC_3}" ${engine} ${WATCH} "${image}")
+    expect("${expected}" "${actual}" "${IMAGE} ${WATCH} differs under ${engine}")
+  endforeach()
+
+  run(actual "${AOT}" ${WATCH})
+  expect("${expected}" "${actual}" "${AOT} ${WATCH} differs")
+elseif(CASE STREQUAL "aot")
+  run(expected "${VM_LC_3}" "${image}")
+  run(actual "${AOT}")
+  expect("${expected}" "${actual}" "${AOT} differs")
+elseif(CASE STREQUAL "session")
+  run(expected "${VM_LC_3}" "${image}")
+  run(actual "${EMBED}" -session "${image}" "hi." "hi.")
+  string(REGEX REPLACE "== guest [0-9]+: halt after [0-9]+ instructions ==\n" "" actual "${actual}")
+  string(REGEX REPLACE "== 2 guests, [0-9]+ suspensions ==\n$" "" actual "${actual}")
+  expect("${expected}${expected}" "${actual}" "${IMAGE} differs under lc3_embed -session")
+else()
+  message(FATAL_ERROR "unknown CASE ${CASE}")
+endif()
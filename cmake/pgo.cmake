@@ -0,0 +1,27 @@
+# 两阶段 PGO 构建：
+#   cmake [-DBUILD_DIR=build-pgo] [-DCMAKE_C_COMPILER=clang] -P cmake/pgo.cmake
+# 在同一构建目录中先插桩构建并执行训练负载，再用采集的 profile 重新构建，
+# 产物即为 BUILD_DIR 中的 vm_1、vm_2、vm_lc_3
+
+get_filename_component(source_dir "${CMAKE_CURRENT_LIST_DIR}/.." ABSOLUTE)
+
+if(NOT BUILD_DIR)
+  set(BUILD_DIR "${source_dir}/build-pgo")
+endif()
+
+set(configure_args -DCMAKE_BUILD_TYPE=Release)
+if(CMAKE_C_COMPILER)
+  list(APPEND configure_args -DCMAKE_C_COMPILER=${CMAKE_C_COMPILER})
+endif()
+
+function(step)
+  execute_process(COMMAND ${ARGN} RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "failed: ${ARGN}")
+  endif()
+endfunction()
+
+step(${CMAKE_COMMAND} -S "${source_dir}" -B "${BUILD_DIR}" ${configure_args} -DVM_PGO=GENERATE)
+step(${CMAKE_COMMAND} --build "${BUILD_DIR}" --target pgo-train)
+step(${CMAKE_COMMAND} -S "${source_dir}" -B "${BUILD_DIR}" -DVM_PGO=USE)
+step(${CMAKE_COMMAND} --build "${BUILD_DIR}")
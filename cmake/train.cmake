@@ -0,0 +1,63 @@
+# PGO 训练负载，由 pgo-train 目标以脚本模式调用：
+# 清空旧的 profile，执行全部 LC-3 镜像和 vm_2 程序（覆盖各引擎和 -O/-r），
+# Clang 下再把 .profraw 合并成 default.profdata
+
+file(REMOVE_RECURSE "${PGO_DIR}")
+file(MAKE_DIRECTORY "${PGO_DIR}" "${WORK_DIR}")
+
+function(run)
+  execute_process(COMMAND ${ARGN}
+    RESULT_VARIABLE result
+    OUTPUT_QUIET
+    ERROR_QUIET
+    INPUT_FILE /dev/null)
+
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "training run failed (${result}): ${ARGN}")
+  endif()
+endfunction()
+
+set(engines -e=predecode -e=decode)
+
+# os.obj 只提供 trap 服务例程，不单独执行
+file(GLOB lc3_images "${PROGRAMS}/*.obj")
+list(FILTER lc3_images EXCLUDE REGEX "/os\\.obj$")
+foreach(image IN LISTS lc3_images)
+  message(STATUS "lc3: ${image}")
+  foreach(engine IN LISTS engines)
+    run("${VM_LC_3}" ${engine} "${image}")
+  endforeach()
+
+  # 同名 .txt 为多组输入，按 lane 并行执行
+  string(REGEX REPLACE "\\.obj$" ".txt" inputs "${image}")
+  if(EXISTS "${inputs}")
+    run("${VM_LC_3}" "-batch=${inputs}" "${image}")
+  endif()
+endforeach()
+
+# TRAP 经客户机向量表进入 os.obj 的例程
+run("${VM_LC_3}" -trap=guest "${PROGRAMS}/os.obj" "${PROGRAMS}/primes.obj")
+
+file(GLOB vm2_sources "${PROGRAMS}/*.s")
+foreach(source IN LISTS vm2_sources)
+  get_filename_component(name "${source}" NAME_WE)
+  set(bytecode "${WORK_DIR}/${name}.vm2")
+
+  message(STATUS "vm_2: ${source}")
+  run("${VM_2}" -c "${bytecode}" "${source}")
+
+  foreach(engine IN LISTS engines)
+    run("${VM_2}" ${engine} "${bytecode}")
+    run("${VM_2}" ${engine} -O "${bytecode}")
+    run("${VM_2}" ${engine} -r "${bytecode}")
+    run("${VM_2}" ${engine} -O -r "${bytecode}")
+  endforeach()
+endforeach()
+
+run("${VM_1}")
+run("${VM_2}")
+
+if(LLVM_PROFDATA)
+  file(GLOB raw "${PGO_DIR}/*.profraw")
+  run("${LLVM_PROFDATA}" merge -output=${PGO_DIR}/default.profdata ${raw})
+endif()
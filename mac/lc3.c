@@ -0,0 +1,949 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+
+// 宏便捷定义
+// PC 寄存器
+#define PC (vm->core.pc)
+
+// 标志寄存器
+#define COND (vm->reg[R_COND])
+
+// 处理函数中取回机器状态
+#define LC3(core) ((Lc3 *)(core))
+
+// 被观察页上的访问，检查是否落在某个观察范围内
+static void watch_hit(Lc3 *vm, uint16_t address, int flag, uint16_t old_value, uint16_t new_value)
+{
+  for (int i = 0; i < vm->watchpoint_count; i++)
+  {
+    Lc3Watchpoint *w = &vm->watchpoints[i];
+
+    if (!(w->flags & flag) || address < w->start || address >= w->end)
+    {
+      continue;
+    }
+
+    // 访存指令不改变 PC，当前指令即 PC - 1
+    uint16_t pc = PC - 1;
+
+    if (flag == VM_WATCH_WRITE)
+    {
+      fprintf(stderr, "[lc3] watch write %04x at pc %04x: %04x -> %04x\n", address, pc, old_value, new_value);
+    }
+    else
+    {
+      fprintf(stderr, "[lc3] watch read %04x at pc %04x: %04x\n", address, pc, old_value);
+    }
+
+    if (vm->core.debug)
+    {
+      vm_core_stop(&vm->core, VM_STOP_WATCH);
+    }
+
+    return;
+  }
+}
+
+// 从内存读取数据
+uint16_t mem_read(Lc3 *vm, int address)
+{
+  if (address < 0 || address >= UINT16_MAX)
+  {
+    printf("memory read error!\n");
+    exit(4);
+  }
+
+  uint8_t flags = vm->page_flags[address >> LC3_PAGE_SHIFT];
+
+  if (flags)
+  {
+    if (flags & LC3_PAGE_LAZY)
+    {
+      lc3_page_in(vm, address >> LC3_PAGE_SHIFT);
+    }
+
+    if (flags & LC3_PAGE_DEVICE)
+    {
+      lc3_device_read(vm, address);
+    }
+
+    if (flags & VM_WATCH_READ)
+    {
+      watch_hit(vm, address, VM_WATCH_READ, vm->mem[address], vm->mem[address]);
+    }
+  }
+
+  return vm->mem[address];
+}
+
+// 将 data 写入内存地址为 address 处
+void mem_write(Lc3 *vm, uint16_t address, uint16_t data)
+{
+  if (address >= UINT16_MAX)
+  {
+    printf("memory write error!\n");
+    exit(3);
+  }
+
+  uint8_t flags = vm->page_flags[address >> LC3_PAGE_SHIFT];
+
+  if (flags)
+  {
+    if (flags & LC3_PAGE_LAZY)
+    {
+      lc3_page_in(vm, address >> LC3_PAGE_SHIFT);
+    }
+
+    if (flags & VM_WATCH_WRITE)
+    {
+      watch_hit(vm, address, VM_WATCH_WRITE, vm->mem[address], data);
+    }
+
+    if (flags & LC3_PAGE_DEVICE)
+    {
+      data = lc3_device_write(vm, address, data);
+    }
+
+    if (flags & LC3_PAGE_CODE)
+    {
+      lc3_jit_written(vm, address);
+    }
+  }
+
+  vm->mem[address] = data;
+
+  // 自修改代码，丢弃该地址的解码结果
+  vm_core_invalidate(&vm->core, address);
+}
+
+// 符号扩展
+uint16_t sign_extend(uint16_t x, int bit_count)
+{
+  // 最高位 1
+  if ((x >> (bit_count - 1)) & 0x1)
+  {
+    x |= 0xFFFF << bit_count;
+  }
+
+  return x;
+}
+
+// 更新标志寄存器
+void update_flags(Lc3 *vm, uint16_t r)
+{
+  uint16_t value = vm->reg[r];
+  if (value == 0)
+  {
+    COND = FL_ZRO;
+  }
+  else if ((value >> 15) & 0x1)
+  {
+    // 最高位 1，负数
+    COND = FL_NEG;
+  }
+  else
+  {
+    COND = FL_POS;
+  }
+}
+
+// 加法指令，两种模式
+// add r0, r1, imm， 立即数模式
+// add r0, r1, r2，寄存器模式
+void add(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  // 取出目的寄存器 r0，9~11，占 3 位，与上 111
+  uint16_t r0 = (instr >> 9) & 0x7;
+
+  // 源寄存器 r1，6~8 位，
+  uint16_t r1 = (instr >> 6) & 0x7;
+
+  // add 模式
+  uint16_t flag = (instr >> 5) & 0x1;
+
+  // 立即数模式
+  if (flag)
+  {
+    // 低五位，取出立即数。
+    uint16_t data = instr & 0x1F;
+
+    // 符号扩展，若高位是 1，则全部补 1
+    uint16_t value = sign_extend(data, 5);
+
+    vm->reg[r0] = vm->reg[r1] + value;
+
+    VM_TRACE(core, "add imm dr:%d, sr:%d, value:%d\n", r0, r1, value);
+  }
+  else
+  {
+    // 寄存器模式
+    // 取出源寄存器 2，低 3 位
+    uint16_t r2 = instr & 0x7;
+
+    vm->reg[r0] = vm->reg[r1] + vm->reg[r2];
+  }
+
+  VM_TRACE(core, "reg_%d value:%d\n", r0, vm->reg[r0]);
+
+  // 更新标志寄存器
+  update_flags(vm, r0);
+}
+
+// 与运算，同 add ，两种模式
+void and (VmCore * core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  // 取出目的寄存器 r0，9~11，占 3 位，与上 111
+  uint16_t r0 = (instr >> 9) & 0x7;
+
+  // 源寄存器 r1，6~8 位，
+  uint16_t r1 = (instr >> 6) & 0x7;
+
+  // add 模式
+  uint16_t flag = (instr >> 5) & 0x1;
+
+  // 立即数模式
+  if (flag)
+  {
+    // 低五位，取出立即数。
+    uint16_t data = instr & 0x1F;
+
+    // 符号扩展，若高位是 1，则全部补 1
+    uint16_t value = sign_extend(data, 5);
+
+    VM_TRACE(core, "and imm mode, sign_extend imm:%d\n", value);
+
+    vm->reg[r0] = vm->reg[r1] & value;
+  }
+  else
+  {
+    // 寄存器模式
+    // 取出源寄存器 2，低 3 位
+    uint16_t r2 = instr & 0x7;
+
+    vm->reg[r0] = vm->reg[r1] & vm->reg[r2];
+  }
+
+  VM_TRACE(core, "reg_%d value:%d\n", r0, vm->reg[r0]);
+
+  // 更新标志寄存器
+  update_flags(vm, r0);
+}
+
+// NOT r0, r1。将 r1 取反后，放入 r0
+void not(VmCore * core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  // 取出目的寄存器 r0，9~11，占 3 位，与上 111
+  uint16_t r0 = (instr >> 9) & 0x7;
+
+  // 源寄存器 r1，6~8 位，
+  uint16_t r1 = (instr >> 6) & 0x7;
+
+  vm->reg[r0] = ~vm->reg[r1];
+  update_flags(vm, r0);
+}
+
+// 标志条件跳转
+// br cond_flag, pc_offset
+void branch(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  uint16_t cond_flag = (instr >> 9) & 0x7;
+  uint16_t pc_offset = sign_extend(instr & 0x1FF, 9);
+
+  // 传入标识与标志寄存器的值相符，N,P,Z
+  if (cond_flag & COND)
+  {
+    PC = (uint16_t)(PC + pc_offset);
+  }
+}
+
+// jump r
+// 跳转到寄存器中的值
+void jump(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  uint16_t r1 = (instr >> 6) & 0x7;
+  PC = vm->reg[r1];
+}
+
+// load indirect，从内存中获取数据，放入寄存器。间接模式
+// 以 pc 寄存器作为偏移基准
+// ldi dr, pc_offset
+// [[pc+pc_offset]]，pc+pc_offset 中的内容是数据的地址。
+void load_indirect(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  uint16_t pc_offset = instr & 0x1ff;
+
+  // 符号扩展
+  pc_offset = sign_extend(pc_offset, 9);
+
+  uint16_t r = (instr >> 9) & 0x7;
+
+  // 取出存储数据的地址
+  uint16_t address = mem_read(vm, (uint16_t)(PC + pc_offset));
+
+  // 取出数据
+  uint16_t data = mem_read(vm, address);
+
+  // 更新寄存器
+  vm->reg[r] = data;
+
+  VM_TRACE(core, "ldi r:%d, address:%d, data:%d\n", r, address, data);
+
+  // 更新标志寄存器
+  update_flags(vm, r);
+}
+
+// 将地址放入寄存器 r
+// 以 pc 寄存器作为偏移基准
+// lea r, pc_offset
+void load_effective_address(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  uint16_t pc_offset = instr & 0x1ff;
+
+  // 符号扩展
+  pc_offset = sign_extend(pc_offset, 9);
+
+  uint16_t address = PC + pc_offset;
+
+  uint16_t r = (instr >> 9) & 0x7;
+
+  // 更新寄存器
+  vm->reg[r] = address;
+
+  // 更新标志寄存器
+  update_flags(vm, r);
+}
+
+// jump resgister
+// 偏移量跳转
+void jump_subroutine(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  uint16_t long_flag = (instr >> 11) & 0x1;
+
+  // 先取出目标寄存器，JSRR R7 时不能被下面的写入覆盖
+  uint16_t r1 = (instr >> 6) & 0x7;
+  uint16_t target = vm->reg[r1];
+
+  // R7 保存 pc 值
+  vm->reg[R_R7] = PC;
+
+  if (long_flag)
+  {
+    // long_pc_offset
+    uint16_t long_pc_offset = sign_extend(instr & 0x7ff, 11);
+    PC = (uint16_t)(PC + long_pc_offset);
+  }
+  else
+  {
+    PC = target;
+  }
+}
+
+// ld r, pc_offset
+// 以 pc 寄存器作为偏移基准
+// 将距离下一条指令 pc_offset 处里的数据取出来，放入 r 中。
+void load(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  uint16_t pc_offset = sign_extend(instr & 0x1ff, 9);
+  uint16_t r0 = (instr >> 9) & 0x7;
+  vm->reg[r0] = mem_read(vm, (uint16_t)(PC + pc_offset));
+  update_flags(vm, r0);
+}
+
+// ldr r0, r1, offset
+// 以 r1 作为偏移基准
+// 将距离 r1，offset 处的数据取出来，放入 r0。
+void load_register(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  uint16_t r0 = (instr >> 9) & 0x7;
+
+  uint16_t r1 = (instr >> 6) & 0x7;
+
+  uint16_t offset = sign_extend(instr & 0x3f, 6);
+
+  uint16_t address = vm->reg[r1] + offset;
+  uint16_t value = mem_read(vm, address);
+
+  vm->reg[r0] = value;
+  update_flags(vm, r0);
+}
+
+// st r, pc_offset
+// 以 pc 寄存器作为偏移基准
+// 将 r 中的数据放入距离下一条指令，pc_offset 的地址中。
+void store(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  uint16_t pc_offset = sign_extend(instr & 0x1ff, 9);
+  uint16_t r0 = (instr >> 9) & 0x7;
+
+  uint16_t address = PC + pc_offset;
+  uint16_t value = vm->reg[r0];
+
+  mem_write(vm, address, value);
+}
+
+// sti r, pc_offset，间接存储，pc+pc_offset 是待存储数据地址的地址。
+void store_indirect(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  uint16_t pc_offset = sign_extend(instr & 0x1ff, 9);
+  uint16_t r0 = (instr >> 9) & 0x7;
+
+  uint16_t indirect_address = PC + pc_offset;
+  uint16_t address = mem_read(vm, indirect_address);
+
+  uint16_t value = vm->reg[r0];
+
+  mem_write(vm, address, value);
+}
+
+// str r0, r1, offsets
+// 以 r1 作为偏移基准
+void store_register(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  // r0
+  uint16_t r0 = (instr >> 9) & 0x7;
+
+  // r1
+  uint16_t r1 = (instr >> 6) & 0x7;
+
+  uint16_t offset = sign_extend(instr & 0x3f, 6);
+
+  uint16_t address = vm->reg[r1] + offset;
+  uint16_t value = vm->reg[r0];
+
+  mem_write(vm, address, value);
+}
+
+// 将 r0 寄存器中地址处的字符串打印出来。1 个字符占 2 字节。
+void trap_puts(Lc3 *vm)
+{
+  uint16_t address = vm->reg[R_R0];
+
+  VM_TRACE(&vm->core, "trap_puts begin address:%d\n", address);
+
+  for (uint16_t c; lc3_touch(vm, address), (c = vm->mem[address]); address++)
+  {
+    lc3_output_char(vm, (char)c);
+  }
+
+  lc3_output_flush(vm);
+  VM_TRACE(&vm->core, "\ntrap_puts end ...\n");
+}
+
+static void output_string(Lc3 *vm, const char *s)
+{
+  while (*s)
+  {
+    lc3_output_char(vm, *s++);
+  }
+
+  lc3_output_flush(vm);
+}
+
+// 先取键盘中断已收下、客户机还没读走的字符。需要等待输入时返回 0
+static int read_char(Lc3 *vm, uint16_t *c)
+{
+  if (vm->mem[MR_KBSR] & LC3_READY)
+  {
+    vm->mem[MR_KBSR] &= ~LC3_READY;
+    *c = vm->mem[MR_KBDR];
+    return 1;
+  }
+
+  if (!lc3_input_wait(vm))
+  {
+    return 0;
+  }
+
+  *c = lc3_input_char(vm);
+  return 1;
+}
+
+// 等待输入一个字符，最后存入 r0
+void trap_getc(Lc3 *vm)
+{
+  VM_TRACE(&vm->core, "trap_getc begin ...\n");
+
+  uint16_t c;
+  if (read_char(vm, &c))
+  {
+    vm->reg[R_R0] = c;
+  }
+
+  VM_TRACE(&vm->core, "trap_getc end ...\n");
+}
+
+// 将 r0 中的字符打印出来
+void trap_out(Lc3 *vm)
+{
+  VM_TRACE(&vm->core, "trap_out begin ...\n");
+
+  lc3_output_char(vm, (char)vm->reg[R_R0]);
+  lc3_output_flush(vm);
+
+  VM_TRACE(&vm->core, "\ntrap_out end ...\n");
+}
+
+// 提示输入一个字符，将字符打印，并放入 R0
+void trap_in(Lc3 *vm)
+{
+  VM_TRACE(&vm->core, "trap_in begin ...\n");
+
+  // 等待输入时整条指令重新执行，提示不能先打印
+  if ((vm->mem[MR_KBSR] & LC3_READY) || lc3_input_wait(vm))
+  {
+    uint16_t c;
+
+    output_string(vm, "Enter a character:");
+    if (read_char(vm, &c))
+    {
+      lc3_output_char(vm, (char)c);
+      vm->reg[R_R0] = (uint16_t)(char)c;
+    }
+  }
+
+  VM_TRACE(&vm->core, "\ntrap_in end ...\n");
+}
+
+// 将 r0 地址处的字符串出来，一个字符一字节
+void trap_put_string(Lc3 *vm)
+{
+  VM_TRACE(&vm->core, "trap_put_string begin ...\n");
+
+  for (uint16_t address = vm->reg[R_R0], c; lc3_touch(vm, address), (c = vm->mem[address]); address++)
+  {
+    // 低  8 位
+    char char1 = c & 0xff;
+    lc3_output_char(vm, char1);
+
+    // 高 8 位
+    char char2 = c >> 8;
+    if (char2)
+    {
+      lc3_output_char(vm, char2);
+    }
+  }
+
+  lc3_output_flush(vm);
+  VM_TRACE(&vm->core, "\ntrap_put_string end ...\n");
+}
+
+// op = 1111
+void trap(VmCore *core, uint32_t instr)
+{
+  Lc3 *vm = LC3(core);
+
+  // trap_code，低 8 位
+  uint16_t trap_code = instr & 0xff;
+  Lc3TrapHook *hook = &vm->trap_hooks[trap_code];
+
+  if (hook->handler)
+  {
+    hook->handler(vm, trap_code, hook->ctx);
+    return;
+  }
+
+  uint8_t mode = vm->trap_mode[trap_code];
+  int standard = trap_code >= TRAP_GETC && trap_code <= TRAP_HALT;
+
+  // 经向量表进入客户机的服务例程，例程以 RET 返回
+  if (mode == LC3_TRAP_GUEST || (mode == LC3_TRAP_AUTO && !standard && vm->mem[trap_code]))
+  {
+    VM_TRACE(core, "trap %02x -> %04x\n", trap_code, vm->mem[trap_code]);
+
+    vm->reg[R_R7] = PC;
+    PC = vm->mem[trap_code];
+    return;
+  }
+
+  switch (trap_code)
+  {
+  case TRAP_GETC:
+  {
+    trap_getc(vm);
+    break;
+  }
+
+  case TRAP_OUT:
+  {
+    trap_out(vm);
+    break;
+  }
+
+  case TRAP_PUTS:
+  {
+    trap_puts(vm);
+    break;
+  }
+
+  case TARP_IN:
+  {
+    trap_in(vm);
+    break;
+  }
+
+  case TRAP_PUTSP:
+  {
+    trap_put_string(vm);
+    break;
+  }
+
+  case TRAP_HALT:
+  {
+    output_string(vm, "Halt\n");
+    vm_core_halt(core);
+    break;
+  }
+
+  default:
+  {
+    printf("Unknown TrapCode!\n");
+    break;
+  }
+  }
+}
+
+// op = 1000
+void return_from_interrupt(VmCore *core, uint32_t instr)
+{
+  (void)instr;
+  lc3_return_from_interrupt(LC3(core));
+}
+
+// op = 1101，保留操作码
+void reserved(VmCore *core, uint32_t instr)
+{
+  (void)instr;
+  lc3_exception(LC3(core), LC3_VEC_ILLEGAL);
+}
+
+// 镜像是大端字节序
+int lc3_parse_image(uint16_t *mem, uint16_t *origin, const void *data, size_t size)
+{
+  const uint8_t *p = data;
+
+  if (size < 2)
+  {
+    return 0;
+  }
+
+  *origin = p[0] << 8 | p[1];
+
+  size_t count = (size - 2) / 2;
+  if (count > (size_t)(UINT16_MAX - *origin))
+  {
+    count = UINT16_MAX - *origin;
+  }
+
+  for (size_t i = 0; i < count; i++)
+  {
+    mem[*origin + i] = p[2 + 2 * i] << 8 | p[3 + 2 * i];
+  }
+
+  return 1;
+}
+
+int lc3_load(Lc3 *vm, const void *data, size_t size)
+{
+  if (!lc3_parse_image(vm->mem, &vm->origin, data, size))
+  {
+    return 0;
+  }
+
+  // 载入的代码可能覆盖已解码的地址
+  vm_core_flush(&vm->core);
+  lc3_jit_flush(vm);
+  return 1;
+}
+
+// 读取指令文件
+int read_image(Lc3 *vm, const char *image_path)
+{
+  FILE *file = fopen(image_path, "rb");
+  if (!file)
+  {
+    return 0;
+  }
+
+  // 镜像最大 128KB
+  uint8_t *data = malloc(2 * (UINT16_MAX + 1) + 2);
+  size_t size = fread(data, 1, 2 * (UINT16_MAX + 1) + 2, file);
+  fclose(file);
+
+  int ok = lc3_load(vm, data, size);
+  free(data);
+  return ok;
+}
+
+int lc3_watch(Lc3 *vm, uint16_t address, uint32_t len, int flags)
+{
+  if (vm->watchpoint_count == LC3_MAX_WATCHPOINTS || len == 0 || address + len > UINT16_MAX)
+  {
+    return 0;
+  }
+
+  vm->watchpoints[vm->watchpoint_count++] = (Lc3Watchpoint){address, address + len, flags};
+
+  for (uint32_t page = address >> LC3_PAGE_SHIFT; page <= (address + len - 1) >> LC3_PAGE_SHIFT; page++)
+  {
+    vm->page_flags[page] |= flags;
+  }
+
+  return 1;
+}
+
+static int trap_mode_parse(const char *name)
+{
+  static const char *const names[] = {[LC3_TRAP_AUTO] = "auto", [LC3_TRAP_NATIVE] = "native", [LC3_TRAP_GUEST] = "guest"};
+
+  for (int mode = 0; mode < 3; mode++)
+  {
+    if (strcmp(name, names[mode]) == 0)
+    {
+      return mode;
+    }
+  }
+
+  return -1;
+}
+
+int lc3_trap_option(Lc3 *vm, const char *spec)
+{
+  const char *eq = strchr(spec, '=');
+
+  if (!eq)
+  {
+    int mode = trap_mode_parse(spec);
+    if (mode < 0)
+    {
+      return 0;
+    }
+
+    memset(vm->trap_mode, mode, sizeof(vm->trap_mode));
+    return 1;
+  }
+
+  // 允许 x22 或 0x22 的写法
+  if (*spec == 'x' || *spec == 'X')
+  {
+    spec++;
+  }
+
+  char *end;
+  unsigned long code = strtoul(spec, &end, 16);
+  int mode = trap_mode_parse(eq + 1);
+
+  if (end != eq || code > 0xff || mode < 0)
+  {
+    return 0;
+  }
+
+  vm->trap_mode[code] = mode;
+  return 1;
+}
+
+int watch(VmCore *core, uint32_t address, uint32_t len, int flags)
+{
+  return address <= UINT16_MAX && lc3_watch(LC3(core), address, len, flags);
+}
+
+// 指令操作码占 4 位，取指不触发读观察点
+uint32_t fetch(VmCore *core, uint32_t pc, int *op, uint32_t *next_pc)
+{
+  if (pc >= UINT16_MAX)
+  {
+    printf("memory read error!\n");
+    exit(4);
+  }
+
+  lc3_touch(LC3(core), pc);
+  uint16_t instr = LC3(core)->mem[pc];
+
+  *op = instr >> 12;
+  *next_pc = (pc + 1) & 0xFFFF;
+  return instr;
+}
+
+void dump(VmCore *core, FILE *out)
+{
+  Lc3 *vm = LC3(core);
+
+  for (int r = R_R0; r <= R_R7; r++)
+  {
+    fprintf(out, "R%d:%04x ", r, vm->reg[r]);
+  }
+
+  fprintf(out, "PC:%04x COND:%x PSR:%04x\n", PC, COND, vm->psr | COND);
+}
+
+uint32_t peek(VmCore *core, uint32_t address)
+{
+  if (address >= UINT16_MAX)
+  {
+    return 0;
+  }
+
+  lc3_touch(LC3(core), address);
+  return LC3(core)->mem[address];
+}
+
+// 用于打印当前执行操作码
+static const char *const op_list[] = {"BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR", "RTI", "NOT", "LDI", "STI", "JMP", "RES", "LEA", "TRAP"};
+
+static const VmHandler handlers[] = {
+    [OP_BR] = branch,
+    [OP_ADD] = add,
+    [OP_LD] = load,
+    [OP_ST] = store,
+    [OP_JSR] = jump_subroutine,
+    [OP_AND] = and,
+    [OP_LDR] = load_register,
+    [OP_STR] = store_register,
+    [OP_RTI] = return_from_interrupt,
+    [OP_NOT] = not,
+    [OP_LDI] = load_indirect,
+    [OP_STI] = store_indirect,
+    [OP_JMP] = jump,
+    [OP_RES] = reserved,
+    [OP_LEA] = load_effective_address,
+    [OP_TRAP] = trap,
+};
+
+const VmIsa lc3_isa = {
+    .name = "lc3",
+    .op_count = 16,
+    .op_names = op_list,
+    .handlers = handlers,
+    .fetch = fetch,
+    .dump = dump,
+    .peek = peek,
+    .watch = watch,
+    .interrupt = lc3_interrupt,
+};
+
+static void init_core(Lc3 *vm)
+{
+  vm_core_init(&vm->core, &lc3_isa, UINT16_MAX + 1);
+  vm->page_flags[MR_KBSR >> LC3_PAGE_SHIFT] |= LC3_PAGE_DEVICE;
+  vm->page_flags[MR_MCR >> LC3_PAGE_SHIFT] |= LC3_PAGE_DEVICE;
+}
+
+int lc3_init(Lc3 *vm)
+{
+  vm->mem = lc3_mem_alloc();
+  if (!vm->mem)
+  {
+    return 0;
+  }
+
+  init_core(vm);
+  return 1;
+}
+
+void lc3_fini(Lc3 *vm)
+{
+  if (vm->io.file)
+  {
+    fclose(vm->io.file);
+    vm->io.file = NULL;
+  }
+
+  free(vm->io.input);
+  free(vm->io.output);
+  vm->io.input = vm->io.output = NULL;
+
+  lc3_checkpoint_free(vm);
+  lc3_pretranslate_free(vm);
+  lc3_jit_free(vm);
+  free(vm->aot);
+  vm->aot = NULL;
+  vm_core_free(&vm->core);
+
+  lc3_mem_free(vm->mem);
+  vm->mem = NULL;
+}
+
+int lc3_recycle(Lc3 *vm)
+{
+  uint16_t *mem = vm->mem;
+  VmSlot *slots = vm->core.slots;
+
+  // lc3_fini 不释放保留的映射
+  vm->mem = NULL;
+  vm->core.slots = NULL;
+  lc3_fini(vm);
+
+  memset(vm, 0, sizeof(*vm));
+  init_core(vm);
+  vm->mem = mem;
+  vm->core.slots = slots;
+  vm_core_clear_slots(&vm->core);
+
+  if (!lc3_mem_clear(vm->mem))
+  {
+    lc3_fini(vm);
+    return 0;
+  }
+
+  return 1;
+}
+
+Lc3 *lc3_create(void)
+{
+  Lc3 *vm = calloc(1, sizeof(Lc3));
+
+  if (vm && !lc3_init(vm))
+  {
+    free(vm);
+    return NULL;
+  }
+
+  return vm;
+}
+
+void lc3_destroy(Lc3 *vm)
+{
+  lc3_fini(vm);
+  free(vm);
+}
+
+void lc3_reset(Lc3 *vm)
+{
+  PC = vm->origin;
+
+  // 标志寄存器须恰有一位，否则开头的 BRnzp 不会跳转
+  COND = FL_ZRO;
+
+  vm->psr = LC3_PSR_USER;
+  vm->saved_ssp = LC3_SSP;
+  vm->saved_usp = 0;
+  vm->timer_deadline = 0;
+}
@@ -0,0 +1,393 @@
+#ifndef LC3_H
+#define LC3_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lc3_api.h"
+#include "vm_core.h"
+
+// 寄存器定义，PC 由内核的 core.pc 保存
+typedef enum
+{
+  R_R0,
+  R_R1,
+  R_R2,
+  R_R3,
+  R_R4,
+  R_R5,
+  R_R6,
+  R_R7,
+  R_COND,
+  R_COUNT
+} Registers;
+
+// 指令定义
+typedef enum
+{
+  OP_BR = 0,    // 条件分支
+  OP_ADD = 1,   // 加法
+  OP_LD = 2,    // load
+  OP_ST = 3,    // store
+  OP_JSR = 4,   // jump resgister
+  OP_AND = 5,   // 与运算
+  OP_LDR = 6,   // load register
+  OP_STR = 7,   // store register
+  OP_RTI = 8,   // unused
+  OP_NOT = 9,   // 取反
+  OP_LDI = 10,  // load indirect
+  OP_STI = 11,  // store indirect
+  OP_JMP = 12,  // jump
+  OP_RES = 13,  // reserved
+  OP_LEA = 14,  // load effective address
+  OP_TRAP = 15, // trap，陷阱，相当于中断
+} InstructionSet;
+
+// 标志定义
+typedef enum
+{
+  FL_POS = 1 << 0, // 正数
+  FL_ZRO = 1 << 1, // 0
+  FL_NEG = 1 << 2  //负数
+} ConditionFlags;
+
+// 中断类型
+typedef enum
+{
+  TRAP_GETC = 0x20, // 从键盘输入
+  TRAP_OUT = 0x21,  //输出字符
+  TRAP_PUTS = 0x22, // 输出字符串
+  TARP_IN = 0x23,
+  TRAP_PUTSP = 0x24,
+  TRAP_HALT = 0x25, // 退出程序
+} TrapSet;
+
+// 内存映射的设备寄存器
+typedef enum
+{
+  MR_KBSR = 0xFE00, // 键盘状态，最高位为 1 表示有输入
+  MR_KBDR = 0xFE02, // 键盘数据
+  MR_DSR = 0xFE04,  // 显示状态，最高位为 1 表示可以输出
+  MR_DDR = 0xFE06,  // 显示数据，写入即输出
+  MR_TMR = 0xFE08,  // 定时器状态，最高位为 1 表示到期，写入以清除
+  MR_TMI = 0xFE0A,  // 定时器间隔（指令数），0 表示关闭
+  MR_PSR = 0xFFFC,  // 处理器状态
+  MR_MCR = 0xFFFE,  // 机器控制，最高位清 0 时停机
+} MemoryMappedRegisters;
+
+// 设备状态寄存器的位
+#define LC3_READY (1 << 15)
+#define LC3_IE (1 << 14) // 开中断
+
+// PSR：bit 15 为 1 表示用户态，bit 10~8 为优先级，bit 2~0 为条件码（保存在 reg[R_COND]）
+#define LC3_PSR_USER 0x8000
+#define LC3_PSR_PRIORITY(psr) (((psr) >> 8) & 0x7)
+
+// 中断向量表，PC = mem[LC3_IVT + 向量]
+#define LC3_IVT 0x0100
+
+typedef enum
+{
+  LC3_VEC_PRIVILEGE = 0x00, // 用户态执行 RTI 或写 PSR
+  LC3_VEC_ILLEGAL = 0x01,   // 保留操作码
+  LC3_VEC_KEYBOARD = 0x80,  // 优先级 4
+  LC3_VEC_TIMER = 0x81,     // 优先级 5
+} Lc3Vector;
+
+// 开了键盘中断时每隔这么多条指令轮询一次输入
+#define LC3_KEYBOARD_POLL 1024
+
+// 复位后的监督栈栈顶
+#define LC3_SSP 0x3000
+
+// TRAP 的执行方式，按 trap_code 分别设置
+typedef enum
+{
+  LC3_TRAP_AUTO,   // 六个标准例程在宿主机上执行，其余代码在向量表非 0 时经向量表跳转
+  LC3_TRAP_NATIVE, // 在宿主机上执行，非标准代码报错
+  LC3_TRAP_GUEST,  // R7 = PC，PC = mem[trap_code]，由客户机的 OS 例程处理
+} Lc3TrapMode;
+
+// 观察点和设备按页标记，访问未观察的页只多读一个标志字节
+#define LC3_PAGE_SHIFT 8
+#define LC3_PAGES ((UINT16_MAX >> LC3_PAGE_SHIFT) + 1)
+#define LC3_MAX_WATCHPOINTS 16
+
+// 内存映射的大小，比 UINT16_MAX 个字多一个字，凑满宿主机的页
+#define LC3_MEM_BYTES (2 * (UINT16_MAX + 1))
+
+// page_flags 中除 VM_WATCH_READ/VM_WATCH_WRITE 外，设备寄存器所在页的标记
+#define LC3_PAGE_DEVICE 4
+// 从检查点恢复后还没载入的页，第一次访问时由 lc3_page_in 解压
+#define LC3_PAGE_LAZY 8
+// 有轨迹覆盖的字的页，写入时检查是否要丢弃轨迹，见 lc3_jit.c
+#define LC3_PAGE_CODE 16
+
+typedef struct
+{
+  uint16_t start;
+  uint32_t end; // 不含
+  int flags;    // VM_WATCH_READ | VM_WATCH_WRITE
+} Lc3Watchpoint;
+
+// 输入事件，记录文件中的类型
+typedef enum
+{
+  LC3_EVENT_CHAR,      // GETC/IN 读到的字符
+  LC3_EVENT_POLL_CHAR, // 轮询 KBSR 时有输入，之前若干次轮询为空
+} Lc3EventKind;
+
+typedef enum
+{
+  LC3_IO_LIVE,
+  LC3_IO_RECORD, // 从终端输入，同时记录
+  LC3_IO_REPLAY,  // 从记录文件输入，不读终端
+  LC3_IO_SESSION, // 输入输出都在内存缓冲区中，没有输入或输出满时暂停，见 lc3_session
+} Lc3IoMode;
+
+// 记录文件："LC3R" 和版本号之后是追加写入的事件，每个事件为
+// ULEB128((与上一事件的指令数之差) << 2 | 类型)、ULEB128(值)，
+// POLL_CHAR 再跟 ULEB128(之前为空的轮询次数)。回放按轮询次数决定 KBSR 何时就绪，
+// 指令数用于校验回放是否与记录一致
+typedef struct
+{
+  Lc3IoMode mode;
+  FILE *file;
+  uint64_t last_count;  // 上一个事件的指令数
+  uint64_t empty_polls; // 自上一个事件以来为空的轮询次数
+
+  // 当前事件，指令数要等该指令执行完（vm_core_yield）才确定
+  Lc3EventKind kind;
+  uint16_t value;
+  uint64_t polls;
+
+  // 回放时下一个事件是否已读出
+  int loaded;
+  uint64_t expected_count;
+  int diverged;
+
+  // 会话模式的缓冲区，输入读完且 input_eof 时读到 xFFFF
+  char *input;
+  size_t input_len;
+  size_t input_pos;
+  size_t input_cap;
+  int input_eof;
+
+  char *output;
+  size_t output_len;
+  size_t output_cap;
+  size_t output_limit;
+} Lc3Io;
+
+// 嵌入方注册的回调，见 lc3_api.h
+// 检查点的基准内存、后台写入线程和恢复时映射的文件，见 lc3_checkpoint.c
+typedef struct Lc3Checkpoint Lc3Checkpoint;
+
+// 载入时后台预解码的状态，见 lc3_cfg.c
+typedef struct Lc3Pretranslate Lc3Pretranslate;
+
+// 热轨迹引擎和分层执行的状态，见 lc3_jit.c
+typedef struct Lc3Jit Lc3Jit;
+
+typedef struct
+{
+  Lc3TrapHandler handler;
+  void *ctx;
+} Lc3TrapHook;
+
+#define LC3_MAX_DEVICES 16
+
+typedef struct
+{
+  uint16_t address;
+  Lc3DeviceRead read;
+  Lc3DeviceWrite write;
+  void *ctx;
+} Lc3Device;
+
+// 机器状态，typedef 见 lc3_api.h
+struct Lc3
+{
+  VmCore core; // 公共内核，必须位于首位
+
+  // 内存区，UINT16_MAX 个字，映射方式见 lc3_image.c
+  uint16_t *mem;
+
+  // 寄存器数组
+  uint16_t reg[R_COUNT];
+
+  // 载入地址
+  uint16_t origin;
+
+  // 每页被观察的访问类型
+  uint8_t page_flags[LC3_PAGES];
+  Lc3Watchpoint watchpoints[LC3_MAX_WATCHPOINTS];
+  int watchpoint_count;
+
+  Lc3Io io;
+
+  // 每个 trap_code 的执行方式，默认 LC3_TRAP_AUTO
+  uint8_t trap_mode[256];
+
+  // 特权级和优先级，条件码在 reg[R_COND]
+  uint16_t psr;
+  // 不在使用中的另一个栈的 R6
+  uint16_t saved_ssp;
+  uint16_t saved_usp;
+  // 定时器下次到期时的 core.retired，0 表示在下一次片间检查时重新开始计时
+  uint64_t timer_deadline;
+
+  Lc3TrapHook trap_hooks[256];
+  Lc3Device devices[LC3_MAX_DEVICES];
+  int device_count;
+
+  Lc3Checkpoint *checkpoint;
+  Lc3Pretranslate *pretranslate;
+  Lc3Jit *jit;
+
+  // lc3_aot 生成的代码跨片保留的返回栈和内联缓存，见 lc3_aot.h
+  void *aot;
+};
+
+extern const VmIsa lc3_isa;
+
+// 初始化 calloc 得到的或清零的实例，lc3_create 和实例池共用。分配内存失败时返回 0
+int lc3_init(Lc3 *vm);
+
+// 释放实例持有的资源，不释放 vm 本身
+void lc3_fini(Lc3 *vm);
+
+// 实例池复用实例：与 lc3_fini 后再 lc3_init 相同，但保留内存和预解码缓存的映射，只把它们清零。
+// 失败时实例已经 lc3_fini，返回 0
+int lc3_recycle(Lc3 *vm);
+
+// 把 .obj 镜像解析到 mem 中，lc3_load 和 lc3_image_create 共用
+int lc3_parse_image(uint16_t *mem, uint16_t *origin, const void *data, size_t size);
+
+// 客户机内存的映射，见 lc3_image.c
+uint16_t *lc3_mem_alloc(void);
+
+// 把 mem 清零，地址不变。成功返回 1
+int lc3_mem_clear(uint16_t *mem);
+
+void lc3_mem_free(uint16_t *mem);
+
+// 内存内容的 FNV-1a 哈希，检查点和共享镜像用它识别镜像
+uint64_t lc3_hash_words(const uint16_t *words, size_t count);
+
+// 读取指令文件，可多次调用载入多个镜像
+int read_image(Lc3 *vm, const char *image_path);
+
+uint16_t mem_read(Lc3 *vm, int address);
+
+void mem_write(Lc3 *vm, uint16_t address, uint16_t data);
+
+// 观察 [address, address + len) 的读（VM_WATCH_READ）或写（VM_WATCH_WRITE）。
+// 命中时打印 PC 和新旧值，调试器中还会停止执行。成功返回 1
+int lc3_watch(Lc3 *vm, uint16_t address, uint32_t len, int flags);
+
+// 设置 TRAP 执行方式：spec 为 auto/native/guest 时作用于所有代码，
+// 为 CODE=MODE（CODE 为十六进制，如 x22=native）时只作用于该代码。成功返回 1
+int lc3_trap_option(Lc3 *vm, const char *spec);
+
+// 内存映射设备，mem_read/mem_write 在设备页上调用：读之前更新寄存器的值，
+// 写入时返回寄存器实际保存的值
+void lc3_device_read(Lc3 *vm, uint16_t address);
+
+uint16_t lc3_device_write(Lc3 *vm, uint16_t address, uint16_t data);
+
+// 片之间轮询键盘和定时器，投递优先级高于当前的中断（lc3_isa.interrupt）
+void lc3_interrupt(VmCore *core);
+
+// 同步异常，向量表中没有例程时报错停机
+void lc3_exception(Lc3 *vm, Lc3Vector vector);
+
+// 从监督栈弹出 PC 和 PSR
+void lc3_return_from_interrupt(Lc3 *vm);
+
+// 记录或回放输入，在 lc3_reset 之前调用。成功返回 1
+int lc3_record(Lc3 *vm, const char *path);
+
+int lc3_replay(Lc3 *vm, const char *path);
+
+// 所有不确定的输入都经过这里：GETC/IN 读一个字符，KBSR 轮询是否有输入
+uint16_t lc3_input_char(Lc3 *vm);
+
+int lc3_input_poll(Lc3 *vm, uint16_t *c);
+
+// 会话模式下没有输入时让当前指令等待：pc 退回该指令，lc3_run 返回 VM_STOP_INPUT。
+// 可以继续执行时返回 1
+int lc3_input_wait(Lc3 *vm);
+
+// 所有输出都经过这里，会话模式下写入缓冲区，达到上限时在当前指令后暂停
+void lc3_output_char(Lc3 *vm, char c);
+
+void lc3_output_flush(Lc3 *vm);
+
+// 载入检查点中 LC3_PAGE_LAZY 标记的页
+void lc3_page_in(Lc3 *vm, uint16_t page);
+
+// 绕过 mem_read 直接读写 mem 之前调用
+static inline void lc3_touch(Lc3 *vm, uint16_t address)
+{
+  if (vm->page_flags[address >> LC3_PAGE_SHIFT] & LC3_PAGE_LAZY)
+  {
+    lc3_page_in(vm, address >> LC3_PAGE_SHIFT);
+  }
+}
+
+// 等待后台写入，释放检查点状态
+void lc3_checkpoint_free(Lc3 *vm);
+
+// 静态控制流图，flags 按地址标记
+#define LC3_CFG_CODE 1     // 从入口可达的指令
+#define LC3_CFG_BLOCK 2    // 基本块的第一条指令
+#define LC3_CFG_FUNCTION 4 // 起始地址、JSR 的目标、TRAP 和中断例程
+
+// lc3_cfg_build 的选项：LEA 算出的地址、从该处开始连续的指向镜像内的字（跳转表），
+// 以及 LD/LDI 读到的值也作为入口。须给出载入标记
+#define LC3_CFG_POINTERS 1
+
+// 调用图的边
+typedef struct
+{
+  uint16_t site; // JSR/TRAP 指令的地址
+  uint16_t target;
+} Lc3Call;
+
+typedef struct
+{
+  uint8_t flags[UINT16_MAX + 1];
+  int instr_count;
+  int block_count;
+  int function_count;
+
+  Lc3Call *calls;
+  int call_count;
+  int call_cap;
+} Lc3Cfg;
+
+// 从 origin、TRAP 和中断向量出发恢复 mem 的控制流图。loaded 标记镜像中的字，
+// 为 NULL 时以 0 作为代码的结束
+Lc3Cfg *lc3_cfg_build(const uint16_t *mem, const uint8_t *loaded, uint16_t origin, int options);
+
+void lc3_cfg_free(Lc3Cfg *cfg);
+
+// 等待后台预解码线程，释放状态
+void lc3_pretranslate_free(Lc3 *vm);
+
+// -s 时打印控制流图的规模和预解码的结果，还没有并入时不打印
+void lc3_pretranslate_report(Lc3 *vm, FILE *out);
+
+// 写入了 LC3_PAGE_CODE 页上的 address，是轨迹覆盖的字时在回到引擎后丢弃全部轨迹
+void lc3_jit_written(Lc3 *vm, uint16_t address);
+
+// 内存被整体替换（载入镜像、恢复检查点），丢弃全部轨迹
+void lc3_jit_flush(Lc3 *vm);
+
+void lc3_jit_free(Lc3 *vm);
+
+// -s 时打印轨迹的个数、进出次数和轨迹中执行的指令数，分层执行时还打印每层的指令数、时间和升层的次数
+void lc3_jit_report(Lc3 *vm, FILE *out);
+
+#endif
@@ -0,0 +1,304 @@
+#ifndef LC3_HPP
+#define LC3_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "lc3_api.h"
+
+// lc3_api.h 的 C++ 封装。Vm 只能移动不能复制，可以从 Pool 取得，析构时归还（Pool 须比 Vm 活得久）。
+// 回调保存在堆上，Vm 移动后仍然有效
+namespace lc3
+{
+
+enum class Stop
+{
+  None = VM_STOP_NONE,
+  Halt = VM_STOP_HALT,
+  Budget = VM_STOP_BUDGET,
+  Timeout = VM_STOP_TIMEOUT,
+  Break = VM_STOP_BREAK,
+  Watch = VM_STOP_WATCH,
+  Request = VM_STOP_REQUEST,
+  Input = VM_STOP_INPUT,
+  Output = VM_STOP_OUTPUT,
+};
+
+inline const char *name(Stop stop)
+{
+  return vm_core_stop_name(static_cast<VmStopReason>(stop));
+}
+
+class Pool;
+
+// 共享镜像，见 lc3_image_create。格式不对时抛出 std::invalid_argument
+class Image
+{
+public:
+  Image(const void *data, size_t size) : image_(lc3_image_create(data, size))
+  {
+    if (!image_)
+    {
+      throw std::invalid_argument("bad lc3 image");
+    }
+  }
+
+  ~Image() { lc3_image_destroy(image_); }
+
+  Image(const Image &) = delete;
+  Image &operator=(const Image &) = delete;
+
+  const Lc3Image *get() const { return image_; }
+
+private:
+  Lc3Image *image_;
+};
+
+class Vm
+{
+public:
+  using TrapHandler = std::function<void(Vm &vm, uint8_t trap_code)>;
+  using DeviceRead = std::function<uint16_t(Vm &vm, uint16_t address)>;
+  using DeviceWrite = std::function<void(Vm &vm, uint16_t address, uint16_t value)>;
+
+  Vm() : Vm(lc3_create(), nullptr) {}
+
+  Vm(Vm &&other) noexcept : vm_(other.vm_), pool_(other.pool_), hooks_(std::move(other.hooks_))
+  {
+    other.vm_ = nullptr;
+    other.pool_ = nullptr;
+    adopt_hooks();
+  }
+
+  Vm &operator=(Vm &&other) noexcept
+  {
+    if (this != &other)
+    {
+      release();
+      vm_ = other.vm_;
+      pool_ = other.pool_;
+      hooks_ = std::move(other.hooks_);
+      other.vm_ = nullptr;
+      other.pool_ = nullptr;
+      adopt_hooks();
+    }
+
+    return *this;
+  }
+
+  Vm(const Vm &) = delete;
+  Vm &operator=(const Vm &) = delete;
+
+  ~Vm() { release(); }
+
+  explicit operator bool() const { return vm_ != nullptr; }
+
+  Lc3 *get() const { return vm_; }
+
+  bool load(const void *data, size_t size) { return lc3_load(vm_, data, size) != 0; }
+
+  // 与其他实例共享未写入的内存页
+  bool load(const Image &image) { return lc3_load_image(vm_, image.get()) != 0; }
+
+  void reset() { lc3_reset(vm_); }
+
+  // 再执行最多 n 条指令，0 表示不限
+  Stop run(uint64_t n = 0) { return static_cast<Stop>(lc3_run(vm_, n)); }
+
+  // 每 batch 条指令检查一次 until(vm)，成立时返回 Stop::Request
+  template <typename F>
+  Stop run_until(F until, uint64_t batch = 0)
+  {
+    std::pair<F *, Vm *> ctx(&until, this);
+
+    auto check = [](Lc3 *, void *p) -> int {
+      auto *c = static_cast<std::pair<F *, Vm *> *>(p);
+      return (*c->first)(*c->second) ? 1 : 0;
+    };
+
+    return static_cast<Stop>(lc3_run_until(vm_, check, &ctx, batch));
+  }
+
+  // 供回调使用，当前指令执行完后停止
+  void stop() { lc3_stop(vm_); }
+
+  uint64_t retired() const { return lc3_retired(vm_); }
+
+  uint16_t reg(int r) const { return lc3_reg(vm_, r); }
+
+  void set_reg(int r, uint16_t value) { lc3_set_reg(vm_, r, value); }
+
+  uint16_t pc() const { return lc3_pc(vm_); }
+
+  void set_pc(uint16_t pc) { lc3_set_pc(vm_, pc); }
+
+  uint16_t psr() const { return lc3_psr(vm_); }
+
+  uint16_t peek(uint16_t address) const { return lc3_peek(vm_, address); }
+
+  void poke(uint16_t address, uint16_t value) { lc3_poke(vm_, address, value); }
+
+  // 会话模式，见 lc3_session：run 在需要输入时返回 Stop::Input，输出满 output_limit 时返回 Stop::Output
+  void session(size_t output_limit) { lc3_session(vm_, output_limit); }
+
+  void feed(const std::string &input) { lc3_feed(vm_, input.data(), input.size()); }
+
+  void feed_eof() { lc3_feed_eof(vm_); }
+
+  std::string take_output()
+  {
+    std::string output;
+    char buf[256];
+
+    for (size_t n; (n = lc3_take_output(vm_, buf, sizeof(buf))) > 0;)
+    {
+      output.append(buf, n);
+    }
+
+    return output;
+  }
+
+  void on_trap(uint8_t trap_code, TrapHandler handler)
+  {
+    Hooks &hooks = ensure_hooks();
+
+    hooks.traps[trap_code] = std::move(handler);
+    lc3_on_trap(vm_, trap_code, hooks.traps[trap_code] ? trap_thunk : nullptr, &hooks);
+  }
+
+  bool map_device(uint16_t address, DeviceRead read, DeviceWrite write)
+  {
+    Hooks &hooks = ensure_hooks();
+    std::unique_ptr<Device> device(new Device{&hooks, std::move(read), std::move(write)});
+
+    if (!lc3_map_device(vm_, address, device->read ? read_thunk : nullptr,
+                        device->write ? write_thunk : nullptr, device.get()))
+    {
+      return false;
+    }
+
+    hooks.devices.push_back(std::move(device));
+    return true;
+  }
+
+private:
+  friend class Pool;
+
+  struct Hooks;
+
+  struct Device
+  {
+    Hooks *hooks;
+    DeviceRead read;
+    DeviceWrite write;
+  };
+
+  struct Hooks
+  {
+    Vm *owner;
+    TrapHandler traps[256];
+    std::vector<std::unique_ptr<Device>> devices;
+  };
+
+  Vm(Lc3 *vm, Lc3Pool *pool) : vm_(vm), pool_(pool)
+  {
+    if (!vm_)
+    {
+      throw std::bad_alloc();
+    }
+  }
+
+  Hooks &ensure_hooks()
+  {
+    if (!hooks_)
+    {
+      hooks_.reset(new Hooks());
+      hooks_->owner = this;
+    }
+
+    return *hooks_;
+  }
+
+  void adopt_hooks()
+  {
+    if (hooks_)
+    {
+      hooks_->owner = this;
+    }
+  }
+
+  void release()
+  {
+    if (vm_)
+    {
+      if (pool_)
+      {
+        lc3_pool_release(pool_, vm_);
+      }
+      else
+      {
+        lc3_destroy(vm_);
+      }
+    }
+
+    vm_ = nullptr;
+    pool_ = nullptr;
+    hooks_.reset();
+  }
+
+  static void trap_thunk(Lc3 *, uint8_t trap_code, void *ctx)
+  {
+    Hooks *hooks = static_cast<Hooks *>(ctx);
+    hooks->traps[trap_code](*hooks->owner, trap_code);
+  }
+
+  static uint16_t read_thunk(Lc3 *, uint16_t address, void *ctx)
+  {
+    Device *device = static_cast<Device *>(ctx);
+    return device->read(*device->hooks->owner, address);
+  }
+
+  static void write_thunk(Lc3 *, uint16_t address, uint16_t value, void *ctx)
+  {
+    Device *device = static_cast<Device *>(ctx);
+    device->write(*device->hooks->owner, address, value);
+  }
+
+  Lc3 *vm_;
+  Lc3Pool *pool_;
+  std::unique_ptr<Hooks> hooks_;
+};
+
+class Pool
+{
+public:
+  explicit Pool(int capacity) : pool_(lc3_pool_create(capacity))
+  {
+    if (!pool_)
+    {
+      throw std::bad_alloc();
+    }
+  }
+
+  ~Pool() { lc3_pool_destroy(pool_); }
+
+  Pool(const Pool &) = delete;
+  Pool &operator=(const Pool &) = delete;
+
+  // 没有空闲实例时抛出 std::bad_alloc
+  Vm acquire() { return Vm(lc3_pool_acquire(pool_), pool_); }
+
+private:
+  Lc3Pool *pool_;
+};
+
+} // namespace lc3
+
+#endif
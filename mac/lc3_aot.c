@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+
+// LC-3 镜像的预先翻译：从入口恢复控制流图（lc3_cfg_build），把可达的指令翻译成 C，运行时见 lc3_aot.h。
+//
+//   lc3_aot image.obj out.c
+//
+// 除起始地址、TRAP 和中断向量外，LEA 算出的地址和 LD/LDI 读到的落在镜像内的常量（函数指针表）
+// 也作为入口。JMP/JSRR/RET 和 TRAP/RTI 之后的目标在运行时才知道，经分派的 switch 跳到对应的标号，
+// 不在其中的地址由解释器逐条执行。每个基本块开头的标号处检查本片的指令数。
+// 镜像不能修改自己的代码：写入已翻译的指令不会生效
+
+#define WORDS (UINT16_MAX + 1)
+
+typedef struct
+{
+  uint16_t mem[WORDS];
+  uint8_t loaded[WORDS]; // 镜像中的字
+  uint16_t origin;
+
+  const uint8_t *flags; // 控制流图，LC3_CFG_*
+
+  int site[WORDS]; // 间接跳转点（RET 以外的 JMP、JSRR）的编号加 1，0 表示不是
+  int site_count;
+} Cfg;
+
+static uint16_t sign_extend(uint16_t x, int bit_count)
+{
+  if ((x >> (bit_count - 1)) & 1)
+  {
+    x |= 0xFFFF << bit_count;
+  }
+
+  return x;
+}
+
+// BR 的条件，cc 为最后写入寄存器的值
+static const char *condition(int nzp)
+{
+  static const char *const conditions[] = {
+      "0", "(int16_t)cc > 0", "cc == 0", "(int16_t)cc >= 0",
+      "(int16_t)cc < 0", "cc != 0", "(int16_t)cc <= 0", "1",
+  };
+
+  return conditions[nzp];
+}
+
+// 跳到 target：翻译过的直接 goto，否则经分派
+static void emit_goto(FILE *out, const Cfg *cfg, uint16_t target)
+{
+  if ((cfg->flags[target] & LC3_CFG_CODE) && (cfg->flags[target] & LC3_CFG_BLOCK))
+  {
+    fprintf(out, "goto L%04x;", target);
+  }
+  else
+  {
+    fprintf(out, "{ pc = 0x%04x; goto dispatch; }", target);
+  }
+}
+
+static void emit_push(FILE *out, const Cfg *cfg, uint16_t next)
+{
+  if ((cfg->flags[next] & LC3_CFG_CODE) && (cfg->flags[next] & LC3_CFG_BLOCK))
+  {
+    fprintf(out, "AOT_PUSH(0x%04x, L%04x); ", next, next);
+  }
+}
+
+static void emit_instr(FILE *out, const Cfg *cfg, uint16_t pc)
+{
+  uint16_t instr = cfg->mem[pc];
+  uint16_t next = pc + 1;
+  int dr = (instr >> 9) & 7;
+  int sr1 = (instr >> 6) & 7;
+  uint16_t imm5 = sign_extend(instr & 0x1F, 5);
+  uint16_t pc9 = next + sign_extend(instr & 0x1FF, 9);
+  uint16_t off6 = sign_extend(instr & 0x3F, 6);
+
+  fprintf(out, "  n++; // %04x: %04x\n  ", pc, instr);
+
+  switch (instr >> 12)
+  {
+  case 0x1: // ADD
+  case 0x5: // AND
+  {
+    const char *op = instr >> 12 == 0x1 ? "+" : "&";
+
+    if (instr & 0x20)
+    {
+      fprintf(out, "r[%d] = r[%d] %s 0x%04x; cc = r[%d];\n", dr, sr1, op, imm5, dr);
+    }
+    else
+    {
+      fprintf(out, "r[%d] = r[%d] %s r[%d]; cc = r[%d];\n", dr, sr1, op, instr & 7, dr);
+    }
+    break;
+  }
+
+  case 0x9: // NOT
+    fprintf(out, "r[%d] = ~r[%d]; cc = r[%d];\n", dr, sr1, dr);
+    break;
+
+  case 0xE: // LEA
+    fprintf(out, "r[%d] = 0x%04x; cc = r[%d];\n", dr, pc9, dr);
+    break;
+
+  case 0x0: // BR
+    if (dr)
+    {
+      fprintf(out, "if (%s) ", condition(dr));
+      emit_goto(out, cfg, pc9);
+    }
+    fprintf(out, "\n");
+    break;
+
+  case 0xC: // JMP/RET
+    if (sr1 == 7)
+    {
+      fprintf(out, "pc = r[7]; AOT_RET(); goto dispatch;\n");
+    }
+    else
+    {
+      fprintf(out, "pc = r[%d]; AOT_IC(%d); goto dispatch;\n", sr1, cfg->site[pc] - 1);
+    }
+    break;
+
+  case 0x4: // JSR/JSRR，返回地址翻译过时压入影子返回栈
+    if (instr & 0x800)
+    {
+      fprintf(out, "r[7] = 0x%04x; ", next);
+      emit_push(out, cfg, next);
+      emit_goto(out, cfg, next + sign_extend(instr & 0x7FF, 11));
+      fprintf(out, "\n");
+    }
+    else
+    {
+      fprintf(out, "pc = r[%d]; r[7] = 0x%04x; ", sr1, next);
+      emit_push(out, cfg, next);
+      fprintf(out, "AOT_IC(%d); goto dispatch;\n", cfg->site[pc] - 1);
+    }
+    break;
+
+  case 0x2: // LD
+  case 0x6: // LDR
+    if (instr >> 12 == 0x2)
+    {
+      fprintf(out, "a = 0x%04x;\n  ", pc9);
+    }
+    else
+    {
+      fprintf(out, "a = r[%d] + 0x%04x;\n  ", sr1, off6);
+    }
+
+    fprintf(out, "if (AOT_SLOW(a)) AOT_CALL(0x%04x, 0x%04x); else { r[%d] = vm->mem[a]; cc = r[%d]; }\n",
+            instr, next, dr, dr);
+    break;
+
+  case 0xA: // LDI
+    fprintf(out, "a = 0x%04x;\n  ", pc9);
+    fprintf(out, "if (AOT_SLOW(a) || AOT_SLOW(vm->mem[a])) AOT_CALL(0x%04x, 0x%04x); "
+                 "else { r[%d] = vm->mem[vm->mem[a]]; cc = r[%d]; }\n",
+            instr, next, dr, dr);
+    break;
+
+  case 0x3: // ST
+  case 0x7: // STR
+    if (instr >> 12 == 0x3)
+    {
+      fprintf(out, "a = 0x%04x;\n  ", pc9);
+    }
+    else
+    {
+      fprintf(out, "a = r[%d] + 0x%04x;\n  ", sr1, off6);
+    }
+
+    fprintf(out, "if (AOT_SLOW(a)) AOT_CALL(0x%04x, 0x%04x); else { vm->mem[a] = r[%d]; vm_core_invalidate(core, a); }\n",
+            instr, next, dr);
+    break;
+
+  case 0xB: // STI
+    fprintf(out, "a = 0x%04x;\n  ", pc9);
+    fprintf(out, "if (AOT_SLOW(a) || AOT_SLOW(vm->mem[a])) AOT_CALL(0x%04x, 0x%04x); "
+                 "else { a = vm->mem[a]; vm->mem[a] = r[%d]; vm_core_invalidate(core, a); }\n",
+            instr, next, dr);
+    break;
+
+  default: // TRAP、RTI 和保留操作码
+    fprintf(out, "AOT_CALL(0x%04x, 0x%04x);\n", instr, next);
+    break;
+  }
+}
+
+static void emit(FILE *out, const Cfg *cfg, const uint8_t *image, size_t size, const char *name)
+{
+  const char *base = strrchr(name, '/');
+
+  fprintf(out, "// 由 lc3_aot 从 %s 生成\n\n#include \"lc3_aot.h\"\n\n", base ? base + 1 : name);
+  fprintf(out, "static const uint8_t image[] = {");
+
+  for (size_t i = 0; i < size; i++)
+  {
+    fprintf(out, "%s0x%02x,", i % 16 ? " " : "\n    ", image[i]);
+  }
+
+  fprintf(out, "\n};\n\n");
+
+  if (cfg->site_count)
+  {
+    fprintf(out, "static const uint16_t aot_sites[] = {");
+
+    for (int pc = 0; pc < WORDS; pc++)
+    {
+      if (cfg->site[pc])
+      {
+        fprintf(out, "0x%04x, ", pc);
+      }
+    }
+
+    fprintf(out, "};\nstatic uint64_t aot_site_hits[%d];\nstatic uint64_t aot_site_misses[%d];\n", cfg->site_count,
+            cfg->site_count);
+    fprintf(out, "static Lc3AotStats aot_stats = {0, 0, %d, aot_sites, aot_site_hits, aot_site_misses};\n\n",
+            cfg->site_count);
+  }
+  else
+  {
+    fprintf(out, "static Lc3AotStats aot_stats;\n\n");
+  }
+
+  fprintf(out, "static uint64_t run(VmCore *core, uint64_t slice)\n{\n");
+  fprintf(out, "  Lc3 *vm = (Lc3 *)core;\n");
+  fprintf(out, "  uint16_t r[8];\n  uint16_t cc;\n  uint16_t a;\n");
+  fprintf(out, "  uint16_t pc = (uint16_t)core->pc;\n  uint64_t n = 0;\n  AOT_RAS_LOCALS();\n");
+
+  if (cfg->site_count)
+  {
+    fprintf(out, "  AOT_IC_LOCALS(%d);\n", cfg->site_count);
+  }
+
+  fprintf(out, "\n");
+  fprintf(out, "  AOT_LOAD();\n\n");
+
+  // 分派：翻译过的块直接跳转，其余由解释器执行一条
+  fprintf(out, "dispatch:\n  if (n >= slice)\n  {\n    goto out;\n  }\n\n  switch (pc)\n  {\n");
+
+  for (int pc = 0; pc < WORDS; pc++)
+  {
+    if ((cfg->flags[pc] & LC3_CFG_CODE) && (cfg->flags[pc] & LC3_CFG_BLOCK))
+    {
+      if (cfg->site_count)
+      {
+        fprintf(out, "  case 0x%04x: AOT_IC_FILL(0x%04x, L%04x); goto L%04x;\n", pc, pc, pc, pc);
+      }
+      else
+      {
+        fprintf(out, "  case 0x%04x: goto L%04x;\n", pc, pc);
+      }
+    }
+  }
+
+  fprintf(out, "  default: break;\n  }\n\n");
+
+  // 目标没有翻译，不填入内联缓存
+  if (cfg->site_count)
+  {
+    fprintf(out, "  ic_site = -1;\n\n");
+  }
+
+  // 解释执行一条
+  fprintf(out, "step:\n  {\n    int op;\n    uint32_t next;\n    uint32_t instr = lc3_isa.fetch(core, pc, &op, &next);\n\n");
+  fprintf(out, "    n++;\n    AOT_SAVE();\n    core->pc = next;\n    lc3_isa.handlers[op](core, instr);\n");
+  fprintf(out, "    AOT_LOAD();\n    pc = (uint16_t)core->pc;\n\n");
+  fprintf(out, "    if (!core->running)\n    {\n      goto out;\n    }\n\n    goto dispatch;\n  }\n\n");
+
+  for (int pc = 0; pc < WORDS; pc++)
+  {
+    if (!(cfg->flags[pc] & LC3_CFG_CODE))
+    {
+      continue;
+    }
+
+    // 本片剩下的指令数不够顺序执行完这个块时逐条解释，不超出 slice
+    if (cfg->flags[pc] & LC3_CFG_BLOCK)
+    {
+      int len = 1;
+      while (pc + len < WORDS && (cfg->flags[pc + len] & LC3_CFG_CODE) && !(cfg->flags[pc + len] & LC3_CFG_BLOCK))
+      {
+        len++;
+      }
+
+      fprintf(out, "L%04x:\n  if (n + %d > slice)\n  {\n    pc = 0x%04x;\n    goto tail;\n  }\n", pc, len, pc);
+    }
+
+    emit_instr(out, cfg, pc);
+
+    // 下一条没有翻译，顺序执行时经分派
+    if (pc + 1 >= WORDS || !(cfg->flags[pc + 1] & LC3_CFG_CODE))
+    {
+      fprintf(out, "  pc = 0x%04x;\n  goto dispatch;\n", (uint16_t)(pc + 1));
+    }
+
+    fprintf(out, "\n");
+  }
+
+  fprintf(out, "tail:\n  if (n >= slice)\n  {\n    goto out;\n  }\n\n  goto step;\n\n");
+  fprintf(out, "out:\n  AOT_SAVE();\n  AOT_RAS_FLUSH();\n");
+
+  if (cfg->site_count)
+  {
+    fprintf(out, "\n  for (int k = 0; k < %d; k++)\n  {\n", cfg->site_count);
+    fprintf(out, "    aot_site_hits[k] += ic_hits[k];\n    aot_site_misses[k] += ic_misses[k];\n  }\n\n");
+  }
+
+  fprintf(out, "  core->pc = pc;\n  return n;\n}\n\n");
+  fprintf(out, "const Lc3AotProgram lc3_aot_program = {image, sizeof(image), run, &aot_stats,\n");
+  fprintf(out, "                                       sizeof(Lc3AotState) + %d * sizeof(Lc3AotIc)};\n",
+          cfg->site_count);
+}
+
+int main(int argc, const char *argv[])
+{
+  if (argc != 3)
+  {
+    fprintf(stderr, "usage: %s image.obj out.c\n", argv[0]);
+    return 2;
+  }
+
+  FILE *file = fopen(argv[1], "rb");
+  if (!file)
+  {
+    fprintf(stderr, "failed to open %s\n", argv[1]);
+    return 1;
+  }
+
+  uint8_t *image = malloc(2 * WORDS + 2);
+  size_t size = fread(image, 1, 2 * WORDS + 2, file);
+  fclose(file);
+
+  if (size < 2)
+  {
+    fprintf(stderr, "bad image %s\n", argv[1]);
+    return 1;
+  }
+
+  Cfg *cfg = calloc(1, sizeof(Cfg));
+  cfg->origin = image[0] << 8 | image[1];
+
+  for (size_t i = 0; i < (size - 2) / 2 && cfg->origin + i < UINT16_MAX; i++)
+  {
+    cfg->mem[cfg->origin + i] = image[2 + 2 * i] << 8 | image[3 + 2 * i];
+    cfg->loaded[cfg->origin + i] = 1;
+  }
+
+  Lc3Cfg *graph = lc3_cfg_build(cfg->mem, cfg->loaded, cfg->origin, LC3_CFG_POINTERS);
+  cfg->flags = graph->flags;
+
+  for (int pc = 0; pc < WORDS; pc++)
+  {
+    uint16_t instr = cfg->mem[pc];
+    int indirect = instr >> 12 == OP_JMP ? ((instr >> 6) & 7) != 7 : instr >> 12 == OP_JSR && !(instr & 0x800);
+
+    if ((cfg->flags[pc] & LC3_CFG_CODE) && indirect)
+    {
+      cfg->site[pc] = ++cfg->site_count;
+    }
+  }
+
+  FILE *out = fopen(argv[2], "w");
+  if (!out)
+  {
+    fprintf(stderr, "failed to create %s\n", argv[2]);
+    return 1;
+  }
+
+  emit(out, cfg, image, size, argv[1]);
+  fclose(out);
+
+  lc3_cfg_free(graph);
+  free(cfg);
+  free(image);
+  return 0;
+}
@@ -0,0 +1,196 @@
+#ifndef LC3_AOT_H
+#define LC3_AOT_H
+
+#include <string.h>
+
+#include "lc3.h"
+
+// lc3_aot 生成的 C 代码所用的运行时。生成的 run 作为 VmCore.native 引擎执行：
+// R0~R7 是局部变量，条件码只记下最后写入的值 cc，BR 时才比较；
+// 访存的页没有标记（设备、观察点、未载入的检查点页）时直接读写 mem，
+// 否则和 TRAP、RTI 一样写回寄存器后调用解释器的处理函数，结束后再取回
+
+// 生成的代码中的计数，-s 时打印
+typedef struct
+{
+  uint64_t ras_hits;   // RET 命中影子返回栈
+  uint64_t ras_misses; // RET 经分派
+
+  // 间接跳转点（RET 以外的 JMP 和 JSRR）的地址和内联缓存的命中、未命中次数
+  int site_count;
+  const uint16_t *sites;
+  uint64_t *site_hits;
+  uint64_t *site_misses;
+} Lc3AotStats;
+
+typedef struct
+{
+  const uint8_t *image; // 原 .obj 文件
+  size_t image_size;
+  uint64_t (*run)(VmCore *core, uint64_t slice);
+  Lc3AotStats *stats;
+  size_t state_size; // 运行前 vm->aot 须指向这么大的清零内存，存放 Lc3AotState
+} Lc3AotProgram;
+
+// 由生成的代码定义
+extern const Lc3AotProgram lc3_aot_program;
+
+#define AOT_SAVE()                                                             \
+  do                                                                           \
+  {                                                                            \
+    memcpy(vm->reg, r, sizeof(r));                                             \
+    vm->reg[R_COND] = cc == 0 ? FL_ZRO : (cc >> 15) ? FL_NEG : FL_POS;         \
+  } while (0)
+
+#define AOT_LOAD()                                                                           \
+  do                                                                                         \
+  {                                                                                          \
+    memcpy(r, vm->reg, sizeof(r));                                                           \
+    cc = (vm->reg[R_COND] & FL_NEG) ? 0x8000 : (vm->reg[R_COND] & FL_ZRO) ? 0 : 1;           \
+  } while (0)
+
+// 访存要经过 mem_read/mem_write
+#define AOT_SLOW(address) (vm->page_flags[(uint16_t)(address) >> LC3_PAGE_SHIFT])
+
+// 影子返回栈：JSR/JSRR 压入返回地址和它的标号，RET（JMP R7）时 R7 与栈顶相同则直接跳到该标号，
+// 不同（客户机改写了 R7、longjmp 式的返回）时弹出栈顶，经分派。栈满时覆盖最早的项。
+// 需要 GNU C 的标号地址，其他编译器下 RET 总是经分派
+#define AOT_RAS_DEPTH 64
+
+// 内联缓存：每个间接跳转点记住最近 AOT_IC_WAYS 个目标和它们的标号，命中时直接跳转，
+// 未命中时经分派，分派到翻译过的块时把目标填入该跳转点（轮流替换）
+#define AOT_IC_WAYS 4
+
+typedef struct
+{
+  uint16_t pc[AOT_IC_WAYS];
+  void *label[AOT_IC_WAYS];
+  uint8_t used;
+  uint8_t next;
+} Lc3AotIc;
+
+// 返回栈和内联缓存放在 vm->aot 中，跨片保留。标号都属于同一个 run，在之后的调用中仍然有效
+typedef struct
+{
+  uint16_t ras_pc[AOT_RAS_DEPTH];
+  void *ras_label[AOT_RAS_DEPTH];
+  int ras_top;
+  int ras_count;
+  Lc3AotIc ic[]; // 每个间接跳转点一项
+} Lc3AotState;
+
+#ifdef __GNUC__
+#define AOT_RAS_LOCALS()                 \
+  Lc3AotState *aot = vm->aot;            \
+  uint64_t ras_hits = 0;                 \
+  uint64_t ras_misses = 0
+
+#define AOT_PUSH(next, label)                                    \
+  do                                                             \
+  {                                                              \
+    aot->ras_top = (aot->ras_top + 1) & (AOT_RAS_DEPTH - 1);     \
+    aot->ras_pc[aot->ras_top] = (next);                          \
+    aot->ras_label[aot->ras_top] = &&label;                      \
+    if (aot->ras_count < AOT_RAS_DEPTH)                          \
+    {                                                            \
+      aot->ras_count++;                                          \
+    }                                                            \
+  } while (0)
+
+#define AOT_RET()                                                \
+  do                                                             \
+  {                                                              \
+    if (aot->ras_count)                                          \
+    {                                                            \
+      int top_ = aot->ras_top;                                   \
+      aot->ras_top = (top_ - 1) & (AOT_RAS_DEPTH - 1);           \
+      aot->ras_count--;                                          \
+      if (aot->ras_pc[top_] == pc)                               \
+      {                                                          \
+        ras_hits++;                                              \
+        goto *aot->ras_label[top_];                              \
+      }                                                          \
+    }                                                            \
+    ras_misses++;                                                \
+  } while (0)
+#else
+#define AOT_RAS_LOCALS()     \
+  uint64_t ras_hits = 0;     \
+  uint64_t ras_misses = 0
+
+#define AOT_PUSH(next, label) (void)0
+#define AOT_RET() ras_misses++
+#endif
+
+// 退出 run 时累计本片的计数
+#define AOT_RAS_FLUSH()                \
+  do                                   \
+  {                                    \
+    aot_stats.ras_hits += ras_hits;    \
+    aot_stats.ras_misses += ras_misses; \
+  } while (0)
+
+// 内联缓存的计数在退出 run 时累加到 aot_stats
+#define AOT_IC_LOCALS(count)                   \
+  uint64_t ic_hits[count] = {0};               \
+  uint64_t ic_misses[count] = {0};             \
+  int ic_site = -1
+
+#ifdef __GNUC__
+#define AOT_IC(k)                                      \
+  do                                                   \
+  {                                                    \
+    Lc3AotIc *ic_ = &aot->ic[k];                       \
+    for (int w_ = 0; w_ < ic_->used; w_++)             \
+    {                                                  \
+      if (ic_->pc[w_] == pc)                           \
+      {                                                \
+        ic_hits[k]++;                                  \
+        goto *ic_->label[w_];                          \
+      }                                                \
+    }                                                  \
+    ic_misses[k]++;                                    \
+    ic_site = (k);                                     \
+  } while (0)
+
+#define AOT_IC_FILL(target, block)                               \
+  do                                                             \
+  {                                                              \
+    if (ic_site >= 0)                                            \
+    {                                                            \
+      Lc3AotIc *ic_ = &aot->ic[ic_site];                         \
+      int w_ = ic_->next++ & (AOT_IC_WAYS - 1);                  \
+      ic_->pc[w_] = (target);                                    \
+      ic_->label[w_] = &&block;                                  \
+      if (ic_->used < AOT_IC_WAYS)                               \
+      {                                                          \
+        ic_->used++;                                             \
+      }                                                          \
+      ic_site = -1;                                              \
+    }                                                            \
+  } while (0)
+#else
+#define AOT_IC(k) ic_misses[k]++
+#define AOT_IC_FILL(target, block) (void)0
+#endif
+
+// 由解释器执行 instr，pc 改变时回到分派，停止时退出
+#define AOT_CALL(instr, next)                             \
+  do                                                      \
+  {                                                       \
+    AOT_SAVE();                                           \
+    core->pc = (next);                                    \
+    lc3_isa.handlers[(instr) >> 12](core, (instr));       \
+    AOT_LOAD();                                           \
+    pc = (uint16_t)core->pc;                              \
+    if (!core->running)                                   \
+    {                                                     \
+      goto out;                                           \
+    }                                                     \
+    if (pc != (next))                                     \
+    {                                                     \
+      goto dispatch;                                      \
+    }                                                     \
+  } while (0)
+
+#endif
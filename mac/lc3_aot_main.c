@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3_aot.h"
+#include "vm_debug.h"
+
+// lc3_aot 翻译出的程序的入口，与生成的 C 代码链接成可执行文件：
+//
+//   primes_aot [-trap=...] [-watch=...] [公共参数] [image.obj ...]
+//
+// 命令行中的镜像（如 os.obj）先载入，翻译的镜像最后载入并作为起始地址。
+// 参数同 vm_lc_3；-t 和断点时退回解释器执行，观察点所在页的访存由解释器完成
+int main(int argc, const char *argv[])
+{
+  Lc3 *vm = lc3_create();
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strncmp(argv[i], "-trap=", 6) == 0)
+    {
+      if (!lc3_trap_option(vm, argv[i] + 6))
+      {
+        printf("bad trap mode %s\n", argv[i]);
+        exit(2);
+      }
+    }
+    else if (strncmp(argv[i], "-watch=", 7) == 0 || strncmp(argv[i], "-awatch=", 8) == 0)
+    {
+      int write_only = argv[i][1] == 'w';
+      char *end;
+      unsigned long address = strtoul(strchr(argv[i], '=') + 1, &end, 16);
+      unsigned long len = *end == ':' ? strtoul(end + 1, NULL, 0) : 1;
+
+      if (!lc3_watch(vm, address, len, write_only ? VM_WATCH_WRITE : VM_WATCH_READ | VM_WATCH_WRITE))
+      {
+        printf("bad watchpoint %s\n", argv[i]);
+        exit(2);
+      }
+    }
+    else if (argv[i][0] == '-')
+    {
+      vm_core_option(&vm->core, argv[i]);
+    }
+    else if (!read_image(vm, argv[i]))
+    {
+      printf("failed to load image %s\n", argv[i]);
+      exit(1);
+    }
+  }
+
+  if (!lc3_load(vm, lc3_aot_program.image, lc3_aot_program.image_size))
+  {
+    printf("bad image\n");
+    exit(1);
+  }
+
+  vm->aot = calloc(1, lc3_aot_program.state_size);
+  if (!vm->aot)
+  {
+    printf("out of memory\n");
+    exit(1);
+  }
+
+  lc3_reset(vm);
+  vm->core.native = lc3_aot_program.run;
+
+  if (vm->core.debug)
+  {
+    vm_debug_run(&vm->core, stdin, stderr);
+  }
+  else
+  {
+    vm_core_run(&vm->core);
+  }
+
+  vm_core_report(&vm->core, stderr);
+  vm_core_report_stop(&vm->core, stderr);
+
+  if (vm->core.stats)
+  {
+    const Lc3AotStats *stats = lc3_aot_program.stats;
+    fprintf(stderr, "[lc3] return stack: %llu hits, %llu misses\n", (unsigned long long)stats->ras_hits,
+            (unsigned long long)stats->ras_misses);
+
+    for (int k = 0; k < stats->site_count; k++)
+    {
+      fprintf(stderr, "[lc3] inline cache at %04x: %llu hits, %llu misses\n", stats->sites[k],
+              (unsigned long long)stats->site_hits[k], (unsigned long long)stats->site_misses[k]);
+    }
+  }
+
+  lc3_destroy(vm);
+
+  return 0;
+}
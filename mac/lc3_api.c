@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3.h"
+
+VmStopReason lc3_run(Lc3 *vm, uint64_t n)
+{
+  // 预算按累计值计算，这里临时换成本次的上限
+  uint64_t budget = vm->core.budget;
+
+  vm->core.budget = n ? vm->core.retired + n : 0;
+  VmStopReason stop = vm_core_run(&vm->core);
+  vm->core.budget = budget;
+
+  return stop;
+}
+
+VmStopReason lc3_run_until(Lc3 *vm, int (*until)(Lc3 *vm, void *ctx), void *ctx, uint64_t batch)
+{
+  if (!batch)
+  {
+    batch = VM_SLICE;
+  }
+
+  for (;;)
+  {
+    VmStopReason stop = lc3_run(vm, batch);
+
+    if (stop != VM_STOP_BUDGET)
+    {
+      return stop;
+    }
+
+    if (until(vm, ctx))
+    {
+      vm->core.stop = VM_STOP_REQUEST;
+      return VM_STOP_REQUEST;
+    }
+  }
+}
+
+void lc3_stop(Lc3 *vm)
+{
+  vm_core_stop(&vm->core, VM_STOP_REQUEST);
+}
+
+uint64_t lc3_retired(const Lc3 *vm)
+{
+  return vm->core.retired;
+}
+
+uint16_t lc3_reg(const Lc3 *vm, int r)
+{
+  return r >= R_R0 && r <= R_R7 ? vm->reg[r] : 0;
+}
+
+void lc3_set_reg(Lc3 *vm, int r, uint16_t value)
+{
+  if (r >= R_R0 && r <= R_R7)
+  {
+    vm->reg[r] = value;
+  }
+}
+
+uint16_t lc3_pc(const Lc3 *vm)
+{
+  return (uint16_t)vm->core.pc;
+}
+
+void lc3_set_pc(Lc3 *vm, uint16_t pc)
+{
+  vm->core.pc = pc;
+}
+
+uint16_t lc3_psr(const Lc3 *vm)
+{
+  return vm->psr | vm->reg[R_COND];
+}
+
+uint16_t lc3_peek(const Lc3 *vm, uint16_t address)
+{
+  if (address >= UINT16_MAX)
+  {
+    return 0;
+  }
+
+  lc3_touch((Lc3 *)vm, address);
+  return vm->mem[address];
+}
+
+void lc3_poke(Lc3 *vm, uint16_t address, uint16_t value)
+{
+  if (address < UINT16_MAX)
+  {
+    lc3_touch(vm, address);
+    vm->mem[address] = value;
+    vm_core_invalidate(&vm->core, address);
+    lc3_jit_written(vm, address);
+  }
+}
+
+void lc3_on_trap(Lc3 *vm, uint8_t trap_code, Lc3TrapHandler handler, void *ctx)
+{
+  vm->trap_hooks[trap_code] = (Lc3TrapHook){handler, ctx};
+}
+
+int lc3_map_device(Lc3 *vm, uint16_t address, Lc3DeviceRead read, Lc3DeviceWrite write, void *ctx)
+{
+  int i = 0;
+
+  // 同一地址重复注册时替换
+  while (i < vm->device_count && vm->devices[i].address != address)
+  {
+    i++;
+  }
+
+  if (i == LC3_MAX_DEVICES || address >= UINT16_MAX)
+  {
+    return 0;
+  }
+
+  if (i == vm->device_count)
+  {
+    vm->device_count++;
+  }
+
+  vm->devices[i] = (Lc3Device){address, read, write, ctx};
+  vm->page_flags[address >> LC3_PAGE_SHIFT] |= LC3_PAGE_DEVICE;
+  return 1;
+}
+
+// ================= 实例池 =================
+
+struct Lc3Pool
+{
+  Lc3 *vms;
+  uint8_t *used;
+  int capacity;
+};
+
+Lc3Pool *lc3_pool_create(int capacity)
+{
+  Lc3Pool *pool = calloc(1, sizeof(Lc3Pool));
+
+  if (!pool)
+  {
+    return NULL;
+  }
+
+  pool->vms = calloc(capacity, sizeof(Lc3));
+  pool->used = calloc(capacity, 1);
+  pool->capacity = capacity;
+
+  if (!pool->vms || !pool->used)
+  {
+    lc3_pool_destroy(pool);
+    return NULL;
+  }
+
+  return pool;
+}
+
+void lc3_pool_destroy(Lc3Pool *pool)
+{
+  for (int i = 0; pool->vms && i < pool->capacity; i++)
+  {
+    if (pool->vms[i].mem)
+    {
+      lc3_fini(&pool->vms[i]);
+    }
+  }
+
+  free(pool->vms);
+  free(pool->used);
+  free(pool);
+}
+
+Lc3 *lc3_pool_acquire(Lc3Pool *pool)
+{
+  for (int i = 0; i < pool->capacity; i++)
+  {
+    if (!pool->used[i])
+    {
+      Lc3 *vm = &pool->vms[i];
+
+      // 用过的实例保留内存和预解码缓存，只清零；从未取出过的实例仍是 calloc 得到的全 0
+      if (!(vm->mem ? lc3_recycle(vm) : lc3_init(vm)))
+      {
+        return NULL;
+      }
+
+      pool->used[i] = 1;
+      return vm;
+    }
+  }
+
+  return NULL;
+}
+
+void lc3_pool_release(Lc3Pool *pool, Lc3 *vm)
+{
+  pool->used[vm - pool->vms] = 0;
+}
@@ -0,0 +1,147 @@
+#ifndef LC3_API_H
+#define LC3_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "vm_core.h"
+
+// 嵌入用的 LC-3 接口。Lc3 的布局见 lc3.h，嵌入方只通过这里的函数访问。
+// 执行按片进行（见 vm_core_run），回调只发生在 TRAP、设备寄存器访问和片之间，
+// 不会每条指令都回到调用方
+
+typedef struct Lc3 Lc3;
+typedef struct Lc3Pool Lc3Pool;
+typedef struct Lc3Image Lc3Image;
+
+Lc3 *lc3_create(void);
+
+void lc3_destroy(Lc3 *vm);
+
+// 从内存载入 .obj 镜像：大端的起始地址，之后是大端的指令。可多次调用，成功返回 1
+int lc3_load(Lc3 *vm, const void *data, size_t size);
+
+// 共享镜像：解析一次，之后 lc3_load_image 载入的所有实例共享未写入的内存页和预解码结果，
+// 每个实例只为自己写过的页（按宿主机的页大小）分配内存。内容相同的镜像在进程内只解码一次，
+// 重复创建时得到同一个对象（带引用计数，各自调用 lc3_image_destroy）。
+// 可以在任意线程中创建和销毁，镜像可以在实例之前销毁
+Lc3Image *lc3_image_create(const void *data, size_t size);
+
+void lc3_image_destroy(Lc3Image *image);
+
+// 以镜像替换实例的全部内存（之前载入的内容都被丢弃），成功返回 1
+int lc3_load_image(Lc3 *vm, const Lc3Image *image);
+
+// 在后台线程中从起始地址恢复控制流图、预解码所有静态可达的指令，不等待，
+// 之后的 lc3_run 立即开始执行，线程完成后在下一次预解码缓存未命中时并入结果。启动线程和复制内存有固定开销，
+// 只对执行时间远长于此的任务划算。
+// 在载入镜像之后调用；已有预解码结果（共享镜像）或用解码引擎时不做。启动了线程返回 1
+int lc3_pretranslate(Lc3 *vm);
+
+// 热轨迹引擎：BR 向后跳转到同一目标 threshold 次（0 为 LC3_JIT_THRESHOLD）后记录该循环的执行路径，
+// 编译成带守卫的线性轨迹执行，守卫不成立时回到解释器。跟踪（-t）和断点时不用。成功返回 1
+#define LC3_JIT_THRESHOLD 50
+
+int lc3_jit(Lc3 *vm, unsigned threshold);
+
+// 分层执行：冷代码每次解码，基本块进入 block_threshold 次（0 为 LC3_TIER_BLOCKS）后由后台线程预解码，
+// 循环的回边执行 trace_threshold 次后记录轨迹、由后台线程编译，装入后在下一个基本块开头换到新的层。
+// 不要再调用 lc3_pretranslate。成功返回 1
+#define LC3_TIER_BLOCKS 16
+
+int lc3_tier(Lc3 *vm, unsigned block_threshold, unsigned trace_threshold);
+
+// PC 指向最后载入镜像的起始地址，标志寄存器置为 Z，用户态、优先级 0
+void lc3_reset(Lc3 *vm);
+
+// 再执行最多 n 条指令，0 表示不限。返回停止原因，因次数停止时为 VM_STOP_BUDGET
+VmStopReason lc3_run(Lc3 *vm, uint64_t n);
+
+// 每执行 batch 条指令（0 表示 VM_SLICE）检查一次 until，返回非 0 时停止并返回 VM_STOP_REQUEST
+VmStopReason lc3_run_until(Lc3 *vm, int (*until)(Lc3 *vm, void *ctx), void *ctx, uint64_t batch);
+
+// 在当前指令执行完后停止，供回调使用，lc3_run 返回 VM_STOP_REQUEST
+void lc3_stop(Lc3 *vm);
+
+// 已执行的指令数
+uint64_t lc3_retired(const Lc3 *vm);
+
+// R0~R7
+uint16_t lc3_reg(const Lc3 *vm, int r);
+
+void lc3_set_reg(Lc3 *vm, int r, uint16_t value);
+
+uint16_t lc3_pc(const Lc3 *vm);
+
+void lc3_set_pc(Lc3 *vm, uint16_t pc);
+
+// 含条件码的 PSR
+uint16_t lc3_psr(const Lc3 *vm);
+
+// 直接读写客户机内存，不经过设备和观察点，写入会丢弃该地址的预解码结果
+uint16_t lc3_peek(const Lc3 *vm, uint16_t address);
+
+void lc3_poke(Lc3 *vm, uint16_t address, uint16_t value);
+
+// TRAP 回调，注册后该 trap_code 不再按 -trap 的方式执行。handler 为 NULL 时取消
+typedef void (*Lc3TrapHandler)(Lc3 *vm, uint8_t trap_code, void *ctx);
+
+void lc3_on_trap(Lc3 *vm, uint8_t trap_code, Lc3TrapHandler handler, void *ctx);
+
+// 设备寄存器回调：客户机读 address 时 read 的返回值即读到的值，写入时调用 write，都可为 NULL。
+// 所在页的访存都会走慢速路径，寄存器宜集中在 xFE00 页。满了返回 0
+typedef uint16_t (*Lc3DeviceRead)(Lc3 *vm, uint16_t address, void *ctx);
+typedef void (*Lc3DeviceWrite)(Lc3 *vm, uint16_t address, uint16_t value, void *ctx);
+
+int lc3_map_device(Lc3 *vm, uint16_t address, Lc3DeviceRead read, Lc3DeviceWrite write, void *ctx);
+
+// 会话模式：输入输出不经过终端，而在实例自己的缓冲区中。需要输入而缓冲区为空时
+// lc3_run 返回 VM_STOP_INPUT，输出达到 output_limit 字节时返回 VM_STOP_OUTPUT，
+// 补充输入或取走输出后再次调用即可继续，一个线程可以在事件循环中轮流驱动任意多个实例。
+// 须在开始执行前调用
+void lc3_session(Lc3 *vm, size_t output_limit);
+
+// 追加输入
+void lc3_feed(Lc3 *vm, const void *data, size_t len);
+
+// 输入结束，之后读完缓冲区的输入时读到 xFFFF 而不再等待
+void lc3_feed_eof(Lc3 *vm);
+
+// 取出最多 cap 字节输出，返回取出的字节数
+size_t lc3_take_output(Lc3 *vm, void *buf, size_t cap);
+
+// 检查点：保存与基准内存不同的页（压缩后）和寄存器，用于长时间运行的客户机中断后继续。
+// lc3_checkpoint_base 在载入镜像、复位之后调用，以当前内存为基准；恢复时的基准须与保存时相同。
+// lc3_checkpoint_save 只在调用时复制一份内存，比较、压缩和写盘在后台线程中进行，
+// 写入临时文件后改名，失败时不影响已有的检查点。上一次写入未完成时先等待它。开始写入返回 1
+void lc3_checkpoint_base(Lc3 *vm);
+
+int lc3_checkpoint_save(Lc3 *vm, const char *path);
+
+// 等待后台写入完成，返回最近一次写入是否成功
+int lc3_checkpoint_wait(Lc3 *vm);
+
+// 映射检查点文件，恢复寄存器；内存页在第一次访问时才解压。文件无效或基准不同时返回 0，状态不变
+int lc3_checkpoint_restore(Lc3 *vm, const char *path);
+
+// 预先分配 capacity 个实例。归还的实例保留内存和预解码缓存，再次取出时只清零复位，避免反复分配大块内存
+Lc3Pool *lc3_pool_create(int capacity);
+
+// 实例须都已归还
+void lc3_pool_destroy(Lc3Pool *pool);
+
+// 没有空闲实例时返回 NULL
+Lc3 *lc3_pool_acquire(Lc3Pool *pool);
+
+void lc3_pool_release(Lc3Pool *pool, Lc3 *vm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
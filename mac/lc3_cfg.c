@@ -0,0 +1,356 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lc3.h"
+
+// 静态控制流图和载入时的预解码。
+//
+// 入口为起始地址、TRAP 和中断向量表中的非 0 项，沿 BR 的目标、JSR 的目标和顺序执行的下一条扩展；
+// JMP/JSRR/RET 和 RTI 的目标在运行时才知道，不再扩展。JSR 和 TRAP 的下一条经返回到达，也是基本块开头。
+// 预解码在后台线程中对内存的副本进行，解释器同时从头开始执行（未解码的地址照常即时解码），
+// 结果只保存可达的指令。线程结束后在下一次预解码缓存未命中时把结果并入，与当前内存不同的字（已被改写）跳过
+
+#define WORDS (UINT16_MAX + 1)
+
+typedef struct
+{
+  Lc3Cfg *cfg;
+  const uint16_t *mem;
+  const uint8_t *loaded;
+  uint16_t *work;
+  int work_count;
+} Builder;
+
+struct Lc3Pretranslate
+{
+  pthread_t thread;
+  atomic_int done;
+
+  uint16_t *mem;  // 内存副本，分析完即释放
+  uint16_t *pcs;  // 可达指令的地址
+  VmSlot *slots;  // 对应的预解码结果
+  int count;
+  uint16_t origin;
+  Lc3Cfg *cfg;
+  double seconds; // 分析和解码所用时间
+
+  int merged; // 并入的指令数，-1 表示还没有并入
+};
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint16_t sign_extend(uint16_t x, int bit_count)
+{
+  if ((x >> (bit_count - 1)) & 1)
+  {
+    x |= 0xFFFF << bit_count;
+  }
+
+  return x;
+}
+
+// 没有载入标记时以 0（未载入的内存、.BLKW）作为代码的结束
+static int is_code(const Builder *b, uint16_t pc)
+{
+  return pc != UINT16_MAX && (b->loaded ? b->loaded[pc] : b->mem[pc] != 0);
+}
+
+// 顺序执行的下一条
+static void add_next(Builder *b, uint16_t pc)
+{
+  if (is_code(b, pc) && !(b->cfg->flags[pc] & LC3_CFG_CODE))
+  {
+    b->cfg->flags[pc] |= LC3_CFG_CODE;
+    b->work[b->work_count++] = pc;
+  }
+}
+
+// 跳转目标，开始新的基本块
+static void add_target(Builder *b, uint16_t pc, int flags)
+{
+  if (is_code(b, pc))
+  {
+    b->cfg->flags[pc] |= LC3_CFG_BLOCK | flags;
+    add_next(b, pc);
+  }
+}
+
+static void add_call(Builder *b, uint16_t site, uint16_t target)
+{
+  Lc3Cfg *cfg = b->cfg;
+
+  if (!is_code(b, target))
+  {
+    return;
+  }
+
+  if (cfg->call_count == cfg->call_cap)
+  {
+    cfg->call_cap = cfg->call_cap ? 2 * cfg->call_cap : 64;
+    cfg->calls = realloc(cfg->calls, cfg->call_cap * sizeof(Lc3Call));
+  }
+
+  cfg->calls[cfg->call_count++] = (Lc3Call){site, target};
+  add_target(b, target, LC3_CFG_FUNCTION);
+}
+
+// 从 address 开始连续的指向镜像内的字作为跳转表的各项
+static void add_table(Builder *b, uint16_t address)
+{
+  for (uint16_t p = address; is_code(b, p) && is_code(b, b->mem[p]); p++)
+  {
+    add_target(b, b->mem[p], 0);
+  }
+}
+
+Lc3Cfg *lc3_cfg_build(const uint16_t *mem, const uint8_t *loaded, uint16_t origin, int options)
+{
+  Lc3Cfg *cfg = calloc(1, sizeof(Lc3Cfg));
+  Builder b = {cfg, mem, loaded, malloc(WORDS * sizeof(uint16_t)), 0};
+
+  add_target(&b, origin, LC3_CFG_FUNCTION);
+
+  // TRAP 和中断向量
+  for (int v = 0x20; v < LC3_IVT + 0x100; v++)
+  {
+    if (mem[v] && (!loaded || loaded[v]))
+    {
+      add_target(&b, mem[v], LC3_CFG_FUNCTION);
+    }
+  }
+
+  while (b.work_count)
+  {
+    uint16_t pc = b.work[--b.work_count];
+    uint16_t instr = mem[pc];
+    uint16_t next = pc + 1;
+    uint16_t pc9 = next + sign_extend(instr & 0x1FF, 9);
+
+    switch (instr >> 12)
+    {
+    case OP_BR:
+      if ((instr >> 9) & 7)
+      {
+        add_target(&b, pc9, 0);
+      }
+
+      if (((instr >> 9) & 7) != 7)
+      {
+        add_next(&b, next);
+      }
+      break;
+
+    case OP_JSR: // 返回地址经 RET 间接到达
+      if (instr & 0x800)
+      {
+        add_call(&b, pc, next + sign_extend(instr & 0x7FF, 11));
+      }
+
+      add_target(&b, next, 0);
+      break;
+
+    case OP_TRAP: // 向量表中的例程已作为入口，HALT 不返回
+      if (mem[instr & 0xFF])
+      {
+        add_call(&b, pc, mem[instr & 0xFF]);
+      }
+
+      if ((instr & 0xFF) != TRAP_HALT)
+      {
+        add_target(&b, next, 0);
+      }
+      break;
+
+    case OP_JMP:
+    case OP_RTI:
+    case OP_RES:
+      break;
+
+    case OP_LEA: // 可能是函数地址或跳转表
+      if (options & LC3_CFG_POINTERS)
+      {
+        add_target(&b, pc9, 0);
+        add_table(&b, pc9);
+      }
+
+      add_next(&b, next);
+      break;
+
+    case OP_LD: // 可能读的是函数指针表
+    case OP_LDI:
+      if ((options & LC3_CFG_POINTERS) && is_code(&b, pc9))
+      {
+        add_target(&b, mem[pc9], 0);
+      }
+
+      add_next(&b, next);
+      break;
+
+    default:
+      add_next(&b, next);
+      break;
+    }
+  }
+
+  free(b.work);
+
+  for (int pc = 0; pc < WORDS; pc++)
+  {
+    cfg->instr_count += (cfg->flags[pc] & LC3_CFG_CODE) != 0;
+    cfg->block_count += (cfg->flags[pc] & LC3_CFG_BLOCK) != 0;
+    cfg->function_count += (cfg->flags[pc] & LC3_CFG_FUNCTION) != 0;
+  }
+
+  return cfg;
+}
+
+void lc3_cfg_free(Lc3Cfg *cfg)
+{
+  if (cfg)
+  {
+    free(cfg->calls);
+    free(cfg);
+  }
+}
+
+static void *pretranslate(void *arg)
+{
+  Lc3Pretranslate *pt = arg;
+  double start = now();
+
+  pt->cfg = lc3_cfg_build(pt->mem, NULL, pt->origin, 0);
+  pt->pcs = malloc(pt->cfg->instr_count * sizeof(uint16_t));
+  pt->slots = malloc(pt->cfg->instr_count * sizeof(VmSlot));
+
+  // 与 lc3.c 的 fetch 相同，副本中没有设备和未载入的页
+  for (int pc = 0; pc < WORDS && pt->pcs && pt->slots; pc++)
+  {
+    if (pt->cfg->flags[pc] & LC3_CFG_CODE)
+    {
+      uint16_t instr = pt->mem[pc];
+      pt->pcs[pt->count] = pc;
+      pt->slots[pt->count++] = (VmSlot){lc3_isa.handlers[instr >> 12], instr, (uint16_t)(pc + 1), instr >> 12};
+    }
+  }
+
+  free(pt->mem);
+  pt->mem = NULL;
+
+  pt->seconds = now() - start;
+  atomic_store_explicit(&pt->done, 1, memory_order_release);
+  return NULL;
+}
+
+// 预解码缓存未命中时检查后台线程是否完成，完成后并入未解码的地址
+static void merge(VmCore *core)
+{
+  Lc3 *vm = (Lc3 *)core;
+  Lc3Pretranslate *pt = vm->pretranslate;
+
+  if (!atomic_load_explicit(&pt->done, memory_order_acquire))
+  {
+    return;
+  }
+
+  pthread_join(pt->thread, NULL);
+  core->on_miss = NULL;
+  pt->merged = 0;
+
+  for (int i = 0; i < pt->count && core->slots; i++)
+  {
+    uint16_t pc = pt->pcs[i];
+
+    if (!core->slots[pc].handler && !(vm->page_flags[pc >> LC3_PAGE_SHIFT] & LC3_PAGE_LAZY) &&
+        vm->mem[pc] == pt->slots[i].instr)
+    {
+      core->slots[pc] = pt->slots[i];
+      pt->merged++;
+    }
+  }
+
+  free(pt->pcs);
+  free(pt->slots);
+  pt->pcs = NULL;
+  pt->slots = NULL;
+}
+
+int lc3_pretranslate(Lc3 *vm)
+{
+  if (vm->pretranslate || vm->core.engine != VM_ENGINE_PREDECODE || vm->core.slots)
+  {
+    return 0;
+  }
+
+  Lc3Pretranslate *pt = calloc(1, sizeof(Lc3Pretranslate));
+  uint16_t *mem = malloc(LC3_MEM_BYTES);
+
+  if (!pt || !mem)
+  {
+    free(pt);
+    free(mem);
+    return 0;
+  }
+
+  memcpy(mem, vm->mem, LC3_MEM_BYTES);
+  pt->mem = mem;
+  pt->origin = vm->origin;
+  pt->merged = -1;
+
+  if (pthread_create(&pt->thread, NULL, pretranslate, pt) != 0)
+  {
+    free(mem);
+    free(pt);
+    return 0;
+  }
+
+  vm->pretranslate = pt;
+  vm->core.on_miss = merge;
+  return 1;
+}
+
+void lc3_pretranslate_free(Lc3 *vm)
+{
+  Lc3Pretranslate *pt = vm->pretranslate;
+
+  if (!pt)
+  {
+    return;
+  }
+
+  if (pt->merged < 0)
+  {
+    pthread_join(pt->thread, NULL);
+  }
+
+  free(pt->pcs);
+  free(pt->slots);
+
+  lc3_cfg_free(pt->cfg);
+  free(pt);
+
+  vm->pretranslate = NULL;
+  vm->core.on_miss = NULL;
+}
+
+void lc3_pretranslate_report(Lc3 *vm, FILE *out)
+{
+  Lc3Pretranslate *pt = vm->pretranslate;
+
+  if (!pt || pt->merged < 0)
+  {
+    return;
+  }
+
+  fprintf(out, "[lc3] cfg: %d instructions in %d blocks, %d functions, %d calls; "
+               "pretranslated in %.6f s, %d merged\n",
+          pt->cfg->instr_count, pt->cfg->block_count, pt->cfg->function_count, pt->cfg->call_count,
+          pt->seconds, pt->merged);
+}
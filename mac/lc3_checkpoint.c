@@ -0,0 +1,533 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lc3.h"
+
+// 检查点文件（小端）：
+//
+//   偏移  大小  内容
+//   0     4     magic "LC3C"
+//   4     2     版本号
+//   6     2     保存的页数 n
+//   8     8     基准内存的 FNV-1a 哈希，恢复时须相同
+//   16    8     已执行的指令数
+//   24    8     定时器到期时的指令数
+//   32    2*10  R0~R7、COND、PC
+//   52    2*3   PSR、SSP、USP
+//   58    6     保留，为 0
+//   64    8*n   页表，每项为页号（2 字节）、压缩后的字节数（2 字节）、数据在文件中的偏移（4 字节）
+//   ...         各页数据
+//
+// 只保存与基准（载入镜像后的内存）不同的页，数据为与基准异或后的 256 个字，逐段编码：
+// 段头最高位为 0 时表示 (段头 + 1) 个 0，为 1 时后跟 (段头 & 0x7f) + 1 个小端的字。
+// 未改动的内容异或后为 0，通常只剩很少几段
+
+#define LC3_CHECKPOINT_MAGIC "LC3C"
+#define LC3_CHECKPOINT_VERSION 1
+#define HEADER_SIZE 64
+#define ENTRY_SIZE 8
+#define PAGE_WORDS (1 << LC3_PAGE_SHIFT)
+#define MEM_WORDS UINT16_MAX
+
+// 一页压缩后最多的字节数：两个文字段
+#define MAX_PACKED (PAGE_WORDS * 2 + PAGE_WORDS / 128)
+
+// 冻结时复制的状态，交给后台线程写入
+typedef struct
+{
+  uint16_t mem[MEM_WORDS];
+  uint8_t header[HEADER_SIZE];
+  char *path;
+} Snapshot;
+
+struct Lc3Checkpoint
+{
+  uint16_t base[MEM_WORDS];
+  uint64_t base_hash;
+
+  // 后台写入
+  pthread_t writer;
+  int writing;
+  int result; // 上一次写入是否成功
+  Snapshot *snapshot;
+
+  // 恢复时 mmap 的文件，所有页都载入后解除映射
+  const uint8_t *map;
+  size_t map_size;
+  uint32_t page_offset[LC3_PAGES];
+  uint16_t page_size[LC3_PAGES];
+  int lazy_pages;
+};
+
+static void put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v & 0xff;
+  p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+  put16(p, v & 0xffff);
+  put16(p + 2, v >> 16);
+}
+
+static void put64(uint8_t *p, uint64_t v)
+{
+  put32(p, v & 0xffffffff);
+  put32(p + 4, v >> 32);
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+  return p[0] | p[1] << 8;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+  return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+  return get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+// 压缩一页的差异，返回字节数
+static size_t pack_page(const uint16_t *delta, uint8_t *out)
+{
+  size_t n = 0;
+  int i = 0;
+
+  while (i < PAGE_WORDS)
+  {
+    int run = 0;
+
+    if (!delta[i])
+    {
+      while (i + run < PAGE_WORDS && !delta[i + run] && run < 128)
+      {
+        run++;
+      }
+
+      out[n++] = run - 1;
+    }
+    else
+    {
+      while (i + run < PAGE_WORDS && delta[i + run] && run < 128)
+      {
+        run++;
+      }
+
+      out[n++] = 0x80 | (run - 1);
+
+      for (int k = 0; k < run; k++)
+      {
+        put16(out + n, delta[i + k]);
+        n += 2;
+      }
+    }
+
+    i += run;
+  }
+
+  return n;
+}
+
+// 解压一页差异并异或到 words 上，数据不完整时返回 0
+static int unpack_page(const uint8_t *in, size_t size, uint16_t *words, int count)
+{
+  size_t n = 0;
+  int i = 0;
+
+  while (i < count && n < size)
+  {
+    uint8_t head = in[n++];
+    int run = (head & 0x7f) + 1;
+
+    if (i + run > count)
+    {
+      return 0;
+    }
+
+    if (head & 0x80)
+    {
+      if (n + 2 * run > size)
+      {
+        return 0;
+      }
+
+      for (int k = 0; k < run; k++)
+      {
+        words[i + k] ^= get16(in + n);
+        n += 2;
+      }
+    }
+
+    i += run;
+  }
+
+  return i == count && n == size;
+}
+
+// 最后一页少一个字（mem 只有 UINT16_MAX 个字）
+static int page_words(int page)
+{
+  return page == LC3_PAGES - 1 ? MEM_WORDS - page * PAGE_WORDS : PAGE_WORDS;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+  const uint8_t *p = data;
+
+  while (size)
+  {
+    ssize_t n = write(fd, p, size);
+    if (n <= 0)
+    {
+      return 0;
+    }
+
+    p += n;
+    size -= n;
+  }
+
+  return 1;
+}
+
+// 后台线程：比较、压缩、写入临时文件，同步到磁盘后改名，中途崩溃不会留下不完整的检查点
+static void *write_snapshot(void *arg)
+{
+  Lc3Checkpoint *ckpt = arg;
+  Snapshot *snapshot = ckpt->snapshot;
+
+  uint8_t *table = malloc(LC3_PAGES * ENTRY_SIZE);
+  uint8_t *data = malloc(LC3_PAGES * MAX_PACKED);
+  uint16_t delta[PAGE_WORDS];
+  size_t data_size = 0;
+  int pages = 0;
+
+  for (int page = 0; page < LC3_PAGES; page++)
+  {
+    const uint16_t *words = snapshot->mem + page * PAGE_WORDS;
+    const uint16_t *base = ckpt->base + page * PAGE_WORDS;
+    int count = page_words(page);
+
+    if (memcmp(words, base, count * sizeof(uint16_t)) == 0)
+    {
+      continue;
+    }
+
+    memset(delta, 0, sizeof(delta));
+    for (int i = 0; i < count; i++)
+    {
+      delta[i] = words[i] ^ base[i];
+    }
+
+    size_t size = pack_page(delta, data + data_size);
+
+    put16(table + pages * ENTRY_SIZE, page);
+    put16(table + pages * ENTRY_SIZE + 2, size);
+    put32(table + pages * ENTRY_SIZE + 4, HEADER_SIZE + LC3_PAGES * ENTRY_SIZE + data_size);
+    data_size += size;
+    pages++;
+  }
+
+  // 页表按最大页数留出位置，数据偏移固定
+  memset(table + pages * ENTRY_SIZE, 0, (LC3_PAGES - pages) * ENTRY_SIZE);
+  put16(snapshot->header + 6, pages);
+
+  size_t len = strlen(snapshot->path);
+  char *tmp = malloc(len + 5);
+  memcpy(tmp, snapshot->path, len);
+  memcpy(tmp + len, ".tmp", 5);
+
+  int ok = 0;
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd >= 0)
+  {
+    ok = write_all(fd, snapshot->header, HEADER_SIZE) &&
+         write_all(fd, table, LC3_PAGES * ENTRY_SIZE) &&
+         write_all(fd, data, data_size) &&
+         fsync(fd) == 0;
+    ok = close(fd) == 0 && ok;
+    ok = ok && rename(tmp, snapshot->path) == 0;
+  }
+
+  if (!ok)
+  {
+    unlink(tmp);
+  }
+
+  free(tmp);
+  free(table);
+  free(data);
+
+  ckpt->result = ok;
+  return NULL;
+}
+
+int lc3_checkpoint_wait(Lc3 *vm)
+{
+  Lc3Checkpoint *ckpt = vm->checkpoint;
+
+  if (!ckpt)
+  {
+    return 0;
+  }
+
+  if (ckpt->writing)
+  {
+    pthread_join(ckpt->writer, NULL);
+    ckpt->writing = 0;
+
+    free(ckpt->snapshot->path);
+    free(ckpt->snapshot);
+    ckpt->snapshot = NULL;
+  }
+
+  return ckpt->result;
+}
+
+void lc3_checkpoint_base(Lc3 *vm)
+{
+  if (!vm->checkpoint)
+  {
+    vm->checkpoint = calloc(1, sizeof(Lc3Checkpoint));
+  }
+
+  lc3_checkpoint_wait(vm);
+  memcpy(vm->checkpoint->base, vm->mem, sizeof(vm->checkpoint->base));
+  vm->checkpoint->base_hash = lc3_hash_words(vm->mem, MEM_WORDS);
+  vm->checkpoint->result = 1;
+}
+
+static void unmap(Lc3Checkpoint *ckpt)
+{
+  if (ckpt->map)
+  {
+    munmap((void *)ckpt->map, ckpt->map_size);
+    ckpt->map = NULL;
+  }
+}
+
+void lc3_page_in(Lc3 *vm, uint16_t page)
+{
+  Lc3Checkpoint *ckpt = vm->checkpoint;
+
+  vm->page_flags[page] &= ~LC3_PAGE_LAZY;
+
+  // 恢复时已校验过
+  unpack_page(ckpt->map + ckpt->page_offset[page], ckpt->page_size[page],
+              vm->mem + page * PAGE_WORDS, page_words(page));
+
+  if (--ckpt->lazy_pages == 0)
+  {
+    unmap(ckpt);
+  }
+}
+
+static void page_in_all(Lc3 *vm)
+{
+  for (int page = 0; page < LC3_PAGES && vm->checkpoint->lazy_pages; page++)
+  {
+    if (vm->page_flags[page] & LC3_PAGE_LAZY)
+    {
+      lc3_page_in(vm, page);
+    }
+  }
+}
+
+int lc3_checkpoint_save(Lc3 *vm, const char *path)
+{
+  Lc3Checkpoint *ckpt = vm->checkpoint;
+
+  if (!ckpt)
+  {
+    return 0;
+  }
+
+  // 同一时间只有一个写入
+  lc3_checkpoint_wait(vm);
+  page_in_all(vm);
+
+  // 冻结：只复制内存和寄存器，压缩和写盘都在后台
+  Snapshot *snapshot = malloc(sizeof(Snapshot));
+  uint8_t *h = snapshot->header;
+
+  memcpy(snapshot->mem, vm->mem, sizeof(snapshot->mem));
+  memset(h, 0, HEADER_SIZE);
+  memcpy(h, LC3_CHECKPOINT_MAGIC, 4);
+  put16(h + 4, LC3_CHECKPOINT_VERSION);
+  put64(h + 8, ckpt->base_hash);
+  put64(h + 16, vm->core.retired);
+  put64(h + 24, vm->timer_deadline);
+
+  for (int r = 0; r < R_COUNT; r++)
+  {
+    put16(h + 32 + 2 * r, vm->reg[r]);
+  }
+
+  put16(h + 32 + 2 * R_COUNT, vm->core.pc);
+  put16(h + 52, vm->psr);
+  put16(h + 54, vm->saved_ssp);
+  put16(h + 56, vm->saved_usp);
+
+  snapshot->path = strdup(path);
+  ckpt->snapshot = snapshot;
+
+  if (pthread_create(&ckpt->writer, NULL, write_snapshot, ckpt) != 0)
+  {
+    free(snapshot->path);
+    free(snapshot);
+    ckpt->snapshot = NULL;
+    ckpt->result = 0;
+    return 0;
+  }
+
+  ckpt->writing = 1;
+  return 1;
+}
+
+int lc3_checkpoint_restore(Lc3 *vm, const char *path)
+{
+  if (!vm->checkpoint)
+  {
+    lc3_checkpoint_base(vm);
+  }
+
+  Lc3Checkpoint *ckpt = vm->checkpoint;
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+
+  if (fd < 0)
+  {
+    return 0;
+  }
+
+  if (fstat(fd, &st) != 0 || st.st_size < HEADER_SIZE + LC3_PAGES * ENTRY_SIZE)
+  {
+    close(fd);
+    return 0;
+  }
+
+  const uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+  {
+    return 0;
+  }
+
+  size_t size = st.st_size;
+  int pages = get16(map + 6);
+
+  if (memcmp(map, LC3_CHECKPOINT_MAGIC, 4) != 0 || get16(map + 4) != LC3_CHECKPOINT_VERSION ||
+      get64(map + 8) != ckpt->base_hash || pages > LC3_PAGES)
+  {
+    munmap((void *)map, size);
+    return 0;
+  }
+
+  // 先校验页表，再改动机器状态
+  for (int i = 0; i < pages; i++)
+  {
+    const uint8_t *entry = map + HEADER_SIZE + i * ENTRY_SIZE;
+    uint32_t offset = get32(entry + 4);
+
+    if (get16(entry) >= LC3_PAGES || get16(entry + 2) > MAX_PACKED || offset > size || get16(entry + 2) > size - offset)
+    {
+      munmap((void *)map, size);
+      return 0;
+    }
+  }
+
+  // 之前恢复时没载入的页直接丢弃，内存整体换成基准
+  for (int page = 0; page < LC3_PAGES; page++)
+  {
+    vm->page_flags[page] &= ~LC3_PAGE_LAZY;
+  }
+
+  unmap(ckpt);
+  // 只写回有差别的页，共享镜像中没写过的页保持共享
+  for (int page = 0; page < LC3_PAGES; page++)
+  {
+    size_t bytes = page_words(page) * sizeof(uint16_t);
+
+    if (memcmp(vm->mem + page * PAGE_WORDS, ckpt->base + page * PAGE_WORDS, bytes) != 0)
+    {
+      memcpy(vm->mem + page * PAGE_WORDS, ckpt->base + page * PAGE_WORDS, bytes);
+    }
+  }
+  ckpt->map = map;
+  ckpt->map_size = size;
+  ckpt->lazy_pages = 0;
+
+  for (int i = 0; i < pages; i++)
+  {
+    const uint8_t *entry = map + HEADER_SIZE + i * ENTRY_SIZE;
+    uint16_t page = get16(entry);
+
+    ckpt->page_offset[page] = get32(entry + 4);
+    ckpt->page_size[page] = get16(entry + 2);
+
+    if (!(vm->page_flags[page] & LC3_PAGE_LAZY))
+    {
+      vm->page_flags[page] |= LC3_PAGE_LAZY;
+      ckpt->lazy_pages++;
+    }
+  }
+
+  // 向量表和设备寄存器会被直接读取，不延迟载入
+  int eager[] = {0x0000 >> LC3_PAGE_SHIFT, LC3_IVT >> LC3_PAGE_SHIFT, MR_KBSR >> LC3_PAGE_SHIFT, MR_MCR >> LC3_PAGE_SHIFT};
+
+  for (size_t i = 0; i < sizeof(eager) / sizeof(eager[0]); i++)
+  {
+    if (vm->page_flags[eager[i]] & LC3_PAGE_LAZY)
+    {
+      lc3_page_in(vm, eager[i]);
+    }
+  }
+
+  if (!ckpt->lazy_pages)
+  {
+    unmap(ckpt);
+  }
+
+  const uint8_t *h = map;
+
+  vm->core.retired = get64(h + 16);
+  vm->timer_deadline = get64(h + 24);
+
+  for (int r = 0; r < R_COUNT; r++)
+  {
+    vm->reg[r] = get16(h + 32 + 2 * r);
+  }
+
+  vm->core.pc = get16(h + 32 + 2 * R_COUNT);
+  vm->psr = get16(h + 52);
+  vm->saved_ssp = get16(h + 54);
+  vm->saved_usp = get16(h + 56);
+
+  // 内存已整体替换；中断源的状态在下一次片间检查时重新计算
+  vm_core_flush(&vm->core);
+  lc3_jit_flush(vm);
+  vm->core.irq_pending = 1;
+  return 1;
+}
+
+void lc3_checkpoint_free(Lc3 *vm)
+{
+  if (vm->checkpoint)
+  {
+    lc3_checkpoint_wait(vm);
+    unmap(vm->checkpoint);
+    free(vm->checkpoint);
+    vm->checkpoint = NULL;
+  }
+}
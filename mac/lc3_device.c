@@ -0,0 +1,263 @@
+#include "lc3.h"
+
+// 内存映射设备和中断。设备寄存器所在页带 LC3_PAGE_DEVICE 标记，
+// 普通内存的读写不经过这里；中断只在片之间由 lc3_interrupt 检查和投递
+
+#define PC (vm->core.pc)
+#define COND (vm->reg[R_COND])
+#define SP (vm->reg[R_R6])
+
+// 键盘中断和定时器中断的优先级
+#define KEYBOARD_PRIORITY 4
+#define TIMER_PRIORITY 5
+
+// 没有未读字符时轮询输入，读到的字符锁存在 KBDR 中直到被读走
+static void poll_keyboard(Lc3 *vm)
+{
+  uint16_t c;
+
+  if (lc3_input_poll(vm, &c))
+  {
+    vm->mem[MR_KBSR] |= LC3_READY;
+    vm->mem[MR_KBDR] = c;
+  }
+}
+
+// 嵌入方注册的设备寄存器
+static Lc3Device *find_device(Lc3 *vm, uint16_t address)
+{
+  for (int i = 0; i < vm->device_count; i++)
+  {
+    if (vm->devices[i].address == address)
+    {
+      return &vm->devices[i];
+    }
+  }
+
+  return NULL;
+}
+
+void lc3_device_read(Lc3 *vm, uint16_t address)
+{
+  switch (address)
+  {
+  case MR_KBSR:
+    if (!(vm->mem[MR_KBSR] & LC3_READY))
+    {
+      poll_keyboard(vm);
+
+      // 会话模式下忙等输入的客户机在这里暂停
+      if (!(vm->mem[MR_KBSR] & LC3_READY))
+      {
+        lc3_input_wait(vm);
+      }
+    }
+    break;
+
+  case MR_KBDR:
+    vm->mem[MR_KBSR] &= ~LC3_READY;
+    break;
+
+  // 显示器总是就绪
+  case MR_DSR:
+    vm->mem[MR_DSR] = LC3_READY;
+    break;
+
+  case MR_PSR:
+    vm->mem[MR_PSR] = vm->psr | COND;
+    break;
+
+  default:
+  {
+    Lc3Device *device = find_device(vm, address);
+    if (device && device->read)
+    {
+      vm->mem[address] = device->read(vm, address, device->ctx);
+    }
+    break;
+  }
+  }
+}
+
+uint16_t lc3_device_write(Lc3 *vm, uint16_t address, uint16_t data)
+{
+  switch (address)
+  {
+  // 就绪位只由设备设置
+  case MR_KBSR:
+    data = (vm->mem[MR_KBSR] & LC3_READY) | (data & LC3_IE);
+    vm_core_interrupt(&vm->core);
+    break;
+
+  // 客户机 OS 通过 DDR 输出
+  case MR_DDR:
+    lc3_output_char(vm, (char)data);
+    lc3_output_flush(vm);
+    break;
+
+  case MR_TMR:
+    vm_core_interrupt(&vm->core);
+    break;
+
+  // 片内的 core.retired 不精确，到片之间再开始计时
+  case MR_TMI:
+    vm->timer_deadline = 0;
+    vm_core_interrupt(&vm->core);
+    break;
+
+  // 用户态不能改写 PSR，写入引发特权异常
+  case MR_PSR:
+    if (vm->psr & LC3_PSR_USER)
+    {
+      data = vm->mem[MR_PSR];
+      lc3_exception(vm, LC3_VEC_PRIVILEGE);
+      break;
+    }
+
+    vm->psr = data & (LC3_PSR_USER | 0x0700);
+    COND = data & 0x7;
+    vm_core_interrupt(&vm->core);
+    break;
+
+  // 清最高位停机
+  case MR_MCR:
+    if (!(data & 0x8000))
+    {
+      vm_core_halt(&vm->core);
+    }
+    break;
+
+  default:
+  {
+    Lc3Device *device = find_device(vm, address);
+    if (device && device->write)
+    {
+      device->write(vm, address, data, device->ctx);
+    }
+    break;
+  }
+  }
+
+  return data;
+}
+
+static void push(Lc3 *vm, uint16_t value)
+{
+  SP--;
+  mem_write(vm, SP, value);
+}
+
+static uint16_t pop(Lc3 *vm)
+{
+  return mem_read(vm, SP++);
+}
+
+// 切换到监督栈，压入 PSR 和 PC，以 priority 执行向量表中的例程
+static void enter(Lc3 *vm, Lc3Vector vector, int priority)
+{
+  uint16_t psr = vm->psr | COND;
+
+  VM_TRACE(&vm->core, "interrupt %02x at pc %04x -> %04x\n", vector, PC, vm->mem[LC3_IVT + vector]);
+
+  if (vm->psr & LC3_PSR_USER)
+  {
+    vm->saved_usp = SP;
+    SP = vm->saved_ssp;
+  }
+
+  push(vm, psr);
+  push(vm, PC);
+
+  vm->psr = priority << 8;
+  PC = vm->mem[LC3_IVT + vector];
+}
+
+void lc3_interrupt(VmCore *core)
+{
+  Lc3 *vm = (Lc3 *)core;
+  uint64_t interval = 0;
+
+  if (vm->mem[MR_KBSR] & LC3_IE)
+  {
+    if (!(vm->mem[MR_KBSR] & LC3_READY))
+    {
+      poll_keyboard(vm);
+    }
+
+    interval = LC3_KEYBOARD_POLL;
+  }
+
+  uint16_t period = vm->mem[MR_TMI];
+
+  if (period)
+  {
+    if (!vm->timer_deadline)
+    {
+      vm->timer_deadline = core->retired + period;
+    }
+    else if (core->retired >= vm->timer_deadline)
+    {
+      vm->mem[MR_TMR] |= LC3_READY;
+      vm->timer_deadline = core->retired + period;
+    }
+
+    uint64_t left = vm->timer_deadline - core->retired;
+    if (!interval || left < interval)
+    {
+      interval = left;
+    }
+  }
+
+  // 没有要轮询的设备时片长不受限制，之后只有设备寄存器的写入和 RTI 会再触发检查
+  core->irq_interval = interval;
+
+  // 只投递优先级最高的一个，其余的在例程 RTI 之后再检查
+  int priority = LC3_PSR_PRIORITY(vm->psr);
+  uint16_t raised = LC3_IE | LC3_READY;
+
+  if ((vm->mem[MR_TMR] & raised) == raised && TIMER_PRIORITY > priority)
+  {
+    enter(vm, LC3_VEC_TIMER, TIMER_PRIORITY);
+  }
+  else if ((vm->mem[MR_KBSR] & raised) == raised && KEYBOARD_PRIORITY > priority)
+  {
+    enter(vm, LC3_VEC_KEYBOARD, KEYBOARD_PRIORITY);
+  }
+}
+
+void lc3_exception(Lc3 *vm, Lc3Vector vector)
+{
+  if (!vm->mem[LC3_IVT + vector])
+  {
+    fprintf(stderr, "[lc3] %s at pc %04x\n",
+            vector == LC3_VEC_PRIVILEGE ? "privilege violation" : "illegal opcode", (uint16_t)(PC - 1));
+    vm_core_halt(&vm->core);
+    return;
+  }
+
+  enter(vm, vector, LC3_PSR_PRIORITY(vm->psr));
+}
+
+void lc3_return_from_interrupt(Lc3 *vm)
+{
+  if (vm->psr & LC3_PSR_USER)
+  {
+    lc3_exception(vm, LC3_VEC_PRIVILEGE);
+    return;
+  }
+
+  PC = pop(vm);
+  uint16_t psr = pop(vm);
+
+  vm->psr = psr & (LC3_PSR_USER | 0x0700);
+  COND = psr & 0x7;
+
+  if (vm->psr & LC3_PSR_USER)
+  {
+    vm->saved_ssp = SP;
+    SP = vm->saved_usp;
+  }
+
+  // 优先级降低后，被挡住的中断在片之间重新检查
+  vm_core_interrupt(&vm->core);
+}
@@ -0,0 +1,206 @@
+// 嵌入接口的示例：从实例池取出 LC-3 虚拟机，从内存载入镜像，
+// 用 TRAP 回调提供输入、收集输出，按批执行直到停机。
+//
+//   lc3_embed [-session] image.obj [input ...]
+//
+// 每个 input 作为一个客户机的键盘输入，没有 input 时执行一次、输入为空。
+// -session 时所有客户机同时存在、以会话模式在同一个线程中轮流执行：
+// 需要输入时暂停，每次只补一个字符；输出满 16 字节时暂停并取走
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "lc3.hpp"
+
+namespace
+{
+
+struct Guest
+{
+  std::string input;
+  size_t input_pos = 0;
+  std::string output;
+  bool halted = false;
+};
+
+void attach(lc3::Vm &vm, Guest &guest)
+{
+  auto getc = [&guest](lc3::Vm &vm, uint8_t) {
+    uint16_t c = guest.input_pos < guest.input.size() ? (uint8_t)guest.input[guest.input_pos++] : 0xFFFF;
+    vm.set_reg(0, c);
+  };
+
+  vm.on_trap(0x20, getc);
+  vm.on_trap(0x23, [&guest, getc](lc3::Vm &vm, uint8_t code) {
+    getc(vm, code);
+    guest.output += (char)vm.reg(0);
+  });
+
+  vm.on_trap(0x21, [&guest](lc3::Vm &vm, uint8_t) { guest.output += (char)vm.reg(0); });
+
+  vm.on_trap(0x22, [&guest](lc3::Vm &vm, uint8_t) {
+    for (uint16_t address = vm.reg(0); vm.peek(address); address++)
+    {
+      guest.output += (char)vm.peek(address);
+    }
+  });
+
+  vm.on_trap(0x24, [&guest](lc3::Vm &vm, uint8_t) {
+    for (uint16_t address = vm.reg(0); uint16_t c = vm.peek(address); address++)
+    {
+      guest.output += (char)(c & 0xff);
+      if (c >> 8)
+      {
+        guest.output += (char)(c >> 8);
+      }
+    }
+  });
+
+  vm.on_trap(0x25, [&guest](lc3::Vm &vm, uint8_t) {
+    guest.halted = true;
+    vm.stop();
+  });
+}
+
+// 事件循环：轮流恢复每个暂停的客户机，直到都停机
+void run_sessions(lc3::Pool &pool, const lc3::Image &image, const std::vector<std::string> &inputs)
+{
+  std::vector<lc3::Vm> vms;
+  std::vector<Guest> guests(inputs.size());
+  std::vector<lc3::Stop> stops(inputs.size(), lc3::Stop::None);
+  std::vector<bool> done(inputs.size(), false);
+  size_t running = inputs.size();
+  uint64_t suspends = 0;
+
+  for (size_t i = 0; i < inputs.size(); i++)
+  {
+    guests[i].input = inputs[i] + "\n";
+
+    vms.push_back(pool.acquire());
+    vms[i].load(image);
+    vms[i].reset();
+    vms[i].session(16);
+  }
+
+  while (running)
+  {
+    for (size_t i = 0; i < vms.size(); i++)
+    {
+      lc3::Vm &vm = vms[i];
+      Guest &guest = guests[i];
+
+      if (done[i])
+      {
+        continue;
+      }
+
+      if (stops[i] == lc3::Stop::Input)
+      {
+        if (guest.input_pos < guest.input.size())
+        {
+          vm.feed(guest.input.substr(guest.input_pos++, 1));
+        }
+        else
+        {
+          vm.feed_eof();
+        }
+      }
+
+      // 每次最多执行 1M 条指令，其他客户机不会被饿死
+      stops[i] = vm.run(1 << 20);
+      guest.output += vm.take_output();
+
+      if (stops[i] == lc3::Stop::Input || stops[i] == lc3::Stop::Output)
+      {
+        suspends++;
+      }
+      else if (stops[i] == lc3::Stop::Halt || vm.retired() >= 100000000)
+      {
+        done[i] = true;
+        running--;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < vms.size(); i++)
+  {
+    std::printf("== guest %zu: %s after %llu instructions ==\n%s", i, lc3::name(stops[i]),
+                (unsigned long long)vms[i].retired(), guests[i].output.c_str());
+  }
+
+  std::printf("== %zu guests, %llu suspensions ==\n", vms.size(), (unsigned long long)suspends);
+}
+
+} // namespace
+
+int main(int argc, const char *argv[])
+{
+  bool session = argc > 1 && std::string(argv[1]) == "-session";
+
+  if (session)
+  {
+    argv++;
+    argc--;
+  }
+
+  if (argc < 2)
+  {
+    std::fprintf(stderr, "usage: %s [-session] image.obj [input ...]\n", argv[0]);
+    return 2;
+  }
+
+  std::ifstream file(argv[1], std::ios::binary);
+  std::vector<char> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  if (!file && image.empty())
+  {
+    std::fprintf(stderr, "failed to read %s\n", argv[1]);
+    return 1;
+  }
+
+  std::vector<std::string> inputs(argv + 2, argv + argc);
+  if (inputs.empty())
+  {
+    inputs.emplace_back();
+  }
+
+  if (session)
+  {
+    // 所有客户机共享镜像的内存页，各自只占用写过的页
+    lc3::Image shared(image.data(), image.size());
+    lc3::Pool pool((int)inputs.size());
+
+    run_sessions(pool, shared, inputs);
+    return 0;
+  }
+
+  lc3::Pool pool(4);
+
+  for (size_t i = 0; i < inputs.size(); i++)
+  {
+    Guest guest;
+    guest.input = inputs[i] + "\n";
+
+    // 实例在本轮结束时归还，池中只需容纳同时存在的实例
+    lc3::Vm vm = pool.acquire();
+    if (!vm.load(image.data(), image.size()))
+    {
+      std::fprintf(stderr, "bad image %s\n", argv[1]);
+      return 1;
+    }
+
+    vm.reset();
+    attach(vm, guest);
+
+    // 每 1M 条指令检查一次，失控的客户机在 100M 条后放弃
+    lc3::Stop stop = vm.run_until([](lc3::Vm &vm) { return vm.retired() >= 100000000; }, 1 << 20);
+
+    std::printf("== guest %zu: %s after %llu instructions ==\n%s", i,
+                guest.halted ? "halted" : lc3::name(stop), (unsigned long long)vm.retired(), guest.output.c_str());
+  }
+
+  return 0;
+}
@@ -0,0 +1,279 @@
+// memfd_create
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "lc3.h"
+
+// 客户机内存是一块 LC3_MEM_BYTES 的映射。单独载入时是匿名映射；
+// 从 Lc3Image 载入时改为该镜像文件的私有映射，没写过的页由所有实例共享同一份物理内存，
+// 写入时由内核按宿主机的页复制，每个实例实际占用的只有写过的页。
+//
+// 预解码缓存同样如此：创建镜像时把静态可达的指令解码一次写入另一个文件，实例私有映射它，
+// 只有修改了代码或执行时才解码的（间接跳转的目标）页才复制，写数据不改动缓存（见 vm_core_invalidate）。内容相同的镜像在进程内只有一份，
+// 按内容的哈希查找，无论创建多少次、载入多少个实例，解码都只做一次
+
+struct Lc3Image
+{
+  int fd;       // 内存
+  int slots_fd; // 预解码缓存，UINT16_MAX + 1 个 VmSlot
+  uint16_t origin;
+  uint64_t hash;
+  int refs;
+  Lc3Image *next;
+};
+
+static Lc3Image *images;
+static pthread_mutex_t images_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint16_t *lc3_mem_alloc(void)
+{
+  void *mem = mmap(NULL, LC3_MEM_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return mem == MAP_FAILED ? NULL : mem;
+}
+
+int lc3_mem_clear(uint16_t *mem)
+{
+  // 在原地换成新的匿名映射，地址不变，已写过或载入的页一并丢弃
+  void *cleared = mmap(mem, LC3_MEM_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  return cleared != MAP_FAILED;
+}
+
+void lc3_mem_free(uint16_t *mem)
+{
+  if (mem)
+  {
+    munmap(mem, LC3_MEM_BYTES);
+  }
+}
+
+uint64_t lc3_hash_words(const uint16_t *words, size_t count)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    hash = (hash ^ (words[i] & 0xff)) * 0x100000001b3ull;
+    hash = (hash ^ (words[i] >> 8)) * 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+// 不落盘的临时文件，Linux 上用 memfd
+static int temp_file(const char *name, size_t size)
+{
+  int fd = -1;
+
+#ifdef __linux__
+  fd = memfd_create(name, MFD_CLOEXEC);
+#endif
+
+  if (fd < 0)
+  {
+    char path[] = "/tmp/lc3-XXXXXX";
+
+    fd = mkstemp(path);
+    if (fd >= 0)
+    {
+      unlink(path);
+    }
+  }
+
+  if (fd >= 0 && ftruncate(fd, size) != 0)
+  {
+    close(fd);
+    fd = -1;
+  }
+
+  return fd;
+}
+
+// 把 size 字节的 data 写入新的临时文件
+static int share(const char *name, const void *data, size_t size)
+{
+  int fd = temp_file(name, size);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+  {
+    close(fd);
+    return -1;
+  }
+
+  memcpy(map, data, size);
+  munmap(map, size);
+  return fd;
+}
+
+// 哈希相同时再逐字比较
+static int same_memory(const Lc3Image *image, const uint16_t *mem)
+{
+  void *map = mmap(NULL, LC3_MEM_BYTES, PROT_READ, MAP_SHARED, image->fd, 0);
+  if (map == MAP_FAILED)
+  {
+    return 0;
+  }
+
+  int same = memcmp(map, mem, LC3_MEM_BYTES) == 0;
+  munmap(map, LC3_MEM_BYTES);
+  return same;
+}
+
+// 借一个临时实例按 lc3_isa 解码控制流图中可达的指令，数据保持未解码
+static int translate(const Lc3 *loaded)
+{
+  size_t size = (size_t)(UINT16_MAX + 1) * sizeof(VmSlot);
+  VmSlot *slots = calloc(UINT16_MAX + 1, sizeof(VmSlot));
+  Lc3 *vm = lc3_create();
+  Lc3Cfg *cfg = lc3_cfg_build(loaded->mem, NULL, loaded->origin, 0);
+  int fd = -1;
+
+  if (slots && vm && cfg)
+  {
+    memcpy(vm->mem, loaded->mem, LC3_MEM_BYTES);
+
+    // 最后一个地址不在 mem 中，保持未解码
+    for (uint32_t pc = 0; pc < UINT16_MAX; pc++)
+    {
+      if (cfg->flags[pc] & LC3_CFG_CODE)
+      {
+        vm_core_decode_range(&vm->core, slots, pc, pc + 1);
+      }
+    }
+
+    fd = share("lc3-code", slots, size);
+  }
+
+  lc3_cfg_free(cfg);
+  free(slots);
+  if (vm)
+  {
+    lc3_destroy(vm);
+  }
+
+  return fd;
+}
+
+Lc3Image *lc3_image_create(const void *data, size_t size)
+{
+  Lc3 *loaded = lc3_create();
+
+  if (!loaded || !lc3_load(loaded, data, size))
+  {
+    if (loaded)
+    {
+      lc3_destroy(loaded);
+    }
+
+    return NULL;
+  }
+
+  uint64_t hash = lc3_hash_words(loaded->mem, UINT16_MAX);
+  Lc3Image *image;
+
+  pthread_mutex_lock(&images_lock);
+
+  for (image = images; image; image = image->next)
+  {
+    if (image->hash == hash && image->origin == loaded->origin && same_memory(image, loaded->mem))
+    {
+      image->refs++;
+      break;
+    }
+  }
+
+  if (!image)
+  {
+    image = calloc(1, sizeof(Lc3Image));
+    image->fd = share("lc3-image", loaded->mem, LC3_MEM_BYTES);
+    image->slots_fd = translate(loaded);
+    image->origin = loaded->origin;
+    image->hash = hash;
+    image->refs = 1;
+
+    if (image->fd < 0)
+    {
+      if (image->slots_fd >= 0)
+      {
+        close(image->slots_fd);
+      }
+
+      free(image);
+      image = NULL;
+    }
+    else
+    {
+      image->next = images;
+      images = image;
+    }
+  }
+
+  pthread_mutex_unlock(&images_lock);
+
+  lc3_destroy(loaded);
+  return image;
+}
+
+void lc3_image_destroy(Lc3Image *image)
+{
+  if (!image)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&images_lock);
+
+  if (--image->refs == 0)
+  {
+    Lc3Image **link = &images;
+
+    while (*link != image)
+    {
+      link = &(*link)->next;
+    }
+
+    *link = image->next;
+    close(image->fd);
+
+    if (image->slots_fd >= 0)
+    {
+      close(image->slots_fd);
+    }
+
+    free(image);
+  }
+
+  pthread_mutex_unlock(&images_lock);
+}
+
+int lc3_load_image(Lc3 *vm, const Lc3Image *image)
+{
+  // 原地替换整块内存，vm->mem 的地址不变
+  void *mem = mmap(vm->mem, LC3_MEM_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, image->fd, 0);
+
+  if (mem == MAP_FAILED)
+  {
+    return 0;
+  }
+
+  vm->origin = image->origin;
+
+  // 没有共享的预解码缓存时执行中逐条解码
+  if (image->slots_fd < 0 || !vm_core_map_slots(&vm->core, image->slots_fd))
+  {
+    vm_core_flush(&vm->core);
+  }
+
+  lc3_jit_flush(vm);
+  return 1;
+}
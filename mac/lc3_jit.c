@@ -0,0 +1,1091 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lc3.h"
+
+// 热轨迹引擎（lc3_jit）：以预解码的解释器执行，统计 BR 向后跳转的次数，
+// 某个回边的目标执行到 threshold 次后，从目标开始记录下一遍实际执行的路径，
+// 回到起点时把它编译成一条线性的轨迹：
+//
+//   - BR 变成守卫，记录时走的方向继续，另一方向为旁路出口，回到解释器；
+//     JMP/JSRR/RET 守卫目标寄存器等于记录时的值；JSR 只写 R7，被调用的代码内联在轨迹中
+//   - R0~R7 在整条轨迹中保存在局部变量里，跨越原来的基本块，出口处才写回
+//   - 条件码只记下最后写入的值，到下一个守卫或可能的出口之前被覆盖的写入省去（标志消除）
+//   - 访存的页没有标记时直接读写 mem，否则在该指令前退出，由解释器执行
+//
+// 轨迹执行到末尾跳回开头，每圈检查本片剩余的指令数。TRAP、RTI 和保留操作码不进入轨迹，
+// 记录中遇到它们或超过 JIT_MAX_TRACE 条指令时放弃，同一起点放弃 JIT_MAX_ABORTS 次后不再尝试。
+// 写入轨迹覆盖的字（自修改代码）时丢弃全部轨迹
+//
+// 分层执行（lc3_tier）在此之上从最便宜的方式开始：
+//
+//   第 0 层：冷代码每次取指、解码，不占预解码缓存
+//   第 1 层：基本块进入 block_threshold 次后交给后台线程预解码，之后按预解码缓存执行
+//   第 2 层：循环的回边执行 trace_threshold 次后记录轨迹，也交给后台线程编译
+//
+// 后台线程完成的结果在下一个基本块开头装入，正在执行的循环在下一圈就换到新的层（不用等函数重新进入）。
+// 解码的字在装入时与内存比较，其间被改写的丢弃。-s 时按层打印执行的指令数、所用时间和切换次数
+
+#define WORDS (UINT16_MAX + 1)
+#define JIT_MAX_TRACE 256
+#define JIT_MAX_ABORTS 4
+#define TIER_MAX_BLOCK 64
+
+typedef enum
+{
+  T_ADD,
+  T_ADDI,
+  T_AND,
+  T_ANDI,
+  T_NOT,
+  T_CONST, // LEA
+  T_LD,
+  T_LDR,
+  T_LDI,
+  T_ST,
+  T_STR,
+  T_STI,
+  T_BR_TAKEN, // 条件不成立时从下一条退出
+  T_BR_NOT,   // 条件成立时从目标退出
+  T_JMP,      // 寄存器不等于记录的目标时退出
+  T_JSR,
+  T_JSRR,
+  T_LOOP,
+} TraceKind;
+
+typedef struct
+{
+  uint8_t kind;
+  uint8_t dr; // 目的寄存器，ST 类为源寄存器，BR 为 nzp
+  uint8_t sr1; // 源寄存器或基址寄存器
+  uint8_t sr2;
+  uint8_t setcc; // 需要写条件码
+  uint16_t imm; // 立即数、常量、地址或偏移
+  uint16_t pc; // 指令地址，访存走慢速路径时从这里退出
+  uint16_t exit; // 守卫失败时的下一条地址，JSR/JSRR 为返回地址
+  uint16_t index; // 轨迹中在它之前的指令数
+} TraceOp;
+
+typedef struct
+{
+  uint16_t head;
+  int length; // 一圈的指令数
+  TraceOp ops[];
+} Lc3Trace;
+
+// 记录的路径：每条指令的地址、指令和执行后的 PC
+typedef struct
+{
+  uint16_t head;
+  int len;
+  uint16_t pc[JIT_MAX_TRACE];
+  uint16_t instr[JIT_MAX_TRACE];
+  uint16_t next[JIT_MAX_TRACE];
+} Recording;
+
+// 后台编译队列中的任务：预解码一个基本块（rec.pc 不用），或编译记录的路径
+typedef struct Job
+{
+  struct Job *next;
+  int is_trace;
+  int generation; // 提交时的代数，丢弃全部轨迹后完成的任务作废
+  Recording rec;
+  VmSlot slots[TIER_MAX_BLOCK];
+  Lc3Trace *trace;
+} Job;
+
+typedef struct
+{
+  unsigned threshold;
+  uint16_t counts[WORDS]; // 第 0 层的基本块进入的次数
+  uint8_t queued[WORDS];  // 已提交、还没有装入的基本块或轨迹起点
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  Job *todo;
+  Job *todo_tail;
+  Job *done;
+  atomic_int done_count; // 引擎在基本块开头检查，不为 0 时才加锁
+  int stop;
+  int generation;
+  double compile_seconds; // 后台线程用于解码和编译的时间
+
+  int timed;    // -s 时才在换层时取时间
+  int tier;     // 当前执行所在的层
+  double since; // 进入当前层的时间
+  double seconds[3];
+  uint64_t decoded; // 第 0 层执行的指令数，第 1 层为其余不在轨迹中的指令
+  uint64_t switches;
+  uint64_t promoted[3]; // 升到第 1 层的基本块、第 2 层的轨迹
+  uint64_t dropped;     // 装入时内存已改写或已作废的任务
+} Tier;
+
+struct Lc3Jit
+{
+  unsigned threshold;
+  uint16_t counts[WORDS]; // 以该地址为目标的回边执行次数
+  uint8_t aborts[WORDS]; // 以该地址为起点放弃记录的次数
+  Lc3Trace *traces[WORDS]; // 以该地址为起点的轨迹
+  uint8_t code[WORDS / 8]; // 轨迹覆盖的字
+  int flush_pending; // 轨迹覆盖的字被写入，回到引擎时丢弃全部轨迹
+
+  // 正在记录的路径
+  int recording;
+  Recording rec;
+
+  Tier *tier; // 分层执行，NULL 表示只用轨迹
+
+  uint64_t trace_count;
+  uint64_t abort_count;
+  uint64_t flush_count;
+  uint64_t entries;
+  uint64_t side_exits;
+  uint64_t trace_instrs;
+};
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint16_t sign_extend(uint16_t x, int bit_count)
+{
+  if ((x >> (bit_count - 1)) & 1)
+  {
+    x |= 0xFFFF << bit_count;
+  }
+
+  return x;
+}
+
+static void flush(Lc3 *vm)
+{
+  Lc3Jit *jit = vm->jit;
+
+  for (int pc = 0; pc < WORDS; pc++)
+  {
+    free(jit->traces[pc]);
+    jit->traces[pc] = NULL;
+  }
+
+  for (int page = 0; page < LC3_PAGES; page++)
+  {
+    vm->page_flags[page] &= ~LC3_PAGE_CODE;
+  }
+
+  memset(jit->code, 0, sizeof(jit->code));
+  jit->flush_pending = 0;
+  jit->recording = 0;
+
+  // 队列中的任务完成后丢弃
+  if (jit->tier)
+  {
+    jit->tier->generation++;
+    memset(jit->tier->queued, 0, sizeof(jit->tier->queued));
+  }
+}
+
+// 写条件码的指令
+static int sets_cc(int kind)
+{
+  return kind <= T_LDI;
+}
+
+// 执行前可能退出的指令（访存的慢速路径）
+static int exits_before(int kind)
+{
+  return kind >= T_LD && kind <= T_STI;
+}
+
+// 把记录的路径编译成轨迹，只读 rec，可以在后台线程中进行
+static Lc3Trace *compile(const Recording *rec)
+{
+  Lc3Trace *t = malloc(sizeof(Lc3Trace) + (rec->len + 1) * sizeof(TraceOp));
+  int count = 0;
+
+  t->head = rec->head;
+  t->length = rec->len;
+
+  for (int i = 0; i < rec->len; i++)
+  {
+    uint16_t pc = rec->pc[i];
+    uint16_t instr = rec->instr[i];
+    uint16_t next = pc + 1;
+    uint16_t pc9 = next + sign_extend(instr & 0x1FF, 9);
+    TraceOp op = {0, (instr >> 9) & 7, (instr >> 6) & 7, instr & 7, 1, 0, pc, 0, i};
+
+    switch (instr >> 12)
+    {
+    case OP_ADD:
+    case OP_AND:
+      if (instr & 0x20)
+      {
+        op.kind = instr >> 12 == OP_ADD ? T_ADDI : T_ANDI;
+        op.imm = sign_extend(instr & 0x1F, 5);
+      }
+      else
+      {
+        op.kind = instr >> 12 == OP_ADD ? T_ADD : T_AND;
+      }
+      break;
+
+    case OP_NOT:
+      op.kind = T_NOT;
+      break;
+
+    case OP_LEA:
+      op.kind = T_CONST;
+      op.imm = pc9;
+      break;
+
+    case OP_LD:
+    case OP_LDI:
+    case OP_ST:
+    case OP_STI:
+      op.kind = instr >> 12 == OP_LD ? T_LD : instr >> 12 == OP_LDI ? T_LDI : instr >> 12 == OP_ST ? T_ST : T_STI;
+      op.imm = pc9;
+      break;
+
+    case OP_LDR:
+    case OP_STR:
+      op.kind = instr >> 12 == OP_LDR ? T_LDR : T_STR;
+      op.imm = sign_extend(instr & 0x3F, 6);
+      break;
+
+    case OP_BR:
+      // 无条件或两个方向相同时不需要守卫
+      if (op.dr == 0 || op.dr == 7 || pc9 == next)
+      {
+        continue;
+      }
+
+      op.kind = rec->next[i] == pc9 ? T_BR_TAKEN : T_BR_NOT;
+      op.exit = rec->next[i] == pc9 ? next : pc9;
+      break;
+
+    case OP_JMP:
+      op.kind = T_JMP;
+      op.imm = rec->next[i];
+      break;
+
+    case OP_JSR:
+      op.kind = instr & 0x800 ? T_JSR : T_JSRR;
+      op.imm = rec->next[i];
+      op.exit = next;
+      break;
+    }
+
+    t->ops[count++] = op;
+  }
+
+  t->ops[count++] = (TraceOp){T_LOOP, 0, 0, 0, 0, 0, t->head, 0, t->length};
+
+  // 标志消除：从后往前，守卫和出口处需要条件码，之前最近的写入才保留
+  int need = 1;
+
+  for (int i = count - 1; i >= 0; i--)
+  {
+    TraceOp *op = &t->ops[i];
+
+    if (sets_cc(op->kind))
+    {
+      op->setcc = need;
+      need = 0;
+    }
+    else
+    {
+      op->setcc = 0;
+    }
+
+    if (exits_before(op->kind) || op->kind >= T_BR_TAKEN)
+    {
+      need = 1;
+    }
+  }
+
+  return t;
+}
+
+// 装入编译好的轨迹，路径中的代码已被改写时放弃。返回是否装入
+static int install(Lc3 *vm, const Recording *rec, Lc3Trace *t)
+{
+  Lc3Jit *jit = vm->jit;
+  int i = 0;
+
+  while (i < rec->len && vm->mem[rec->pc[i]] == rec->instr[i])
+  {
+    i++;
+  }
+
+  if (i < rec->len || jit->traces[rec->head])
+  {
+    free(t);
+    jit->aborts[rec->head]++;
+    jit->abort_count++;
+    return 0;
+  }
+
+  for (i = 0; i < rec->len; i++)
+  {
+    uint16_t pc = rec->pc[i];
+
+    jit->code[pc >> 3] |= 1 << (pc & 7);
+    vm->page_flags[pc >> LC3_PAGE_SHIFT] |= LC3_PAGE_CODE;
+  }
+
+  jit->traces[rec->head] = t;
+  jit->trace_count++;
+  return 1;
+}
+
+static void abort_recording(Lc3Jit *jit)
+{
+  jit->recording = 0;
+  jit->aborts[jit->rec.head]++;
+  jit->abort_count++;
+}
+
+// cc 为最后写入寄存器的值，nzp 为 BR 的条件
+static inline int cond(uint16_t cc, int nzp)
+{
+  int flag = cc == 0 ? FL_ZRO : (cc >> 15) ? FL_NEG : FL_POS;
+  return nzp & flag;
+}
+
+// 访存要经过 mem_read/mem_write：设备、观察点、未载入的检查点页，以及写轨迹覆盖的字
+#define SLOW_READ(a) (vm->page_flags[(uint16_t)(a) >> LC3_PAGE_SHIFT] & ~LC3_PAGE_CODE)
+#define SLOW_WRITE(a) (SLOW_READ(a) || (jit->code[(uint16_t)(a) >> 3] >> ((a) & 7) & 1))
+
+// 执行轨迹直到出口，或剩余的指令数不够一圈。返回执行的指令数
+static uint64_t run_trace(Lc3 *vm, const Lc3Trace *t, uint64_t left)
+{
+  Lc3Jit *jit = vm->jit;
+  VmCore *core = &vm->core;
+  uint16_t r[8];
+  uint16_t cc = (vm->reg[R_COND] & FL_NEG) ? 0x8000 : (vm->reg[R_COND] & FL_ZRO) ? 0 : 1;
+  uint16_t a = 0;
+  uint16_t exit_pc;
+  uint64_t n = 0;
+  const TraceOp *op;
+
+  memcpy(r, vm->reg, sizeof(r));
+  jit->entries++;
+
+  for (int i = 0;; i++)
+  {
+    op = &t->ops[i];
+
+    switch (op->kind)
+    {
+    case T_ADD:
+      r[op->dr] = r[op->sr1] + r[op->sr2];
+      goto setcc;
+
+    case T_ADDI:
+      r[op->dr] = r[op->sr1] + op->imm;
+      goto setcc;
+
+    case T_AND:
+      r[op->dr] = r[op->sr1] & r[op->sr2];
+      goto setcc;
+
+    case T_ANDI:
+      r[op->dr] = r[op->sr1] & op->imm;
+      goto setcc;
+
+    case T_NOT:
+      r[op->dr] = ~r[op->sr1];
+      goto setcc;
+
+    case T_CONST:
+      r[op->dr] = op->imm;
+      goto setcc;
+
+    case T_LD:
+      a = op->imm;
+      goto load;
+
+    case T_LDR:
+      a = r[op->sr1] + op->imm;
+      goto load;
+
+    case T_LDI:
+      if (SLOW_READ(op->imm))
+      {
+        goto slow;
+      }
+      a = vm->mem[op->imm];
+      goto load;
+
+    case T_ST:
+      a = op->imm;
+      goto store;
+
+    case T_STR:
+      a = r[op->sr1] + op->imm;
+      goto store;
+
+    case T_STI:
+      if (SLOW_READ(op->imm))
+      {
+        goto slow;
+      }
+      a = vm->mem[op->imm];
+      goto store;
+
+    case T_BR_TAKEN:
+      if (!cond(cc, op->dr))
+      {
+        goto side_exit;
+      }
+      continue;
+
+    case T_BR_NOT:
+      if (cond(cc, op->dr))
+      {
+        goto side_exit;
+      }
+      continue;
+
+    case T_JMP:
+      if (r[op->sr1] != op->imm)
+      {
+        exit_pc = r[op->sr1];
+        n += op->index + 1;
+        jit->side_exits++;
+        goto out;
+      }
+      continue;
+
+    case T_JSR:
+      r[7] = op->exit;
+      continue;
+
+    case T_JSRR:
+      a = r[op->sr1];
+      r[7] = op->exit;
+
+      if (a != op->imm)
+      {
+        exit_pc = a;
+        n += op->index + 1;
+        jit->side_exits++;
+        goto out;
+      }
+      continue;
+
+    case T_LOOP:
+      n += t->length;
+
+      if (left - n < (uint64_t)t->length)
+      {
+        exit_pc = t->head;
+        goto out;
+      }
+
+      i = -1;
+      continue;
+    }
+
+  load:
+    if (SLOW_READ(a))
+    {
+      goto slow;
+    }
+    r[op->dr] = vm->mem[a];
+
+  setcc:
+    if (op->setcc)
+    {
+      cc = r[op->dr];
+    }
+    continue;
+
+  store:
+    if (SLOW_WRITE(a))
+    {
+      goto slow;
+    }
+    vm->mem[a] = r[op->dr];
+    vm_core_invalidate(core, a);
+    continue;
+  }
+
+// 在访存指令之前退出，由解释器执行它
+slow:
+  exit_pc = op->pc;
+  n += op->index;
+  jit->side_exits++;
+  goto out;
+
+side_exit:
+  exit_pc = op->exit;
+  n += op->index + 1;
+  jit->side_exits++;
+
+out:
+  memcpy(vm->reg, r, sizeof(r));
+  vm->reg[R_COND] = cc == 0 ? FL_ZRO : (cc >> 15) ? FL_NEG : FL_POS;
+  core->pc = exit_pc;
+  jit->trace_instrs += n;
+  return n;
+}
+
+// 后台编译线程：依次取出任务，预解码基本块或编译轨迹，放入完成列表
+static void *compile_thread(void *arg)
+{
+  Tier *tier = arg;
+
+  pthread_mutex_lock(&tier->lock);
+
+  while (!tier->stop)
+  {
+    Job *job = tier->todo;
+
+    if (!job)
+    {
+      pthread_cond_wait(&tier->wake, &tier->lock);
+      continue;
+    }
+
+    tier->todo = job->next;
+    pthread_mutex_unlock(&tier->lock);
+
+    double start = now();
+
+    if (job->is_trace)
+    {
+      job->trace = compile(&job->rec);
+    }
+    else
+    {
+      for (int i = 0; i < job->rec.len; i++)
+      {
+        uint16_t instr = job->rec.instr[i];
+        job->slots[i] = (VmSlot){lc3_isa.handlers[instr >> 12], instr, (uint16_t)(job->rec.head + i + 1), instr >> 12};
+      }
+    }
+
+    double seconds = now() - start;
+
+    pthread_mutex_lock(&tier->lock);
+    tier->compile_seconds += seconds;
+    job->next = tier->done;
+    tier->done = job;
+    atomic_fetch_add_explicit(&tier->done_count, 1, memory_order_release);
+  }
+
+  pthread_mutex_unlock(&tier->lock);
+  return NULL;
+}
+
+static void submit(Tier *tier, Job *job)
+{
+  job->generation = tier->generation;
+  job->next = NULL;
+  tier->queued[job->rec.head] = 1;
+
+  pthread_mutex_lock(&tier->lock);
+
+  if (tier->todo)
+  {
+    tier->todo_tail->next = job;
+  }
+  else
+  {
+    tier->todo = job;
+  }
+
+  tier->todo_tail = job;
+  pthread_cond_signal(&tier->wake);
+  pthread_mutex_unlock(&tier->lock);
+}
+
+// 提交从 pc 开始的基本块：复制到控制转移指令为止的字，由后台线程解码。
+// 设备、观察点和未载入的页上的代码留在第 0 层
+static void submit_block(Lc3 *vm, uint16_t pc)
+{
+  Job *job = calloc(1, sizeof(Job));
+  int len = 0;
+
+  if (!job)
+  {
+    return;
+  }
+
+  for (uint16_t p = pc; len < TIER_MAX_BLOCK && p != UINT16_MAX; p++)
+  {
+    if (vm->page_flags[p >> LC3_PAGE_SHIFT] & ~LC3_PAGE_CODE)
+    {
+      break;
+    }
+
+    uint16_t instr = vm->mem[p];
+    job->rec.instr[len++] = instr;
+
+    int op = instr >> 12;
+
+    if (op == OP_BR || op == OP_JMP || op == OP_JSR || op == OP_TRAP || op == OP_RTI || op == OP_RES)
+    {
+      break;
+    }
+  }
+
+  if (!len)
+  {
+    free(job);
+    return;
+  }
+
+  job->rec.head = pc;
+  job->rec.len = len;
+  submit(vm->jit->tier, job);
+}
+
+// 装入后台线程完成的任务
+static void install_done(Lc3 *vm)
+{
+  Tier *tier = vm->jit->tier;
+  VmSlot *slots = vm->core.slots;
+
+  pthread_mutex_lock(&tier->lock);
+  Job *job = tier->done;
+  tier->done = NULL;
+  atomic_store_explicit(&tier->done_count, 0, memory_order_relaxed);
+  pthread_mutex_unlock(&tier->lock);
+
+  while (job)
+  {
+    Job *next = job->next;
+    const Recording *rec = &job->rec;
+
+    if (job->generation != tier->generation)
+    {
+      free(job->trace);
+      tier->dropped++;
+    }
+    else if (job->is_trace)
+    {
+      tier->queued[rec->head] = 0;
+
+      if (install(vm, rec, job->trace))
+      {
+        tier->promoted[2]++;
+      }
+      else
+      {
+        tier->dropped++;
+      }
+    }
+    else
+    {
+      int installed = 0;
+
+      tier->queued[rec->head] = 0;
+
+      for (int i = 0; i < rec->len && slots; i++)
+      {
+        uint16_t pc = rec->head + i;
+
+        if (!slots[pc].handler && vm->mem[pc] == rec->instr[i] &&
+            !(vm->page_flags[pc >> LC3_PAGE_SHIFT] & LC3_PAGE_LAZY))
+        {
+          slots[pc] = job->slots[i];
+          installed = 1;
+        }
+      }
+
+      tier->counts[rec->head] = 0;
+      tier->promoted[1] += installed;
+      tier->dropped += !installed;
+    }
+
+    free(job);
+    job = next;
+  }
+}
+
+// 执行换到第 to 层，把之前的时间记到原来的层
+static void switch_tier(Tier *tier, int to)
+{
+  if (to != tier->tier)
+  {
+    if (tier->timed)
+    {
+      double t = now();
+
+      tier->seconds[tier->tier] += t - tier->since;
+      tier->since = t;
+    }
+
+    tier->tier = to;
+    tier->switches++;
+  }
+}
+
+// 基本块开头：装入完成的任务，统计第 0 层基本块的进入次数，到阈值时提交，记下执行所在的层
+static void enter_block(Lc3 *vm, uint16_t pc, int trace)
+{
+  Tier *tier = vm->jit->tier;
+  VmSlot *slots = vm->core.slots;
+
+  if (atomic_load_explicit(&tier->done_count, memory_order_acquire))
+  {
+    install_done(vm);
+  }
+
+  int to = trace ? 2 : slots && slots[pc].handler ? 1 : 0;
+
+  if (to == 0 && slots && !tier->queued[pc] && ++tier->counts[pc] >= tier->threshold)
+  {
+    tier->counts[pc] = 0;
+    submit_block(vm, pc);
+  }
+
+  switch_tier(tier, to);
+}
+
+// 控制转移指令，之后是新的基本块
+static int ends_block(int op)
+{
+  return op == OP_BR || op == OP_JMP || op == OP_JSR || op == OP_TRAP || op == OP_RTI;
+}
+
+// 引擎：解释执行，遇到轨迹的起点且本片还够一圈时执行轨迹
+static uint64_t jit_run(VmCore *core, uint64_t slice)
+{
+  Lc3 *vm = (Lc3 *)core;
+  Lc3Jit *jit = vm->jit;
+  Tier *tier = jit->tier;
+  uint64_t n = 0;
+  int at_block = 1; // 片之间可能投递了中断，片的开头也是基本块的开头
+
+  // 片之间可能投递了中断，跨片的记录作废
+  if (jit->recording)
+  {
+    abort_recording(jit);
+  }
+
+  if (tier)
+  {
+    tier->timed = core->stats;
+    tier->since = tier->timed ? now() : 0;
+  }
+
+  while (core->running && n < slice)
+  {
+    uint16_t pc = core->pc;
+
+    if (jit->flush_pending)
+    {
+      flush(vm);
+      jit->flush_count++;
+    }
+
+    if (jit->recording)
+    {
+      if (pc == jit->rec.head && jit->rec.len)
+      {
+        jit->recording = 0;
+
+        if (!tier)
+        {
+          install(vm, &jit->rec, compile(&jit->rec));
+        }
+        else
+        {
+          Job *job = malloc(sizeof(Job));
+
+          if (job)
+          {
+            job->is_trace = 1;
+            job->rec = jit->rec;
+            job->trace = NULL;
+            submit(tier, job);
+          }
+        }
+      }
+      else if (jit->rec.len == JIT_MAX_TRACE)
+      {
+        abort_recording(jit);
+      }
+    }
+
+    const Lc3Trace *t = jit->traces[pc];
+    int trace = t && !jit->recording && slice - n >= (uint64_t)t->length;
+
+    if (tier && at_block)
+    {
+      enter_block(vm, pc, trace);
+      at_block = 0;
+    }
+
+    if (trace)
+    {
+      uint64_t done = run_trace(vm, t, slice - n);
+
+      n += done;
+      at_block = 1;
+
+      // 第一条访存指令就要走慢速路径时轨迹没有执行任何指令，由解释器执行它，否则会反复进入轨迹
+      if (done)
+      {
+        continue;
+      }
+
+      // 起点读写设备等的轨迹每次都会立即退出，丢弃它，不再在此记录
+      free(jit->traces[pc]);
+      jit->traces[pc] = NULL;
+      jit->aborts[pc] = JIT_MAX_ABORTS;
+      jit->abort_count++;
+
+      if (tier)
+      {
+        switch_tier(tier, core->slots && core->slots[pc].handler ? 1 : 0);
+      }
+    }
+
+    VmSlot local;
+    VmSlot *slot = core->slots ? &core->slots[pc] : &local;
+
+    // 载入时的后台预解码（分层执行时不用）
+    if (slot != &local && !slot->handler && core->on_miss)
+    {
+      core->on_miss(core);
+    }
+
+    if (slot == &local || !slot->handler)
+    {
+      // 分层执行时冷代码不填入预解码缓存，由后台线程解码
+      slot = tier ? &local : slot;
+      slot->instr = lc3_isa.fetch(core, pc, &slot->op, &slot->next_pc);
+      slot->handler = lc3_isa.handlers[slot->op];
+    }
+
+    if (jit->recording)
+    {
+      if (slot->op == OP_TRAP || slot->op == OP_RTI || slot->op == OP_RES)
+      {
+        abort_recording(jit);
+      }
+      else
+      {
+        jit->rec.pc[jit->rec.len] = pc;
+        jit->rec.instr[jit->rec.len] = slot->instr;
+      }
+    }
+
+    int op = slot->op;
+
+    core->pc = slot->next_pc;
+    slot->handler(core, slot->instr);
+    n++;
+
+    if (tier)
+    {
+      // 块中间的字可能不在预解码缓存中（被改写后失效），按实际执行的方式计
+      tier->decoded += slot == &local;
+      at_block = ends_block(op);
+    }
+
+    if (jit->recording)
+    {
+      jit->rec.next[jit->rec.len++] = core->pc;
+
+      // 等待输入、停机等
+      if (!core->running)
+      {
+        abort_recording(jit);
+      }
+    }
+    else if (op == OP_BR && core->pc <= pc)
+    {
+      uint16_t target = core->pc;
+
+      if (!jit->traces[target] && jit->aborts[target] < JIT_MAX_ABORTS && !(tier && tier->queued[target]) &&
+          ++jit->counts[target] >= jit->threshold)
+      {
+        jit->counts[target] = 0;
+        jit->recording = 1;
+        jit->rec.head = target;
+        jit->rec.len = 0;
+      }
+    }
+  }
+
+  if (tier && tier->timed)
+  {
+    tier->seconds[tier->tier] += now() - tier->since;
+  }
+
+  return n;
+}
+
+int lc3_jit(Lc3 *vm, unsigned threshold)
+{
+  if (!vm->jit)
+  {
+    vm->jit = calloc(1, sizeof(Lc3Jit));
+
+    if (!vm->jit)
+    {
+      return 0;
+    }
+  }
+
+  vm->jit->threshold = threshold ? threshold : LC3_JIT_THRESHOLD;
+  vm->core.native = jit_run;
+  vm->core.native_name = "jit";
+  return 1;
+}
+
+int lc3_tier(Lc3 *vm, unsigned block_threshold, unsigned trace_threshold)
+{
+  if (!lc3_jit(vm, trace_threshold))
+  {
+    return 0;
+  }
+
+  Lc3Jit *jit = vm->jit;
+
+  if (!jit->tier)
+  {
+    Tier *tier = calloc(1, sizeof(Tier));
+
+    if (!tier)
+    {
+      return 0;
+    }
+
+    pthread_mutex_init(&tier->lock, NULL);
+    pthread_cond_init(&tier->wake, NULL);
+
+    if (pthread_create(&tier->thread, NULL, compile_thread, tier) != 0)
+    {
+      pthread_cond_destroy(&tier->wake);
+      pthread_mutex_destroy(&tier->lock);
+      free(tier);
+      return 0;
+    }
+
+    jit->tier = tier;
+  }
+
+  jit->tier->threshold = block_threshold ? block_threshold : LC3_TIER_BLOCKS;
+  vm->core.native_name = "tier";
+
+  // 第 1 层要用预解码缓存
+  vm->core.engine = VM_ENGINE_PREDECODE;
+  return 1;
+}
+
+static void free_jobs(Job *job)
+{
+  while (job)
+  {
+    Job *next = job->next;
+    free(job->trace);
+    free(job);
+    job = next;
+  }
+}
+
+static void tier_free(Tier *tier)
+{
+  pthread_mutex_lock(&tier->lock);
+  tier->stop = 1;
+  pthread_cond_signal(&tier->wake);
+  pthread_mutex_unlock(&tier->lock);
+  pthread_join(tier->thread, NULL);
+
+  free_jobs(tier->todo);
+  free_jobs(tier->done);
+  pthread_cond_destroy(&tier->wake);
+  pthread_mutex_destroy(&tier->lock);
+  free(tier);
+}
+
+void lc3_jit_written(Lc3 *vm, uint16_t address)
+{
+  if (vm->jit && (vm->jit->code[address >> 3] >> (address & 7) & 1))
+  {
+    vm->jit->flush_pending = 1;
+  }
+}
+
+void lc3_jit_flush(Lc3 *vm)
+{
+  if (vm->jit)
+  {
+    flush(vm);
+  }
+}
+
+void lc3_jit_free(Lc3 *vm)
+{
+  if (!vm->jit)
+  {
+    return;
+  }
+
+  if (vm->jit->tier)
+  {
+    tier_free(vm->jit->tier);
+    vm->jit->tier = NULL;
+  }
+
+  flush(vm);
+  free(vm->jit);
+  vm->jit = NULL;
+
+  vm->core.native = NULL;
+  vm->core.native_name = NULL;
+}
+
+void lc3_jit_report(Lc3 *vm, FILE *out)
+{
+  Lc3Jit *jit = vm->jit;
+
+  if (!jit)
+  {
+    return;
+  }
+
+  fprintf(out, "[lc3] jit: %llu traces (%llu aborted, %llu flushes), %llu entries, %llu side exits, "
+               "%llu instructions in traces (%.1f%%)\n",
+          (unsigned long long)jit->trace_count, (unsigned long long)jit->abort_count,
+          (unsigned long long)jit->flush_count, (unsigned long long)jit->entries,
+          (unsigned long long)jit->side_exits, (unsigned long long)jit->trace_instrs,
+          vm->core.retired ? 100.0 * jit->trace_instrs / vm->core.retired : 0.0);
+
+  Tier *tier = jit->tier;
+
+  if (!tier)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&tier->lock);
+  double compile_seconds = tier->compile_seconds;
+  pthread_mutex_unlock(&tier->lock);
+
+  static const char *names[] = {"decode", "predecode", "trace"};
+  uint64_t instrs[3] = {tier->decoded, vm->core.retired - tier->decoded - jit->trace_instrs, jit->trace_instrs};
+
+  for (int k = 0; k < 3; k++)
+  {
+    fprintf(out, "[lc3] tier %d (%s): %llu instructions in %.6f s\n", k, names[k], (unsigned long long)instrs[k],
+            tier->seconds[k]);
+  }
+
+  fprintf(out, "[lc3] tier: %llu blocks promoted to 1, %llu traces to 2, %llu dropped; %llu switches; "
+               "compiled in background in %.6f s\n",
+          (unsigned long long)tier->promoted[1], (unsigned long long)tier->promoted[2],
+          (unsigned long long)tier->dropped, (unsigned long long)tier->switches, compile_seconds);
+}
@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+
+#include "lc3.h"
+
+static const char magic[4] = {'L', 'C', '3', 'R'};
+
+#define LC3_REPLAY_VERSION 1
+
+static void put_uleb(FILE *file, uint64_t v)
+{
+  while (v >= 0x80)
+  {
+    fputc((int)(v | 0x80) & 0xff, file);
+    v >>= 7;
+  }
+
+  fputc((int)v, file);
+}
+
+static int get_uleb(FILE *file, uint64_t *v)
+{
+  *v = 0;
+
+  for (int shift = 0; shift < 64; shift += 7)
+  {
+    int c = fgetc(file);
+    if (c == EOF)
+    {
+      return 0;
+    }
+
+    *v |= (uint64_t)(c & 0x7f) << shift;
+
+    if (!(c & 0x80))
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int lc3_record(Lc3 *vm, const char *path)
+{
+  FILE *file = fopen(path, "wb");
+  if (!file)
+  {
+    return 0;
+  }
+
+  fwrite(magic, 1, sizeof(magic), file);
+  fputc(LC3_REPLAY_VERSION, file);
+  fflush(file);
+
+  vm->io.mode = LC3_IO_RECORD;
+  vm->io.file = file;
+  return 1;
+}
+
+int lc3_replay(Lc3 *vm, const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+  {
+    return 0;
+  }
+
+  char header[sizeof(magic) + 1];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      memcmp(header, magic, sizeof(magic)) != 0 || header[sizeof(magic)] != LC3_REPLAY_VERSION)
+  {
+    fclose(file);
+    return 0;
+  }
+
+  vm->io.mode = LC3_IO_REPLAY;
+  vm->io.file = file;
+  return 1;
+}
+
+// 事件所在指令执行完后调用，vm->retired - 1 即该指令之前执行的指令数
+static void event_done(VmCore *core)
+{
+  Lc3 *vm = (Lc3 *)core;
+  Lc3Io *io = &vm->io;
+  uint64_t count = core->retired - 1;
+
+  if (io->mode == LC3_IO_RECORD)
+  {
+    put_uleb(io->file, (count - io->last_count) << 2 | io->kind);
+    put_uleb(io->file, io->value);
+
+    if (io->kind == LC3_EVENT_POLL_CHAR)
+    {
+      put_uleb(io->file, io->polls);
+    }
+
+    // 进程被杀死时已记录的事件仍然完整
+    fflush(io->file);
+  }
+  else if (count != io->expected_count && !io->diverged)
+  {
+    fprintf(stderr, "[lc3] replay diverged: event expected at instruction %llu, got %llu\n",
+            (unsigned long long)io->expected_count, (unsigned long long)count);
+    io->diverged = 1;
+  }
+
+  io->last_count = count;
+}
+
+// 读出回放的下一个事件，记录用完时停机
+static int load_event(Lc3 *vm)
+{
+  Lc3Io *io = &vm->io;
+  uint64_t head, value, polls = 0;
+
+  if (io->loaded)
+  {
+    return 1;
+  }
+
+  if (!get_uleb(io->file, &head) || !get_uleb(io->file, &value) ||
+      ((head & 3) == LC3_EVENT_POLL_CHAR && !get_uleb(io->file, &polls)))
+  {
+    fprintf(stderr, "[lc3] replay log exhausted at instruction %llu\n", (unsigned long long)vm->core.retired);
+    vm_core_halt(&vm->core);
+    return 0;
+  }
+
+  io->kind = head & 3;
+  io->value = (uint16_t)value;
+  io->polls = polls;
+  io->expected_count = io->last_count + (head >> 2);
+  io->loaded = 1;
+  return 1;
+}
+
+uint16_t lc3_input_char(Lc3 *vm)
+{
+  Lc3Io *io = &vm->io;
+
+  if (io->mode == LC3_IO_SESSION)
+  {
+    return io->input_pos < io->input_len ? (uint8_t)io->input[io->input_pos++] : 0xFFFF;
+  }
+
+  if (io->mode == LC3_IO_REPLAY)
+  {
+    if (!load_event(vm))
+    {
+      return 0;
+    }
+
+    if (io->kind != LC3_EVENT_CHAR && !io->diverged)
+    {
+      fprintf(stderr, "[lc3] replay diverged: GETC where the log has a KBSR poll\n");
+      io->diverged = 1;
+    }
+
+    io->loaded = 0;
+    io->empty_polls = 0;
+    vm_core_yield(&vm->core, event_done);
+    return io->value;
+  }
+
+  uint16_t c = (uint16_t)getchar();
+
+  if (io->mode == LC3_IO_RECORD)
+  {
+    io->kind = LC3_EVENT_CHAR;
+    io->value = c;
+    io->empty_polls = 0;
+    vm_core_yield(&vm->core, event_done);
+  }
+
+  return c;
+}
+
+// 终端是否有输入，不阻塞
+static int check_key(void)
+{
+  fd_set readfds;
+  FD_ZERO(&readfds);
+  FD_SET(0, &readfds);
+
+  struct timeval timeout = {0, 0};
+  return select(1, &readfds, NULL, NULL, &timeout) > 0;
+}
+
+int lc3_input_poll(Lc3 *vm, uint16_t *c)
+{
+  Lc3Io *io = &vm->io;
+
+  if (io->mode == LC3_IO_SESSION)
+  {
+    if (io->input_pos == io->input_len && !io->input_eof)
+    {
+      return 0;
+    }
+
+    *c = lc3_input_char(vm);
+    return 1;
+  }
+
+  if (io->mode == LC3_IO_REPLAY)
+  {
+    if (!load_event(vm))
+    {
+      return 0;
+    }
+
+    // 与记录时相同次数的空轮询之后才就绪
+    if (io->kind != LC3_EVENT_POLL_CHAR || io->empty_polls < io->polls)
+    {
+      io->empty_polls++;
+      return 0;
+    }
+
+    *c = io->value;
+    io->loaded = 0;
+    io->empty_polls = 0;
+    vm_core_yield(&vm->core, event_done);
+    return 1;
+  }
+
+  if (!check_key())
+  {
+    io->empty_polls++;
+    return 0;
+  }
+
+  *c = (uint16_t)getchar();
+
+  if (io->mode == LC3_IO_RECORD)
+  {
+    io->kind = LC3_EVENT_POLL_CHAR;
+    io->value = *c;
+    io->polls = io->empty_polls;
+    vm_core_yield(&vm->core, event_done);
+  }
+
+  io->empty_polls = 0;
+  return 1;
+}
+
+// ================= 会话模式 =================
+
+void lc3_session(Lc3 *vm, size_t output_limit)
+{
+  vm->io.mode = LC3_IO_SESSION;
+  vm->io.output_limit = output_limit ? output_limit : 1;
+}
+
+void lc3_feed(Lc3 *vm, const void *data, size_t len)
+{
+  Lc3Io *io = &vm->io;
+
+  // 已读完的输入不再保留
+  if (io->input_pos == io->input_len)
+  {
+    io->input_pos = io->input_len = 0;
+  }
+
+  if (io->input_len + len > io->input_cap)
+  {
+    io->input_cap = (io->input_len + len) * 2;
+    io->input = realloc(io->input, io->input_cap);
+  }
+
+  memcpy(io->input + io->input_len, data, len);
+  io->input_len += len;
+}
+
+void lc3_feed_eof(Lc3 *vm)
+{
+  vm->io.input_eof = 1;
+}
+
+size_t lc3_take_output(Lc3 *vm, void *buf, size_t cap)
+{
+  Lc3Io *io = &vm->io;
+  size_t n = io->output_len < cap ? io->output_len : cap;
+
+  memcpy(buf, io->output, n);
+  memmove(io->output, io->output + n, io->output_len - n);
+  io->output_len -= n;
+  return n;
+}
+
+int lc3_input_wait(Lc3 *vm)
+{
+  Lc3Io *io = &vm->io;
+
+  if (io->mode != LC3_IO_SESSION || io->input_pos < io->input_len || io->input_eof)
+  {
+    return 1;
+  }
+
+  // 补充输入后从这条指令重新执行
+  vm->core.pc = (vm->core.pc - 1) & 0xFFFF;
+  vm_core_stop(&vm->core, VM_STOP_INPUT);
+  return 0;
+}
+
+void lc3_output_char(Lc3 *vm, char c)
+{
+  Lc3Io *io = &vm->io;
+
+  if (io->mode != LC3_IO_SESSION)
+  {
+    putc(c, stdout);
+    return;
+  }
+
+  if (io->output_len == io->output_cap)
+  {
+    io->output_cap = io->output_cap ? io->output_cap * 2 : 256;
+    io->output = realloc(io->output, io->output_cap);
+  }
+
+  io->output[io->output_len++] = c;
+
+  if (io->output_len >= io->output_limit)
+  {
+    vm_core_stop(&vm->core, VM_STOP_OUTPUT);
+  }
+}
+
+void lc3_output_flush(Lc3 *vm)
+{
+  if (vm->io.mode != LC3_IO_SESSION)
+  {
+    fflush(stdout);
+  }
+}
@@ -0,0 +1,452 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lc3_simd.h"
+
+#define LANES LC3_LANES
+
+// 没有开启 AVX 时按值传递和返回向量的 ABI 不同（-Wpsabi），函数间一律经指针传递向量
+
+// 以下操作作用于全部 lane，m 为掩码，对应 lane 为 0xFFFF 时才写入结果
+#define BLEND(m, a, b) (((a) & (m)) | ((b) & ~(m)))
+#define SPLAT(x) ((Lc3Vec){0} + (uint16_t)(x))
+
+static inline void load_row(Lc3Vec *v, const uint16_t *row)
+{
+  memcpy(v, row, sizeof(*v));
+}
+
+static inline void store_row(uint16_t *row, const Lc3Vec *v)
+{
+  memcpy(row, v, sizeof(*v));
+}
+
+static inline uint32_t lane_bits(const Lc3Vec *m)
+{
+  uint32_t bits = 0;
+
+  for (int l = 0; l < LANES; l++)
+  {
+    bits |= (uint32_t)((*m)[l] & 1) << l;
+  }
+
+  return bits;
+}
+
+static uint16_t sign_extend(uint16_t x, int bit_count)
+{
+  if ((x >> (bit_count - 1)) & 0x1)
+  {
+    x |= 0xFFFF << bit_count;
+  }
+
+  return x;
+}
+
+// 逐 lane 模拟不了的页：设备寄存器、观察点
+static inline int unsupported_page(const Lc3Batch *batch, uint16_t address)
+{
+  return batch->vm->page_flags[address >> LC3_PAGE_SHIFT] & ~(LC3_PAGE_LAZY | LC3_PAGE_CODE);
+}
+
+// lane 执行到不支持的指令，停止并记下地址（pc 为下一条）
+static void fault(Lc3Batch *batch, int lane, uint16_t pc)
+{
+  batch->active[lane] = 0;
+  batch->faulted |= 1u << lane;
+  batch->fault_pc[lane] = pc - 1;
+}
+
+// 掩码内的 lane 全部停止
+static void fault_all(Lc3Batch *batch, const Lc3Vec *m, uint16_t pc)
+{
+  for (int l = 0; l < LANES; l++)
+  {
+    if ((*m)[l])
+    {
+      fault(batch, l, pc);
+    }
+  }
+}
+
+static void set_reg(Lc3Batch *batch, const Lc3Vec *m, int r, const Lc3Vec *value)
+{
+  Lc3Vec zero = (Lc3Vec)(*value == 0);
+  Lc3Vec neg = (Lc3Vec)((*value >> 15) != 0);
+  Lc3Vec cond = (SPLAT(FL_ZRO) & zero) | (SPLAT(FL_NEG) & neg) | (SPLAT(FL_POS) & ~(zero | neg));
+
+  batch->reg[r] = BLEND(*m, *value, batch->reg[r]);
+  batch->reg[R_COND] = BLEND(*m, cond, batch->reg[R_COND]);
+}
+
+// 各 lane 地址不同的读写，逐 lane 进行，访问不支持的页的 lane 停止
+static void gather(Lc3Batch *batch, const Lc3Vec *m, const Lc3Vec *address, uint16_t pc, Lc3Vec *out)
+{
+  Lc3Vec value = {0};
+
+  for (int l = 0; l < LANES; l++)
+  {
+    if ((*m)[l] && unsupported_page(batch, (*address)[l]))
+    {
+      fault(batch, l, pc);
+    }
+    else if ((*m)[l])
+    {
+      value[l] = batch->mem[(*address)[l]][l];
+    }
+  }
+
+  *out = value;
+}
+
+static void scatter(Lc3Batch *batch, const Lc3Vec *m, const Lc3Vec *address, const Lc3Vec *value, uint16_t pc)
+{
+  for (int l = 0; l < LANES; l++)
+  {
+    if ((*m)[l] && unsupported_page(batch, (*address)[l]))
+    {
+      fault(batch, l, pc);
+    }
+    else if ((*m)[l])
+    {
+      batch->mem[(*address)[l]][l] = (*value)[l];
+    }
+  }
+}
+
+// 各 lane 地址相同的读写，地址不支持时全部停止，返回 0
+static int row_ok(Lc3Batch *batch, const Lc3Vec *m, uint16_t address, uint16_t pc)
+{
+  if (unsupported_page(batch, address))
+  {
+    fault_all(batch, m, pc);
+    return 0;
+  }
+
+  return 1;
+}
+
+static void put(Lc3LaneIo *io, char c)
+{
+  if (io->output_len == io->output_cap)
+  {
+    io->output_cap = io->output_cap ? io->output_cap * 2 : 64;
+    io->output = realloc(io->output, io->output_cap);
+  }
+
+  io->output[io->output_len++] = c;
+}
+
+static void put_string(Lc3LaneIo *io, const char *s)
+{
+  while (*s)
+  {
+    put(io, *s++);
+  }
+}
+
+static uint16_t get(Lc3LaneIo *io)
+{
+  return io->input_pos < io->input_len ? (uint8_t)io->input[io->input_pos++] : 0xFFFF;
+}
+
+// 与 lc3.c 的 trap 相同的判断：钩子和经向量表进入客户机的 TRAP 不支持
+static int guest_trap(const Lc3 *vm, uint16_t trap_code)
+{
+  uint8_t mode = vm->trap_mode[trap_code];
+  int standard = trap_code >= TRAP_GETC && trap_code <= TRAP_HALT;
+
+  return vm->trap_hooks[trap_code].handler || mode == LC3_TRAP_GUEST ||
+         (mode == LC3_TRAP_AUTO && !standard && vm->mem[trap_code]);
+}
+
+// TRAP 逐 lane 执行，输入输出落在各自的缓冲区，输出与 lc3.c 的 trap 相同
+static void trap(Lc3Batch *batch, const Lc3Vec *m, uint16_t trap_code, uint16_t pc)
+{
+  if (guest_trap(batch->vm, trap_code))
+  {
+    fault_all(batch, m, pc);
+    return;
+  }
+
+  for (int l = 0; l < LANES; l++)
+  {
+    if (!(*m)[l])
+    {
+      continue;
+    }
+
+    Lc3LaneIo *io = &batch->io[l];
+    uint16_t address = batch->reg[R_R0][l];
+
+    switch (trap_code)
+    {
+    case TRAP_GETC:
+      batch->reg[R_R0][l] = get(io);
+      break;
+
+    case TRAP_OUT:
+      put(io, (char)batch->reg[R_R0][l]);
+      break;
+
+    case TRAP_PUTS:
+      for (uint16_t c; (c = batch->mem[address][l]); address++)
+      {
+        put(io, (char)c);
+      }
+      break;
+
+    case TARP_IN:
+    {
+      uint16_t c = get(io);
+
+      put_string(io, "Enter a character:");
+      put(io, (char)c);
+      batch->reg[R_R0][l] = (uint16_t)(char)c;
+      break;
+    }
+
+    case TRAP_PUTSP:
+      for (uint16_t c; (c = batch->mem[address][l]); address++)
+      {
+        put(io, (char)(c & 0xff));
+        if (c >> 8)
+        {
+          put(io, (char)(c >> 8));
+        }
+      }
+      break;
+
+    case TRAP_HALT:
+      put_string(io, "Halt\n");
+      batch->active[l] = 0;
+      break;
+
+    default:
+      put_string(io, "Unknown TrapCode!\n");
+      break;
+    }
+  }
+}
+
+// 对掩码内的 lane 执行 instr，pc 为下一条指令的地址
+static void execute(Lc3Batch *batch, const Lc3Vec *m, uint16_t instr, uint16_t pc)
+{
+  Lc3Vec *reg = batch->reg;
+  uint16_t r0 = (instr >> 9) & 0x7;
+  uint16_t r1 = (instr >> 6) & 0x7;
+  uint16_t pc_offset = sign_extend(instr & 0x1FF, 9);
+  Lc3Vec value;
+
+  switch (instr >> 12)
+  {
+  case OP_ADD:
+  case OP_AND:
+  {
+    Lc3Vec b = (instr >> 5) & 0x1 ? SPLAT(sign_extend(instr & 0x1F, 5)) : reg[instr & 0x7];
+    value = (instr >> 12) == OP_ADD ? reg[r1] + b : reg[r1] & b;
+    set_reg(batch, m, r0, &value);
+    break;
+  }
+
+  case OP_NOT:
+    value = ~reg[r1];
+    set_reg(batch, m, r0, &value);
+    break;
+
+  case OP_BR:
+  {
+    Lc3Vec taken = *m & (Lc3Vec)((reg[R_COND] & r0) != 0);
+    batch->pc = BLEND(taken, SPLAT(pc + pc_offset), batch->pc);
+    break;
+  }
+
+  case OP_JMP:
+    batch->pc = BLEND(*m, reg[r1], batch->pc);
+    break;
+
+  case OP_JSR:
+  {
+    Lc3Vec target = (instr >> 11) & 0x1 ? SPLAT(pc + sign_extend(instr & 0x7FF, 11)) : reg[r1];
+    reg[R_R7] = BLEND(*m, SPLAT(pc), reg[R_R7]);
+    batch->pc = BLEND(*m, target, batch->pc);
+    break;
+  }
+
+  case OP_LD:
+    if (row_ok(batch, m, pc + pc_offset, pc))
+    {
+      load_row(&value, batch->mem[(uint16_t)(pc + pc_offset)]);
+      set_reg(batch, m, r0, &value);
+    }
+    break;
+
+  case OP_LDI:
+    if (row_ok(batch, m, pc + pc_offset, pc))
+    {
+      Lc3Vec address;
+      load_row(&address, batch->mem[(uint16_t)(pc + pc_offset)]);
+      gather(batch, m, &address, pc, &value);
+      set_reg(batch, m, r0, &value);
+    }
+    break;
+
+  case OP_LDR:
+  {
+    Lc3Vec address = reg[r1] + sign_extend(instr & 0x3F, 6);
+    gather(batch, m, &address, pc, &value);
+    set_reg(batch, m, r0, &value);
+    break;
+  }
+
+  case OP_LEA:
+    value = SPLAT(pc + pc_offset);
+    set_reg(batch, m, r0, &value);
+    break;
+
+  case OP_ST:
+    if (row_ok(batch, m, pc + pc_offset, pc))
+    {
+      uint16_t *row = batch->mem[(uint16_t)(pc + pc_offset)];
+      load_row(&value, row);
+      value = BLEND(*m, reg[r0], value);
+      store_row(row, &value);
+    }
+    break;
+
+  case OP_STI:
+    if (row_ok(batch, m, pc + pc_offset, pc))
+    {
+      Lc3Vec address;
+      load_row(&address, batch->mem[(uint16_t)(pc + pc_offset)]);
+      scatter(batch, m, &address, &reg[r0], pc);
+    }
+    break;
+
+  case OP_STR:
+  {
+    Lc3Vec address = reg[r1] + sign_extend(instr & 0x3F, 6);
+    scatter(batch, m, &address, &reg[r0], pc);
+    break;
+  }
+
+  case OP_TRAP:
+    trap(batch, m, instr & 0xFF, pc);
+    break;
+
+  default:
+    // RTI 和保留指令要进入客户机的异常例程
+    fault_all(batch, m, pc);
+    break;
+  }
+}
+
+Lc3Batch *lc3_batch_create(void)
+{
+  // aligned_alloc 的大小须是对齐的整数倍
+  Lc3Batch *batch = aligned_alloc(64, (sizeof(Lc3Batch) + 63) & ~(size_t)63);
+
+  if (!batch)
+  {
+    return NULL;
+  }
+
+  memset(batch, 0, sizeof(*batch));
+  batch->mem = aligned_alloc(64, sizeof(uint16_t) * LANES * (UINT16_MAX + 1));
+
+  if (!batch->mem)
+  {
+    free(batch);
+    return NULL;
+  }
+
+  return batch;
+}
+
+void lc3_batch_destroy(Lc3Batch *batch)
+{
+  for (int l = 0; l < LANES; l++)
+  {
+    free(batch->io[l].output);
+  }
+
+  free(batch->mem);
+  free(batch);
+}
+
+void lc3_batch_reset(Lc3Batch *batch, const Lc3 *vm, int lanes)
+{
+  for (uint32_t address = 0; address <= UINT16_MAX; address++)
+  {
+    Lc3Vec row = SPLAT(address < UINT16_MAX ? vm->mem[address] : 0);
+    store_row(batch->mem[address], &row);
+  }
+
+  memset(batch->reg, 0, sizeof(batch->reg));
+  batch->reg[R_COND] = SPLAT(FL_ZRO);
+  batch->pc = SPLAT(vm->origin);
+
+  for (int l = 0; l < LANES; l++)
+  {
+    batch->active[l] = l < lanes ? 0xFFFF : 0;
+    batch->io[l].input = NULL;
+    batch->io[l].input_len = batch->io[l].input_pos = 0;
+    batch->io[l].output_len = 0;
+  }
+
+  batch->vm = vm;
+  batch->faulted = 0;
+  batch->retired = 0;
+  batch->steps = 0;
+}
+
+void lc3_batch_set_input(Lc3Batch *batch, int lane, const char *input, size_t len)
+{
+  batch->io[lane].input = input;
+  batch->io[lane].input_len = len;
+  batch->io[lane].input_pos = 0;
+}
+
+uint32_t lc3_batch_run(Lc3Batch *batch, uint64_t max_steps)
+{
+  uint32_t active;
+
+  while ((active = lane_bits(&batch->active)) && (!max_steps || batch->steps < max_steps))
+  {
+    // 选 PC 最小的 lane 组，落后的 lane 先走，分支后能在汇合点重新合并
+    int first = __builtin_ctz(active);
+    uint16_t pc = batch->pc[first];
+
+    for (int l = first + 1; l < LANES; l++)
+    {
+      if (batch->active[l] && batch->pc[l] < pc)
+      {
+        first = l;
+        pc = batch->pc[l];
+      }
+    }
+
+    // 各 lane 内存独立，代码可能被改得不同，只执行与 first 指令相同的 lane
+    Lc3Vec instrs;
+    load_row(&instrs, batch->mem[pc]);
+    uint16_t instr = instrs[first];
+    Lc3Vec m = batch->active & (Lc3Vec)(batch->pc == pc) & (Lc3Vec)(instrs == instr);
+
+    uint16_t next_pc = pc + 1;
+    batch->pc = BLEND(m, SPLAT(next_pc), batch->pc);
+
+    if (unsupported_page(batch, pc))
+    {
+      fault_all(batch, &m, next_pc);
+      continue;
+    }
+
+    execute(batch, &m, instr, next_pc);
+
+    // 停止的 lane 没有执行完这条指令
+    batch->retired += __builtin_popcount(lane_bits(&m) & ~batch->faulted);
+    batch->steps++;
+  }
+
+  return active;
+}
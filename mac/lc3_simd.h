@@ -0,0 +1,68 @@
+#ifndef LC3_SIMD_H
+#define LC3_SIMD_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "lc3.h"
+
+// 同一镜像、不同输入的多个 LC-3 客户机按 lane 并行执行。
+// 寄存器、PC、COND 都是 uint16_t 向量（GCC 向量扩展，开启 AVX2 时一条指令处理 16 个 lane），
+// 每步选取 PC 最小的一组 lane 带掩码执行，PC 不同的 lane 等待，PC 重新一致时自然合并。
+// 六个标准 TRAP 的输入输出与 lc3.c 相同；访问设备寄存器或观察点所在的页、经向量表进入客户机的 TRAP、
+// RTI 和保留操作码不能按 lane 模拟，执行到时该 lane 停止并记入 faulted，应改用单个客户机执行
+
+#ifndef LC3_LANES
+#define LC3_LANES 16
+#endif
+
+typedef uint16_t Lc3Vec __attribute__((vector_size(LC3_LANES * sizeof(uint16_t))));
+
+// 每个 lane 的输入输出
+typedef struct
+{
+  const char *input;
+  size_t input_len;
+  size_t input_pos;
+
+  char *output;
+  size_t output_len;
+  size_t output_cap;
+} Lc3LaneIo;
+
+typedef struct
+{
+  Lc3Vec reg[R_COUNT];
+  Lc3Vec pc;
+  Lc3Vec active; // 未停机的 lane 为 0xFFFF
+
+  // mem[地址][lane]，同一地址各 lane 的数据相邻，地址相同时整行读写
+  uint16_t (*mem)[LC3_LANES];
+
+  Lc3LaneIo io[LC3_LANES];
+
+  const Lc3 *vm;               // 提供内存页标记和 TRAP 设置
+  uint32_t faulted;            // 执行到不支持的指令而停止的 lane
+  uint16_t fault_pc[LC3_LANES]; // 该指令的地址
+
+  uint64_t retired; // 所有 lane 执行的客户指令数之和
+  uint64_t steps;   // 向量步数
+} Lc3Batch;
+
+// 内存不足时返回 NULL
+Lc3Batch *lc3_batch_create(void);
+
+void lc3_batch_destroy(Lc3Batch *batch);
+
+// 从已载入镜像的 vm 复制内存，前 lanes 个 lane 从 vm->origin 开始执行，清空输入输出。
+// 执行期间 vm 须保持有效
+void lc3_batch_reset(Lc3Batch *batch, const Lc3 *vm, int lanes);
+
+// 设置 lane 的输入，GETC/IN 依次读取，读完返回 0xFFFF（与 getchar 的 EOF 相同）
+void lc3_batch_set_input(Lc3Batch *batch, int lane, const char *input, size_t len);
+
+// 执行到所有 lane 停机或执行了 max_steps 步（0 表示不限），返回仍未停机的 lane 掩码，
+// 不含 faulted 中的 lane
+uint32_t lc3_batch_run(Lc3Batch *batch, uint64_t max_steps);
+
+#endif
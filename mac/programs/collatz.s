@@ -0,0 +1,43 @@
+# E = 1..2999 每个数到达 1 的 Collatz 步数之和
+        SET D 1             # 当前起点 n
+        SET E 0             # 总步数
+        SET F 0             # F 恒为 0，IF F 0 即无条件跳转
+outer:  IF D 3000 done
+        MOV B D             # x = n
+inner:  IF B 1 next
+        STR B               # A = x - x / 2 * 2
+        STR B
+        PSH 2
+        DIV
+        PSH 2
+        MUL
+        SUB
+        POP
+        IF A 0 even
+        STR B               # x = 3x + 1
+        PSH 3
+        MUL
+        PSH 1
+        ADD
+        LDR B
+        POP
+        IF F 0 step
+even:   STR B               # x = x / 2
+        PSH 2
+        DIV
+        LDR B
+        POP
+step:   STR E
+        PSH 1
+        ADD
+        LDR E
+        POP
+        IF F 0 inner
+next:   STR D
+        PSH 1
+        ADD
+        LDR D
+        POP
+        IF F 0 outer
+done:   LOGR E
+        HLT
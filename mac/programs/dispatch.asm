@@ -0,0 +1,87 @@
+; 按跳转表执行一段操作序列 1000 遍并打印累加结果，大部分指令在经表的间接调用中
+        .ORIG x3000
+        AND R5, R5, #0      ; R5 = 累加结果
+        LD R4, REPS
+OUTER   LEA R1, OPS
+INNER   LDR R0, R1, #0      ; 操作号，负数表示结束
+        BRn NEXT
+        LEA R3, TABLE
+        ADD R3, R3, R0
+        LDR R3, R3, #0
+        JSRR R3
+        ADD R1, R1, #1
+        BR INNER
+NEXT    ADD R4, R4, #-1
+        BRp OUTER
+        LEA R0, MSG
+        PUTS
+        ADD R1, R5, #0
+        JSR PRINTNUM
+        LD R0, NEWLINE
+        OUT
+        HALT
+
+REPS    .FILL #1000
+NEWLINE .FILL x0A
+ASCII0  .FILL x30
+MSG     .STRINGZ "result: "
+
+TABLE   .FILL OP_INC
+        .FILL OP_DEC
+        .FILL OP_ADD7
+        .FILL OP_SUB5
+
+; 每遍净增 6
+OPS     .FILL #0
+        .FILL #0
+        .FILL #2
+        .FILL #3
+        .FILL #1
+        .FILL #2
+        .FILL #3
+        .FILL #0
+        .FILL #-1
+
+OP_INC  ADD R5, R5, #1
+        RET
+OP_DEC  ADD R5, R5, #-1
+        RET
+OP_ADD7 ADD R5, R5, #7
+        RET
+OP_SUB5 ADD R5, R5, #-5
+        RET
+
+; R1 / R2（R2 > 0）：R3 = 商，R1 = 余数
+DIVMOD  AND R3, R3, #0
+        NOT R2, R2
+        ADD R2, R2, #1      ; R2 = -除数
+DLOOP   ADD R1, R1, R2
+        BRn DEND
+        ADD R3, R3, #1
+        BR DLOOP
+DEND    NOT R2, R2
+        ADD R2, R2, #1      ; 恢复除数
+        ADD R1, R1, R2
+        RET
+
+; 以十进制打印 R1
+PRINTNUM ST R7, N_R7
+        LEA R4, NUMEND
+NLOOP   AND R2, R2, #0
+        ADD R2, R2, #10
+        JSR DIVMOD
+        LD R0, ASCII0
+        ADD R0, R1, R0
+        ADD R4, R4, #-1
+        STR R0, R4, #0
+        ADD R1, R3, #0
+        BRp NLOOP
+        ADD R0, R4, #0
+        PUTS
+        LD R7, N_R7
+        RET
+
+N_R7    .FILL 0
+NUMBUF  .BLKW 6
+NUMEND  .FILL 0
+        .END
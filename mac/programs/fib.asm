@@ -0,0 +1,75 @@
+; 递归计算 fib(23) 并以十进制打印，大部分指令是调用、返回和栈操作
+        .ORIG x3000
+        LD R6, STACK
+        LD R1, N
+        JSR FIB
+        ADD R5, R0, #0
+        LEA R0, MSG
+        PUTS
+        ADD R1, R5, #0
+        JSR PRINTNUM
+        LD R0, NEWLINE
+        OUT
+        HALT
+
+STACK   .FILL x6000
+N       .FILL #23
+NEWLINE .FILL x0A
+ASCII0  .FILL x30
+MSG     .STRINGZ "fib(23) = "
+
+; R0 = fib(R1)，R6 为向下增长的栈，保存 R1、R2、R7
+FIB     ADD R6, R6, #-3
+        STR R7, R6, #0
+        STR R1, R6, #1
+        STR R2, R6, #2
+        ADD R0, R1, #-2
+        BRn FBASE           ; n < 2 时 fib(n) = n
+        ADD R1, R1, #-1
+        JSR FIB
+        ADD R2, R0, #0      ; R2 = fib(n - 1)
+        ADD R1, R1, #-1
+        JSR FIB
+        ADD R0, R0, R2
+        BR FRET
+FBASE   ADD R0, R1, #0
+FRET    LDR R7, R6, #0
+        LDR R1, R6, #1
+        LDR R2, R6, #2
+        ADD R6, R6, #3
+        RET
+
+; R1 / R2（R2 > 0）：R3 = 商，R1 = 余数
+DIVMOD  AND R3, R3, #0
+        NOT R2, R2
+        ADD R2, R2, #1      ; R2 = -除数
+DLOOP   ADD R1, R1, R2
+        BRn DEND
+        ADD R3, R3, #1
+        BR DLOOP
+DEND    NOT R2, R2
+        ADD R2, R2, #1      ; 恢复除数
+        ADD R1, R1, R2
+        RET
+
+; 以十进制打印 R1
+PRINTNUM ST R7, N_R7
+        LEA R4, NUMEND
+NLOOP   AND R2, R2, #0
+        ADD R2, R2, #10
+        JSR DIVMOD
+        LD R0, ASCII0
+        ADD R0, R1, R0
+        ADD R4, R4, #-1
+        STR R0, R4, #0
+        ADD R1, R3, #0
+        BRp NLOOP
+        ADD R0, R4, #0
+        PUTS
+        LD R7, N_R7
+        RET
+
+N_R7    .FILL 0
+NUMBUF  .BLKW 6
+NUMEND  .FILL 0
+        .END
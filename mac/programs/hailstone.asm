@@ -0,0 +1,91 @@
+; 从输入读取十进制数 n（不超过 100），打印 n 到达 1 的 Collatz 步数。
+; 不同输入的分支走向不同，用于 -batch 并行执行
+        .ORIG x3000
+        AND R1, R1, #0      ; R1 = n
+READ    GETC
+        ADD R0, R0, #0
+        BRz PARSED          ; 输入结束
+        LD R3, NEG_ZERO
+        ADD R2, R0, R3      ; 数字的值
+        BRn PARSED          ; 非数字结束
+        ADD R3, R2, #-9
+        BRp PARSED
+        ADD R3, R1, R1      ; n = n * 10 + 数字
+        ADD R1, R3, R3
+        ADD R1, R1, R1
+        ADD R1, R1, R3
+        ADD R1, R1, R2
+        BR READ
+
+PARSED  AND R5, R5, #0      ; R5 = 步数
+STEP    ADD R2, R1, #-1
+        BRnz DONE
+        AND R2, R1, #1
+        BRz EVEN
+        ADD R2, R1, R1      ; n = 3n + 1
+        ADD R1, R2, R1
+        ADD R1, R1, #1
+        BR NEXT
+EVEN    JSR HALVE
+NEXT    ADD R5, R5, #1
+        BR STEP
+
+DONE    ADD R1, R5, #0
+        JSR PRINTNUM
+        LD R0, NEWLINE
+        OUT
+        HALT
+
+NEG_ZERO .FILL xFFD0
+NEWLINE  .FILL x0A
+ASCII0   .FILL x30
+
+; R1 = R1 >> 1
+HALVE   AND R3, R3, #0      ; 结果
+        AND R4, R4, #0
+        ADD R4, R4, #2      ; 源位
+        AND R6, R6, #0
+        ADD R6, R6, #1      ; 目标位
+HLOOP   AND R2, R1, R4
+        BRz HSKIP
+        ADD R3, R3, R6
+HSKIP   ADD R6, R6, R6
+        ADD R4, R4, R4
+        BRnp HLOOP
+        ADD R1, R3, #0
+        RET
+
+; R1 / R2（R2 > 0）：R3 = 商，R1 = 余数
+DIVMOD  AND R3, R3, #0
+        NOT R2, R2
+        ADD R2, R2, #1
+DLOOP   ADD R1, R1, R2
+        BRn DEND
+        ADD R3, R3, #1
+        BR DLOOP
+DEND    NOT R2, R2
+        ADD R2, R2, #1
+        ADD R1, R1, R2
+        RET
+
+; 以十进制打印 R1
+PRINTNUM ST R7, N_R7
+        LEA R4, NUMEND
+NLOOP   AND R2, R2, #0
+        ADD R2, R2, #10
+        JSR DIVMOD
+        LD R0, ASCII0
+        ADD R0, R1, R0
+        ADD R4, R4, #-1
+        STR R0, R4, #0
+        ADD R1, R3, #0
+        BRp NLOOP
+        ADD R0, R4, #0
+        PUTS
+        LD R7, N_R7
+        RET
+
+N_R7    .FILL 0
+NUMBUF  .BLKW 6
+NUMEND  .FILL 0
+        .END
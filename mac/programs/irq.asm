@@ -0,0 +1,116 @@
+; 中断驱动的键盘回显：主程序只等待结束标志，不轮询键盘。
+; 键盘中断例程回显读到的字符，遇到 '.' 或输入结束时置结束标志；
+; 主程序先空转一段时间，定时器中断每 500 条指令计数一次，结束时打印计数
+        .ORIG x3000
+        LEA R0, KBD_ISR
+        STI R0, KBD_VEC
+        LEA R0, TMR_ISR
+        STI R0, TMR_VEC
+        LD R0, PERIOD
+        STI R0, TMI_PTR
+        LD R0, IE
+        STI R0, TMR_PTR
+        STI R0, KBSR_PTR
+
+        LD R2, COUNT
+BUSY    ADD R2, R2, #-1
+        BRp BUSY
+
+WAIT    LD R0, DONE
+        BRz WAIT
+
+        AND R0, R0, #0      ; 关定时器中断
+        STI R0, TMR_PTR
+        LD R0, NEWLINE
+        OUT
+        LD R1, TICKS
+        JSR PRINTNUM
+        LD R0, NEWLINE
+        OUT
+        HALT
+
+KBD_VEC  .FILL x0180
+TMR_VEC  .FILL x0181
+KBSR_PTR .FILL xFE00
+KBDR_PTR .FILL xFE02
+TMR_PTR  .FILL xFE08
+TMI_PTR  .FILL xFE0A
+IE       .FILL x4000
+PERIOD   .FILL #500
+COUNT    .FILL #3000
+NEG_DOT  .FILL xFFD2
+NEWLINE  .FILL x0A
+ASCII0   .FILL x30
+DONE     .FILL 0
+TICKS    .FILL 0
+
+; 读 KBDR 清除就绪位并回显
+KBD_ISR ST R0, K_R0
+        ST R1, K_R1
+        ST R7, K_R7
+        LDI R0, KBDR_PTR
+        ADD R1, R0, #1      ; 输入结束时为 xFFFF
+        BRz K_END
+        LD R1, NEG_DOT
+        ADD R1, R0, R1
+        BRz K_END
+        OUT
+        BR K_RET
+K_END   AND R1, R1, #0      ; 关键盘中断，输入结束后 KBSR 会一直就绪
+        STI R1, KBSR_PTR
+        ADD R1, R1, #1
+        ST R1, DONE
+K_RET   LD R0, K_R0
+        LD R1, K_R1
+        LD R7, K_R7
+        RTI
+
+; 写 TMR 清除到期位
+TMR_ISR ST R0, T_R0
+        LD R0, TICKS
+        ADD R0, R0, #1
+        ST R0, TICKS
+        LD R0, IE
+        STI R0, TMR_PTR
+        LD R0, T_R0
+        RTI
+
+K_R0    .FILL 0
+K_R1    .FILL 0
+K_R7    .FILL 0
+T_R0    .FILL 0
+
+; R1 / R2（R2 > 0）：R3 = 商，R1 = 余数
+DIVMOD  AND R3, R3, #0
+        NOT R2, R2
+        ADD R2, R2, #1
+DLOOP   ADD R1, R1, R2
+        BRn DEND
+        ADD R3, R3, #1
+        BR DLOOP
+DEND    NOT R2, R2
+        ADD R2, R2, #1
+        ADD R1, R1, R2
+        RET
+
+; 以十进制打印 R1
+PRINTNUM ST R7, N_R7
+        LEA R4, NUMEND
+NLOOP   AND R2, R2, #0
+        ADD R2, R2, #10
+        JSR DIVMOD
+        LD R0, ASCII0
+        ADD R0, R1, R0
+        ADD R4, R4, #-1
+        STR R0, R4, #0
+        ADD R1, R3, #0
+        BRp NLOOP
+        ADD R0, R4, #0
+        PUTS
+        LD R7, N_R7
+        RET
+
+N_R7    .FILL 0
+NUMBUF  .BLKW 6
+NUMEND  .FILL 0
+        .END
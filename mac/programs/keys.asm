@@ -0,0 +1,67 @@
+; 轮询 KBSR，回显读到的字符，遇到 '.' 或输入结束时打印空轮询次数（低 14 位）后停机。
+; 空轮询次数取决于输入到达的时机，用于验证 -record/-replay
+        .ORIG x3000
+        AND R5, R5, #0      ; R5 = 空轮询次数
+POLL    LDI R1, KBSR_PTR
+        BRn READY
+        ADD R5, R5, #1
+        BR POLL
+READY   LDI R0, KBDR_PTR
+        ADD R2, R0, #1      ; 输入结束时为 xFFFF
+        BRz DONE
+        LD R2, NEG_DOT
+        ADD R2, R0, R2
+        BRz DONE
+        OUT
+        BR POLL
+
+DONE    LD R0, NEWLINE
+        OUT
+        LD R1, MASK
+        AND R1, R5, R1
+        JSR PRINTNUM
+        LD R0, NEWLINE
+        OUT
+        HALT
+
+KBSR_PTR .FILL xFE00
+KBDR_PTR .FILL xFE02
+NEG_DOT  .FILL xFFD2
+NEWLINE  .FILL x0A
+MASK     .FILL x3FFF
+ASCII0   .FILL x30
+
+; R1 / R2（R2 > 0）：R3 = 商，R1 = 余数
+DIVMOD  AND R3, R3, #0
+        NOT R2, R2
+        ADD R2, R2, #1
+DLOOP   ADD R1, R1, R2
+        BRn DEND
+        ADD R3, R3, #1
+        BR DLOOP
+DEND    NOT R2, R2
+        ADD R2, R2, #1
+        ADD R1, R1, R2
+        RET
+
+; 以十进制打印 R1
+PRINTNUM ST R7, N_R7
+        LEA R4, NUMEND
+NLOOP   AND R2, R2, #0
+        ADD R2, R2, #10
+        JSR DIVMOD
+        LD R0, ASCII0
+        ADD R0, R1, R0
+        ADD R4, R4, #-1
+        STR R0, R4, #0
+        ADD R1, R3, #0
+        BRp NLOOP
+        ADD R0, R4, #0
+        PUTS
+        LD R7, N_R7
+        RET
+
+N_R7    .FILL 0
+NUMBUF  .BLKW 6
+NUMEND  .FILL 0
+        .END
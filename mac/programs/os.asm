@@ -0,0 +1,117 @@
+; 最小的 LC-3 OS：trap 向量表和 GETC/OUT/PUTS/IN/PUTSP/HALT 服务例程，只通过 KBSR/KBDR、DSR/DDR、MCR 访问设备。
+; 放在用户程序之前载入，配合 -trap=guest 验证经向量表执行的 TRAP，如
+;   vm_lc_3 -trap=guest os.obj primes.obj
+        .ORIG x0020
+        .FILL T_GETC        ; x20
+        .FILL T_OUT         ; x21
+        .FILL T_PUTS        ; x22
+        .FILL T_IN          ; x23
+        .FILL T_PUTSP       ; x24
+        .FILL T_HALT        ; x25
+
+; 等待键盘输入，R0 = 字符
+T_GETC  LDI R0, KBSR_P
+        BRzp T_GETC
+        LDI R0, KBDR_P
+        RET
+
+; 输出 R0 的低 8 位
+T_OUT   ST R1, SAVE1
+OUT_W   LDI R1, DSR_P
+        BRzp OUT_W
+        STI R0, DDR_P
+        LD R1, SAVE1
+        RET
+
+; 输出 R0 处的字符串，一个字符一个字
+T_PUTS  ST R0, SAVE0
+        ST R1, SAVE1
+        ST R2, SAVE2
+        ADD R1, R0, #0
+PUTS_L  LDR R0, R1, #0
+        BRz PUTS_D
+PUTS_W  LDI R2, DSR_P
+        BRzp PUTS_W
+        STI R0, DDR_P
+        ADD R1, R1, #1
+        BR PUTS_L
+PUTS_D  LD R0, SAVE0
+        LD R1, SAVE1
+        LD R2, SAVE2
+        RET
+
+; 提示后读一个字符并回显，R0 = 字符
+T_IN    ST R7, SAVE7
+        LEA R0, PROMPT
+        TRAP x22
+        TRAP x20
+        TRAP x21
+        LD R7, SAVE7
+        RET
+
+; 输出 R0 处的字符串，一个字两个字符，先低 8 位后高 8 位
+T_PUTSP ST R0, SAVE0
+        ST R1, SAVE1
+        ST R2, SAVE2
+        ST R3, SAVE3
+        ST R4, SAVE4
+        ST R5, SAVE5
+        ST R6, SAVE6
+        ST R7, SAVE7
+        ADD R1, R0, #0
+PSP_L   LDR R2, R1, #0
+        BRz PSP_D
+        ADD R0, R2, #0      ; DDR 只输出低 8 位
+        TRAP x21
+        AND R0, R0, #0      ; R0 = R2 >> 8，逐位拼出
+        LD R3, HIGH_BIT
+        AND R4, R4, #0
+        ADD R4, R4, #1
+        AND R5, R5, #0
+        ADD R5, R5, #8
+PSP_B   AND R6, R2, R3
+        BRz PSP_N
+        ADD R0, R0, R4
+PSP_N   ADD R3, R3, R3
+        ADD R4, R4, R4
+        ADD R5, R5, #-1
+        BRp PSP_B
+        ADD R0, R0, #0
+        BRz PSP_S
+        TRAP x21
+PSP_S   ADD R1, R1, #1
+        BR PSP_L
+PSP_D   LD R0, SAVE0
+        LD R1, SAVE1
+        LD R2, SAVE2
+        LD R3, SAVE3
+        LD R4, SAVE4
+        LD R5, SAVE5
+        LD R6, SAVE6
+        LD R7, SAVE7
+        RET
+
+; 打印 Halt 后清 MCR 最高位停机
+T_HALT  LEA R0, HALT_S
+        TRAP x22
+        AND R0, R0, #0
+        STI R0, MCR_P
+        BR T_HALT
+
+KBSR_P  .FILL xFE00
+KBDR_P  .FILL xFE02
+DSR_P   .FILL xFE04
+DDR_P   .FILL xFE06
+MCR_P   .FILL xFFFE
+HIGH_BIT .FILL x0100
+SAVE0   .FILL 0
+SAVE1   .FILL 0
+SAVE2   .FILL 0
+SAVE3   .FILL 0
+SAVE4   .FILL 0
+SAVE5   .FILL 0
+SAVE6   .FILL 0
+SAVE7   .FILL 0
+PROMPT  .STRINGZ "Enter a character:"
+HALT_S  .STRINGZ "Halt\n"
+        .END
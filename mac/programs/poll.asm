@@ -0,0 +1,12 @@
+; 轮询 KBSR 直到有输入，回显读到的字符后停机。
+; 循环的第一条指令读设备寄存器，用于验证 -jit/-tier 的轨迹在访存走慢速路径时仍能前进
+        .ORIG x3000
+POLL    LDI R0, KBSR_PTR
+        BRzp POLL
+        LDI R0, KBDR_PTR
+        OUT
+        HALT
+
+KBSR_PTR .FILL xFE00
+KBDR_PTR .FILL xFE02
+        .END
@@ -0,0 +1,89 @@
+; 试除法统计 1000 以内的素数个数，并以十进制打印
+        .ORIG x3000
+        LEA R0, MSG
+        PUTS
+        AND R5, R5, #0      ; R5 = 素数个数
+        AND R4, R4, #0
+        ADD R4, R4, #2      ; R4 = n
+LOOP    LD R1, NEG_LIMIT
+        ADD R1, R4, R1
+        BRzp DONE
+        ADD R1, R4, #0
+        JSR ISPRIME
+        ADD R5, R5, R0
+        ADD R4, R4, #1
+        BR LOOP
+DONE    ADD R1, R5, #0
+        JSR PRINTNUM
+        LD R0, NEWLINE
+        OUT
+        HALT
+
+NEG_LIMIT .FILL #-1000
+NEWLINE   .FILL x0A
+ASCII0    .FILL x30
+MSG       .STRINGZ "primes below 1000: "
+
+; R1 = n (n >= 2)，返回 R0 = 1 表示素数
+ISPRIME ST R7, SAVE_R7
+        ST R1, P_N
+        ST R4, P_R4
+        AND R4, R4, #0
+        ADD R4, R4, #2      ; d = 2
+PLOOP   LD R1, P_N
+        NOT R2, R4
+        ADD R2, R2, #1
+        ADD R2, R1, R2      ; n - d
+        BRz PYES
+        ADD R2, R4, #0
+        JSR DIVMOD          ; R1 = n % d
+        ADD R1, R1, #0
+        BRz PNO
+        ADD R4, R4, #1
+        BR PLOOP
+PYES    AND R0, R0, #0
+        ADD R0, R0, #1
+        BR PRET
+PNO     AND R0, R0, #0
+PRET    LD R4, P_R4
+        LD R7, SAVE_R7
+        RET
+
+SAVE_R7 .FILL 0
+P_N     .FILL 0
+P_R4    .FILL 0
+
+; R1 / R2（R2 > 0）：R3 = 商，R1 = 余数
+DIVMOD  AND R3, R3, #0
+        NOT R2, R2
+        ADD R2, R2, #1      ; R2 = -除数
+DLOOP   ADD R1, R1, R2
+        BRn DEND
+        ADD R3, R3, #1
+        BR DLOOP
+DEND    NOT R2, R2
+        ADD R2, R2, #1      ; 恢复除数
+        ADD R1, R1, R2
+        RET
+
+; 以十进制打印 R1
+PRINTNUM ST R7, N_R7
+        LEA R4, NUMEND
+NLOOP   AND R2, R2, #0
+        ADD R2, R2, #10
+        JSR DIVMOD
+        LD R0, ASCII0
+        ADD R0, R1, R0
+        ADD R4, R4, #-1
+        STR R0, R4, #0
+        ADD R1, R3, #0
+        BRp NLOOP
+        ADD R0, R4, #0
+        PUTS
+        LD R7, N_R7
+        RET
+
+N_R7    .FILL 0
+NUMBUF  .BLKW 6
+NUMEND  .FILL 0
+        .END
@@ -0,0 +1,72 @@
+; 生成 300 个伪随机数，冒泡排序，比较函数经 JSRR 间接调用，最后检查是否有序
+        .ORIG x3000
+        LEA R1, ARRAY
+        LD R2, COUNT
+        LD R3, SEED
+GEN     ADD R4, R3, R3
+        ADD R3, R4, R3      ; x = 3x + 13
+        ADD R3, R3, #13
+        LD R4, MASK
+        AND R3, R3, R4
+        STR R3, R1, #0
+        ADD R1, R1, #1
+        ADD R2, R2, #-1
+        BRp GEN
+
+        LD R5, COUNT
+        ADD R5, R5, #-1     ; R5 = 剩余趟数
+OUTER   BRz CHECK
+        LEA R1, ARRAY
+        ADD R2, R5, #0      ; R2 = 本趟比较次数
+INNER   LDR R3, R1, #0
+        LDR R4, R1, #1
+        LD R6, CMP_PTR
+        JSRR R6             ; R0 = 1 表示 R3 > R4
+        ADD R0, R0, #0
+        BRz NOSWAP
+        STR R4, R1, #0
+        STR R3, R1, #1
+NOSWAP  ADD R1, R1, #1
+        ADD R2, R2, #-1
+        BRp INNER
+        ADD R5, R5, #-1
+        BR OUTER
+
+CHECK   LEA R1, ARRAY
+        LD R2, COUNT
+        ADD R2, R2, #-1
+        AND R5, R5, #0      ; R5 = 逆序对个数
+CLOOP   LDR R3, R1, #0
+        LDR R4, R1, #1
+        LD R6, CMP_PTR
+        JSRR R6
+        ADD R5, R5, R0
+        ADD R1, R1, #1
+        ADD R2, R2, #-1
+        BRp CLOOP
+        LEA R0, OK_MSG
+        ADD R5, R5, #0
+        BRz PRINT
+        LEA R0, BAD_MSG
+PRINT   PUTS
+        HALT
+
+; R3 > R4 时 R0 = 1，否则 R0 = 0
+GREATER NOT R0, R4
+        ADD R0, R0, #1
+        ADD R0, R3, R0
+        BRp GT
+        AND R0, R0, #0
+        RET
+GT      AND R0, R0, #0
+        ADD R0, R0, #1
+        RET
+
+COUNT   .FILL #300
+SEED    .FILL #12345
+MASK    .FILL x7FFF
+CMP_PTR .FILL GREATER
+OK_MSG  .STRINGZ "sorted\n"
+BAD_MSG .STRINGZ "unsorted\n"
+ARRAY   .BLKW #300
+        .END
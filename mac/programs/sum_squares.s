@@ -0,0 +1,20 @@
+# C = 1*1 + 2*2 + ... + 20000*20000（按 int 溢出回绕）
+        SET B 20000
+        SET C 0
+        SET F 0             # F 恒为 0，IF F 0 即无条件跳转
+loop:   IF B 0 done
+        STR C
+        STR B
+        STR B
+        MUL
+        ADD
+        LDR C
+        POP
+        STR B               # B = B - 1
+        PSH 1
+        SUB
+        LDR B
+        POP
+        IF F 0 loop
+done:   LOGR C
+        HLT
@@ -1,5 +1,6 @@
 #include <stdio.h>
-#include <stdbool.h>
+
+#include "vm_debug.h"
 
 // 指令定义
 typedef enum
@@ -18,58 +19,101 @@ const int program[] = {
     POP,
     HLT};
 
-int ip = 0;
-int sp = -1;
-int stack[256];
-
-bool running = true;
+// 机器状态
+typedef struct
+{
+  VmCore core; // 公共内核，必须位于首位
+  int sp;
+  int stack[256];
+} Vm1;
 
-void eval(int instr)
+// instr 为指令所在下标
+void push(VmCore *core, uint32_t instr)
 {
-  switch (instr)
-  {
-  case HLT:
-    running = false;
-    break;
+  Vm1 *vm = (Vm1 *)core;
+  vm->sp++;
+  vm->stack[vm->sp] = program[instr + 1];
+}
 
-  case PSH:
-    sp++;
-    stack[sp] = program[++ip];
-    break;
+void pop(VmCore *core, uint32_t instr)
+{
+  Vm1 *vm = (Vm1 *)core;
+  (void)instr;
+  int popValue = vm->stack[vm->sp--];
+  printf("poped %d\n", popValue);
+}
 
-  case POP:
-  {
-    int popValue = stack[sp--];
-    printf("poped %d\n", popValue);
-  }
+void add(VmCore *core, uint32_t instr)
+{
+  Vm1 *vm = (Vm1 *)core;
+  (void)instr;
 
-  break;
+  // 从栈中取出两个数，相加，再 push 回栈
+  int a = vm->stack[vm->sp--];
+  int b = vm->stack[vm->sp--];
+  int sum = a + b;
+  vm->sp++;
+  vm->stack[vm->sp] = sum;
+}
 
-  case ADD:
-  {
-    // 从栈中取出两个数，相加，再 push 回栈
-    int a = stack[sp--];
-    int b = stack[sp--];
-    int sum = a + b;
-    sp++;
-    stack[sp] = sum;
-  }
+void halt(VmCore *core, uint32_t instr)
+{
+  (void)instr;
+  vm_core_halt(core);
+}
 
-  break;
+uint32_t fetch(VmCore *core, uint32_t pc, int *op, uint32_t *next_pc)
+{
+  (void)core;
+  *op = program[pc];
+  *next_pc = pc + (*op == PSH ? 2 : 1);
+  return pc;
+}
 
-  default:
-    break;
-  }
+void dump(VmCore *core, FILE *out)
+{
+  Vm1 *vm = (Vm1 *)core;
+  fprintf(out, "ip:%u sp:%d\n", core->pc, vm->sp);
 }
 
-int main()
+const char *const op_names[] = {"PSH", "ADD", "POP", "HLT"};
+
+const VmHandler handlers[] = {push, add, pop, halt};
+
+const VmIsa vm1_isa = {
+    .name = "vm_1",
+    .op_count = 4,
+    .op_names = op_names,
+    .handlers = handlers,
+    .fetch = fetch,
+    .dump = dump,
+};
+
+Vm1 vm;
+
+int main(int argc, const char *argv[])
 {
-  while (running)
+  vm_core_init(&vm.core, &vm1_isa, sizeof(program) / sizeof(program[0]));
+
+  for (int i = 1; i < argc; i++)
   {
-    int instr = program[ip];
-    eval(instr);
-    ip++;
+    vm_core_option(&vm.core, argv[i]);
   }
 
+  vm.sp = -1;
+  if (vm.core.debug)
+  {
+    vm_debug_run(&vm.core, stdin, stderr);
+  }
+  else
+  {
+    vm_core_run(&vm.core);
+  }
+
+  vm_core_report(&vm.core, stderr);
+  vm_core_report_stop(&vm.core, stderr);
+
+  vm_core_free(&vm.core);
+
   return 0;
-}
\ No newline at end of file
+}
@@ -1,42 +1,12 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 
-// 指令定义
-typedef enum
-{
-  PSH,  // PSH 5;              ::将数据放入栈中
-  POP,  // POP;                ::栈顶指针-1
-  SET,  // SET reg, 3;         ::给寄存器赋值
-  HLT,  // HLT;                ::停止程序
-  MOV,  // MOV reg1, reg2;     ::将寄存器 reg2 中的值放入 reg1
-  ADD,  // ADD;                ::取出栈中的两个数据相加后，结果放入栈中
-  SUB,  // SUB;                ::取出栈中的两个数据相减后，结果放入栈中
-  DIV,  // DIV;                ::取出栈中的两个数据相除后，结果放入栈中
-  MUL,  // MUL;                ::取出栈中的两个数据相乘后，结果放入栈中
-  STR,  // STR reg;            ::将寄存器的数据放入栈中
-  LDR,  // LDR reg;            ::将栈顶数据放入寄存器
-  IF,   // IF reg, value, ip;  ::如果 reg 的值等于 value，则跳转到新 ip 指向的指令。
-  LOGR, // LOG reg;            ::打印寄存器中的数据
-} InstructionSet;
-
-// 寄存器类型定义
-typedef enum
-{
-  A,
-  B,
-  C,
-  D,
-  E,
-  F,  // A-F 通用寄存器
-  IP, // IP 寄存器
-  SP, // 栈顶指针寄存器
-  NUM_OF_REGISTERS
-} Registers;
-
-// 寄存器
-int registers[NUM_OF_REGISTERS];
-
-// 程序
+#include "vm_2.h"
+#include "vm_debug.h"
+
+// 内置程序，int 数组编码，启动时转换成字节码
 const int program[] = {
 
     IF, B, 0, 6,
@@ -60,21 +30,16 @@ const int program[] = {
     LDR, C,
     HLT};
 
-#define sp (registers[SP])
-#define ip (registers[IP])
-
-int stack[256];
-
-bool is_jump = false;
-bool running = true;
+#define sp (vm->registers[SP])
+#define ip (vm->core.pc)
 
-void printStack()
+void printStack(Vm2 *vm)
 {
   printf("\n\n=========begin print stack:=========\n\n");
 
   for (int i = 0; i <= sp; i++)
   {
-    printf("%d ", stack[i]);
+    printf("%d ", vm->stack[i]);
 
     // 4 个一行
     if ((i + 1) % 4 == 0)
@@ -86,204 +51,479 @@ void printStack()
   printf("\n\n=========print stack done=========\n\n");
 }
 
-void printRegisters()
+void printRegisters(Vm2 *vm)
 {
   printf("\n\n=========begin print registers:=========\n\n");
   for (int i = 0; i < NUM_OF_REGISTERS; i++)
   {
-    printf("%d ", registers[i]);
+    printf("%d ", vm->registers[i]);
   }
 
   printf("\n\n=========print registers done=========\n\n");
 }
 
-void eval(int instr)
+// 以下为各指令的处理函数，instr 为操作数在代码区的偏移
+
+void halt(VmCore *core, uint32_t instr)
 {
-  is_jump = false;
+  (void)instr;
+  vm_core_halt(core);
+}
 
-  switch (instr)
-  {
-  case HLT:
+void push(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
+  const uint8_t *p = vm->image.code + instr;
+
+  vm->stack[++sp] = vm2_read_imm(&vm->image, &p);
+}
+
+void pop(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
+  (void)instr;
+  sp--;
+}
+
+void add(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
+  (void)instr;
+
+  // 从栈中取出两个数，相加，再 push 回栈
+  int a = vm->stack[sp--];
+  int b = vm->stack[sp--];
+
+  int result = a + b;
+
+  vm->stack[++sp] = result;
+
+  vm->registers[A] = result;
+}
+
+void sub(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
+  (void)instr;
+
+  // 从栈中取出两个数，相减，再 push 回栈
+  int a = vm->stack[sp--];
+  int b = vm->stack[sp--];
+
+  int result = b - a;
+
+  // 入栈
+  vm->stack[++sp] = result;
+  vm->registers[A] = result;
+}
+
+void mul(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
+  (void)instr;
+
+  // 从栈中取出两个数，相乘，再 push 回栈
+  int a = vm->stack[sp--];
+  int b = vm->stack[sp--];
+
+  int result = a * b;
+
+  // 入栈
+  vm->stack[++sp] = result;
+  vm->registers[A] = result;
+}
+
+void divide(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
+  (void)instr;
+
+  // 从栈中取出两个数，相除，再 push 回栈
+  int a = vm->stack[sp--];
+  int b = vm->stack[sp--];
+
+  if (a != 0)
   {
-    running = false;
-    break;
-  }
+    int result = b / a;
 
-  case PSH:
+    // 入栈
+    vm->stack[++sp] = result;
+    vm->registers[A] = result;
+  }
+  else
   {
-    stack[++sp] = program[++ip];
-    break;
+    printf("exception occur, divid 0 \n");
   }
+}
+
+void mov(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
+  const uint8_t *p = vm->image.code + instr;
+
+  // 将一个寄存器的值放到另一个寄存器中
+  // 目的寄存器
+  int dr = *p++;
+
+  // 源寄存器
+  int sr = *p++;
 
-  case POP:
+  // 源寄存器的值
+  int sourceValue = vm->registers[sr];
+  vm->registers[dr] = sourceValue;
+}
+
+void str(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
+
+  // 将指定寄存器中的参数，放入栈中
+  int r = vm->image.code[instr];
+  vm->stack[++sp] = vm->registers[r];
+}
+
+void ldr(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
+
+  int value = vm->stack[sp];
+  int r = vm->image.code[instr];
+  vm->registers[r] = value;
+}
+
+void jump_if(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
+  const uint8_t *p = vm->image.code + instr;
+
+  // 如果寄存器的值和后面的数值相等，则跳转
+  int r = *p++;
+  int value = vm2_read_imm(&vm->image, &p);
+  uint32_t target = vm2_read_uleb(&p);
+
+  if (vm->registers[r] == value)
   {
-    sp--;
-    break;
+    ip = target;
+    printf("jump if:%d\n", vm2_source_ip(vm, ip));
   }
+}
 
-  case ADD:
-  {
-    // 从栈中取出两个数，相加，再 push 回栈
-    int a = stack[sp--];
-    int b = stack[sp--];
+void set(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
+  const uint8_t *p = vm->image.code + instr;
 
-    int result = a + b;
+  // set register value
+  int r = *p++;
+  int value = vm2_read_imm(&vm->image, &p);
 
-    stack[++sp] = result;
+  vm->registers[r] = value;
+}
 
-    registers[A] = result;
+void logr(VmCore *core, uint32_t instr)
+{
+  Vm2 *vm = (Vm2 *)core;
 
-    break;
-  }
+  int r = vm->image.code[instr];
+  int value = vm->registers[r];
+  printf("log register_%d %d\n", r, value);
+}
+
+// 操作数紧跟在操作码之后
+uint32_t fetch(VmCore *core, uint32_t pc, int *op, uint32_t *next_pc)
+{
+  Vm2 *vm = (Vm2 *)core;
+
+  *op = vm->image.code[pc];
+  *next_pc = pc + vm2_insn_size(vm->image.code + pc);
+  return pc + 1;
+}
+
+void dump(VmCore *core, FILE *out)
+{
+  Vm2 *vm = (Vm2 *)core;
+  (void)out;
+  vm->registers[IP] = vm2_source_ip(vm, ip);
 
-  case SUB:
+  printStack(vm);
+
+  printRegisters(vm);
+}
+
+// 调试器中的内存即栈
+uint32_t peek(VmCore *core, uint32_t address)
+{
+  Vm2 *vm = (Vm2 *)core;
+  return address < sizeof(vm->stack) / sizeof(vm->stack[0]) ? (uint32_t)vm->stack[address] : 0;
+}
+
+const VmHandler handlers[NUM_OF_INSTRUCTIONS] = {
+    [PSH] = push,
+    [POP] = pop,
+    [SET] = set,
+    [HLT] = halt,
+    [MOV] = mov,
+    [ADD] = add,
+    [SUB] = sub,
+    [DIV] = divide,
+    [MUL] = mul,
+    [STR] = str,
+    [LDR] = ldr,
+    [IF] = jump_if,
+    [LOGR] = logr,
+};
+
+const VmIsa vm2_isa = {
+    .name = "vm_2",
+    .op_count = NUM_OF_INSTRUCTIONS,
+    .op_names = vm2_names,
+    .handlers = handlers,
+    .fetch = fetch,
+    .dump = dump,
+    .peek = peek,
+};
+
+Vm2 machine;
+
+// 将 int 数组形式的程序转换成字节码
+int load_int_program(Vm2Image *image, const int *program, size_t count)
+{
+  Vm2Insn *insns;
+  size_t insn_count;
+
+  if (!vm2_parse_int_program(program, count, &insns, &insn_count))
   {
-    // 从栈中取出两个数，相减，再 push 回栈
-    int a = stack[sp--];
-    int b = stack[sp--];
+    return 0;
+  }
 
-    int result = b - a;
+  size_t size;
+  uint8_t *data = vm2_encode(insns, insn_count, 0, &size);
+  free(insns);
 
-    // 入栈
-    stack[++sp] = result;
-    registers[A] = result;
+  return vm2_open_image(image, data, size, 0);
+}
+
+// 将内置程序转换成字节码
+int load_builtin(Vm2Image *image)
+{
+  return load_int_program(image, program, sizeof(program) / sizeof(program[0]));
+}
 
-    break;
+// 将文本形式的源文件转换成字节码
+int load_source(Vm2Image *image, const char *path)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+  {
+    return 0;
   }
 
-  case MUL:
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+
+  char *text = size < 0 ? NULL : malloc(size + 1);
+  if (!text)
   {
-    // 从栈中取出两个数，相乘，再 push 回栈
-    int a = stack[sp--];
-    int b = stack[sp--];
+    fclose(file);
+    return 0;
+  }
 
-    int result = a * b;
+  text[fread(text, 1, size, file)] = '\0';
+  fclose(file);
 
-    // 入栈
-    stack[++sp] = result;
-    registers[A] = result;
+  int *source;
+  size_t count;
+  int ok = vm2_parse_text_program(text, &source, &count);
+  free(text);
 
-    break;
+  if (ok)
+  {
+    ok = load_int_program(image, source, count);
+    free(source);
   }
 
-  case DIV:
+  return ok;
+}
+
+// 载入时优化，用优化后的字节码替换当前镜像，并记下新偏移对应的原偏移。失败时返回 0
+int optimize_image(Vm2 *vm)
+{
+  Vm2Image *image = &vm->image;
+  Vm2Insn *insns;
+  uint32_t *offsets;
+  int *origin;
+  size_t count, entry;
+
+  if (!vm2_decode(image, &insns, &count, &entry, &offsets))
   {
-    // 从栈中取出两个数，相除，再 push 回栈
-    int a = stack[sp--];
-    int b = stack[sp--];
+    return 0;
+  }
 
-    if (a != 0)
-    {
-      int result = b / a;
+  size_t before = count;
+  size_t removed = vm2_optimize(&insns, &count, &entry, &origin);
 
-      // 入栈
-      stack[++sp] = result;
-      registers[A] = result;
-    }
-    else
+  printf("optimizer removed %zu of %zu instructions\n", removed, before);
+
+  int ok = 1;
+  if (removed > 0)
+  {
+    size_t size;
+    uint8_t *data = vm2_encode(insns, count, entry, &size);
+
+    vm2_close_image(image);
+    ok = vm2_open_image(image, data, size, 0);
+
+    // 执行完 HLT 后 IP 为代码区末尾
+    if (ok)
     {
-      printf("exception occur, divid 0 \n");
+      vm->source_ip = malloc(sizeof(uint32_t) * (image->code_size + 1));
+
+      uint32_t offset = 0;
+      for (size_t i = 0; i < count; i++)
+      {
+        vm->source_ip[offset] = offsets[origin[i]];
+        offset += vm2_insn_size(image->code + offset);
+      }
+
+      vm->source_ip[offset] = offsets[before];
     }
 
-    break;
+    free(origin);
   }
 
-  case MOV:
-  {
-    // 将一个寄存器的值放到另一个寄存器中
-    // 目的寄存器
-    int dr = program[++ip];
+  free(insns);
+  free(offsets);
+  return ok;
+}
 
-    // 源寄存器
-    int sr = program[++ip];
+// 以寄存器式翻译执行。执行到 HLT 或预算用完返回 true；返回 false 时由栈式解释器从 ip 处继续
+bool run_translated(Vm2 *vm)
+{
+  Vm2Insn *insns;
+  size_t count, entry;
+  uint32_t *offsets;
+  Vm2RProgram rprogram;
 
-    // 源寄存器的值
-    int sourceValue = registers[sr];
-    registers[dr] = sourceValue;
+  vm_perf_begin(&vm->core.perf, "translate");
 
-    break;
-  }
+  vm2_decode(&vm->image, &insns, &count, &entry, &offsets);
 
-  case STR:
-  {
-    // 将指定寄存器中的参数，放入栈中
-    int r = program[++ip];
-    stack[++sp] = registers[r];
-    break;
-  }
+  int ok = vm2r_translate(insns, count, entry, offsets, &rprogram);
+  free(insns);
+  free(offsets);
+
+  vm_perf_end(&vm->core.perf, 0);
 
-  case LDR:
+  if (!ok)
   {
-    int value = stack[sp];
-    int r = program[++ip];
-    registers[r] = value;
-    break;
+    printf("program not translatable, fall back to stack interpreter\n");
+    return false;
   }
 
-  case IF:
+  printf("translated %zu stack instructions to %zu register instructions\n", count, rprogram.count);
+
+  bool halted = vm2r_run(vm, &rprogram);
+  vm2r_free(&rprogram);
+
+  vm_core_report(&vm->core, stderr);
+
+  return halted || vm->core.stop != VM_STOP_HALT;
+}
+
+// vm_2 [-O] [-r] [core options] [file]   执行字节码文件，不指定时执行内置程序
+//                                       -O 载入时优化，-r 翻译成寄存器式指令后执行
+// vm_2 -c file [source]                 将文本源文件转换成字节码文件，不指定时转换内置程序
+int main(int argc, const char *argv[])
+{
+  Vm2 *vm = &machine;
+
+  if (argc >= 3 && strcmp(argv[1], "-c") == 0)
   {
-    // 如果寄存器的值和后面的数值相等，则跳转
-    int r = program[++ip];
-    if (registers[r] == program[++ip])
+    int ok = argc >= 4 ? load_source(&vm->image, argv[3]) : load_builtin(&vm->image);
+    if (!ok || !vm2_write_file(argv[2], vm->image.data, vm->image.size))
     {
-      ip = program[++ip];
-
-      is_jump = true;
-      printf("jump if:%d\n", ip);
+      printf("failed to write %s\n", argv[2]);
+      exit(1);
     }
-    else
+
+    if (argc < 4)
     {
-      ip += 1;
+      printf("int encoding: %zu bytes, bytecode: %zu bytes\n", sizeof(program), vm->image.size);
     }
-    break;
+    vm2_close_image(&vm->image);
+    return 0;
   }
 
-  case SET:
-  {
-    // set register value
-    int r = program[++ip];
-    int value = program[++ip];
+  const char *path = NULL;
+  bool optimize = false;
+  bool translate = false;
 
-    registers[r] = value;
-    break;
-  }
+  vm_core_init(&vm->core, &vm2_isa, 0);
 
-  case LOGR:
+  for (int i = 1; i < argc; i++)
   {
-    int r = program[++ip];
-    int value = registers[r];
-    printf("log register_%d %d\n", r, value);
-    break;
+    if (strcmp(argv[i], "-O") == 0)
+    {
+      optimize = true;
+    }
+    else if (strcmp(argv[i], "-r") == 0)
+    {
+      translate = true;
+    }
+    else if (!vm_core_option(&vm->core, argv[i]))
+    {
+      path = argv[i];
+    }
   }
 
-  default:
+  vm_perf_begin(&vm->core.perf, "load");
+  int ok = path ? vm2_map_image(&vm->image, path) : load_builtin(&vm->image);
+  vm_perf_end(&vm->core.perf, 0);
+
+  if (!ok)
   {
-    printf("Unknown Instruction %d!\n", instr);
-    break;
+    printf("failed to load program\n");
+    exit(1);
   }
+
+  if (optimize)
+  {
+    vm_perf_begin(&vm->core.perf, "optimize");
+    ok = optimize_image(vm);
+    vm_perf_end(&vm->core.perf, 0);
+
+    if (!ok)
+    {
+      printf("failed to optimize program\n");
+      exit(1);
+    }
   }
-}
 
-int main()
-{
   //  初始化寄存器
   sp = -1;
-  ip = 0;
+  ip = vm->image.entry;
+
+  vm_core_set_isa(&vm->core, &vm2_isa, vm->image.code_size);
 
-  while (running)
+  // 调试时只用栈式解释器，断点地址即字节码偏移
+  if (vm->core.debug)
   {
-    int instr = program[ip];
-    eval(instr);
+    vm_debug_run(&vm->core, stdin, stderr);
+  }
+  else if (!translate || !run_translated(vm))
+  {
+    vm_core_run(&vm->core);
 
-    if (!is_jump)
-    {
-      ip++;
-    }
+    vm_core_report(&vm->core, stderr);
   }
 
-  printStack();
+  vm_core_report_stop(&vm->core, stderr);
+  vm_core_dump(&vm->core, stdout);
 
-  printRegisters();
+  vm_core_free(&vm->core);
+  vm2_close_image(&vm->image);
+  free(vm->source_ip);
 
   return 0;
 }
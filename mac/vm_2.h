@@ -0,0 +1,259 @@
+#ifndef VM_2_H
+#define VM_2_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vm_core.h"
+
+// 指令定义
+typedef enum
+{
+  PSH,  // PSH 5;              ::将数据放入栈中
+  POP,  // POP;                ::栈顶指针-1
+  SET,  // SET reg, 3;         ::给寄存器赋值
+  HLT,  // HLT;                ::停止程序
+  MOV,  // MOV reg1, reg2;     ::将寄存器 reg2 中的值放入 reg1
+  ADD,  // ADD;                ::取出栈中的两个数据相加后，结果放入栈中
+  SUB,  // SUB;                ::取出栈中的两个数据相减后，结果放入栈中
+  DIV,  // DIV;                ::取出栈中的两个数据相除后，结果放入栈中
+  MUL,  // MUL;                ::取出栈中的两个数据相乘后，结果放入栈中
+  STR,  // STR reg;            ::将寄存器的数据放入栈中
+  LDR,  // LDR reg;            ::将栈顶数据放入寄存器
+  IF,   // IF reg, value, ip;  ::如果 reg 的值等于 value，则跳转到新 ip 指向的指令。
+  LOGR, // LOG reg;            ::打印寄存器中的数据
+  NUM_OF_INSTRUCTIONS
+} InstructionSet;
+
+// 寄存器类型定义
+typedef enum
+{
+  A,
+  B,
+  C,
+  D,
+  E,
+  F,  // A-F 通用寄存器
+  IP, // IP 寄存器
+  SP, // 栈顶指针寄存器
+  NUM_OF_REGISTERS
+} Registers;
+
+// 操作数类型，每条指令的操作数由 vm2_operands[op] 描述，如 "rit"
+// r: 寄存器，1 字节
+// i: 立即数，变长编码，可引用常量池
+// t: 跳转目标，变长编码的代码区字节偏移
+extern const char *const vm2_operands[NUM_OF_INSTRUCTIONS];
+
+// 指令名称
+extern const char *const vm2_names[NUM_OF_INSTRUCTIONS];
+
+// 解码后的指令，操作数统一用 int 表示。IF 的跳转目标为指令序号
+typedef struct
+{
+  int op;
+  int args[3];
+} Vm2Insn;
+
+// 字节码文件格式（小端）：
+//
+//   偏移  大小  内容
+//   0     4     magic "VM2B"
+//   4     2     版本号
+//   6     2     保留，为 0
+//   8     4     入口，代码区内的字节偏移
+//   12    4     常量池个数 n
+//   16    4     代码区字节数
+//   20    4*n   常量池，int32
+//   ...         代码区，1 字节操作码 + 操作数
+//
+// 立即数按无符号 LEB128 存放：最低位为 0 时其余位是 zigzag 编码的数值，
+// 最低位为 1 时其余位是常量池下标。小数值 1~2 字节即可放下，大数值放入常量池。
+#define VM2_MAGIC "VM2B"
+#define VM2_VERSION 1
+#define VM2_HEADER_SIZE 20
+
+// 载入的字节码镜像，可以直接在 mmap 的文件上执行
+typedef struct
+{
+  const uint8_t *data;   // 整个文件
+  size_t size;
+  const uint8_t *consts; // 常量池
+  uint32_t const_count;
+  const uint8_t *code;   // 代码区
+  uint32_t code_size;
+  uint32_t entry;
+  int mapped;            // 1 表示 data 来自 mmap，0 表示来自 malloc
+} Vm2Image;
+
+// 将原先 int 数组形式的程序解码成指令序列，失败返回 0
+int vm2_parse_int_program(const int *program, size_t count, Vm2Insn **insns, size_t *insn_count);
+
+// 将文本形式的程序转换成 int 数组：助记符、寄存器名、整数，
+// "name:" 定义标号，IF 的目标可以写标号，# 之后为注释。返回 malloc 的数组
+int vm2_parse_text_program(const char *text, int **program, size_t *count);
+
+// 将指令序列编码成字节码文件内容，entry 为入口指令序号。返回 malloc 的缓冲区
+uint8_t *vm2_encode(const Vm2Insn *insns, size_t insn_count, size_t entry, size_t *size);
+
+// 校验并打开内存中的字节码，接管 data 的所有权（mapped 决定释放方式）
+int vm2_open_image(Vm2Image *image, const uint8_t *data, size_t size, int mapped);
+
+// mmap 字节码文件并校验
+int vm2_map_image(Vm2Image *image, const char *path);
+
+void vm2_close_image(Vm2Image *image);
+
+int vm2_write_file(const char *path, const uint8_t *data, size_t size);
+
+// 将已校验的字节码解码成指令序列，IF 的目标改写为指令序号。
+// offsets 可为 NULL，否则返回每条指令的字节偏移（多一项为代码区大小）
+int vm2_decode(const Vm2Image *image, Vm2Insn **insns, size_t *insn_count, size_t *entry, uint32_t **offsets);
+
+// ================= 载入时优化 =================
+
+// 常量折叠与窥孔优化，在基本块内进行：
+// 常量运算在载入时算出，PSH/POP 成对消除，SET/MOV 链合并为 SET，
+// 不会被读取的 registers[A] 写入被删除，IF 的目标随之改写。
+// 结果替换 *insns，返回删除的指令条数，程序不支持优化时返回 0 且不做改动。
+// origin 可为 NULL，否则返回每条新指令对应的原指令序号（块入口对应块的第一条原指令）
+size_t vm2_optimize(Vm2Insn **insns, size_t *insn_count, size_t *entry, int **origin);
+
+// ================= 寄存器式翻译 =================
+
+// 三地址指令，操作数都是 cells 下标：
+// [0, NUM_OF_REGISTERS) 为机器寄存器，之后是临时寄存器，再之后是常量
+typedef enum
+{
+  R_MOV,   // cells[d] = cells[a]
+  R_ADD,   // cells[d] = cells[a] + cells[b]
+  R_SUB,   // cells[d] = cells[a] - cells[b]
+  R_MUL,   // cells[d] = cells[a] * cells[b]
+  R_DIV,   // cells[d] = cells[a] / cells[b]，b 为非 0 常量
+  R_DIVZ,  // 同 R_DIV，cells[b] 为 0 时跳到 target 处的补偿代码
+  R_LDS,   // cells[d] = stack[sp + a]
+  R_STS,   // stack[sp + d] = cells[a]
+  R_PUSH,  // stack[++sp] = cells[a]
+  R_SPADJ, // sp += a
+  R_IF,    // cells[a] == cells[b] 时跳转到 target
+  R_LOG,   // 打印寄存器 d，值取 cells[a]
+  R_DIV0,  // 打印除 0 异常
+  R_EXIT,  // 退回栈式解释器，从字节偏移 ip 处继续
+  R_HLT,   // 停止
+  NUM_OF_R_OPS
+} Vm2ROp;
+
+typedef struct
+{
+  uint8_t op;
+  int d, a, b;
+  int target; // 跳转目标，翻译后指令序号
+  int ip;     // 对应的原字节码偏移，用于还原 IP 和打印跳转信息
+} Vm2RInsn;
+
+typedef struct
+{
+  Vm2RInsn *code;
+  size_t count;
+  size_t entry;
+  int *cells;        // 初始 cells，常量已填好
+  size_t cell_count;
+} Vm2RProgram;
+
+// 操作数栈的容量，载入时校验栈深度不超过它
+#define VM2_STACK_SIZE 256
+
+// 机器状态
+typedef struct
+{
+  VmCore core; // 公共内核，必须位于首位，core.pc 即 IP
+  int registers[NUM_OF_REGISTERS];
+  int stack[VM2_STACK_SIZE];
+  Vm2Image image;
+
+  // -O 替换镜像后，按新字节码的偏移查原字节码的偏移，NULL 表示未优化
+  uint32_t *source_ip;
+
+  // 寄存器式执行时的程序和 cells
+  const Vm2RProgram *rprogram;
+  int *cells;
+  int halted;
+} Vm2;
+
+extern const VmIsa vm2_isa;
+
+// 架构上的 IP：打印和转储时把执行的字节码的偏移换算成原字节码的偏移
+static inline int vm2_source_ip(const Vm2 *vm, uint32_t offset)
+{
+  return vm->source_ip ? (int)vm->source_ip[offset] : (int)offset;
+}
+extern const VmIsa vm2r_isa;
+
+// 将栈式指令序列翻译成寄存器式指令，不支持的程序返回 0
+int vm2r_translate(const Vm2Insn *insns, size_t insn_count, size_t entry, const uint32_t *offsets, Vm2RProgram *out);
+
+// 在 vm 上执行寄存器式程序。
+// 执行到 HLT 返回 1；遇到无法继续的情况返回 0，此时 core.pc 为栈式解释器的续执行位置
+int vm2r_run(Vm2 *vm, const Vm2RProgram *program);
+
+void vm2r_free(Vm2RProgram *program);
+
+static inline uint32_t vm2_read_u32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// 读取无符号 LEB128，p 前移。载入时已校验过，这里不做越界检查
+static inline uint32_t vm2_read_uleb(const uint8_t **p)
+{
+  uint32_t value = 0;
+  int shift = 0;
+  uint8_t byte;
+
+  do
+  {
+    byte = *(*p)++;
+    value |= (uint32_t)(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+
+  return value;
+}
+
+// 读取立即数
+static inline int vm2_read_imm(const Vm2Image *image, const uint8_t **p)
+{
+  uint32_t v = vm2_read_uleb(p);
+
+  if (v & 1)
+  {
+    return (int)vm2_read_u32(image->consts + 4 * (v >> 1));
+  }
+
+  // zigzag 解码
+  v >>= 1;
+  return (int)((v >> 1) ^ -(v & 1));
+}
+
+// p 处指令的字节数
+static inline uint32_t vm2_insn_size(const uint8_t *p)
+{
+  const uint8_t *start = p;
+  const char *kinds = vm2_operands[*p++];
+
+  for (; *kinds; kinds++)
+  {
+    if (*kinds == 'r')
+    {
+      p++;
+    }
+    else
+    {
+      vm2_read_uleb(&p);
+    }
+  }
+
+  return (uint32_t)(p - start);
+}
+
+#endif
@@ -0,0 +1,872 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vm_2.h"
+
+const char *const vm2_operands[NUM_OF_INSTRUCTIONS] = {
+    [PSH] = "i",
+    [POP] = "",
+    [SET] = "ri",
+    [HLT] = "",
+    [MOV] = "rr",
+    [ADD] = "",
+    [SUB] = "",
+    [DIV] = "",
+    [MUL] = "",
+    [STR] = "r",
+    [LDR] = "r",
+    [IF] = "rit",
+    [LOGR] = "r",
+};
+
+const char *const vm2_names[NUM_OF_INSTRUCTIONS] = {
+    "PSH", "POP", "SET", "HLT", "MOV", "ADD", "SUB", "DIV", "MUL", "STR", "LDR", "IF", "LOGR"};
+
+// 超过 2 字节的立即数放入常量池
+#define VM2_INLINE_LIMIT (1 << 12)
+
+// ================= int 数组 -> 指令序列 =================
+
+int vm2_parse_int_program(const int *program, size_t count, Vm2Insn **insns, size_t *insn_count)
+{
+  Vm2Insn *list = malloc(sizeof(Vm2Insn) * (count + 1));
+
+  // int 下标 -> 指令序号，用于改写 IF 的跳转目标
+  int *index_of = malloc(sizeof(int) * (count + 1));
+  size_t n = 0;
+  size_t ip = 0;
+
+  for (size_t i = 0; i <= count; i++)
+  {
+    index_of[i] = -1;
+  }
+
+  while (ip < count)
+  {
+    int op = program[ip];
+
+    if (op < 0 || op >= NUM_OF_INSTRUCTIONS)
+    {
+      printf("convert: unknown instruction %d at %zu\n", op, ip);
+      goto fail;
+    }
+
+    const char *kinds = vm2_operands[op];
+    size_t argc = strlen(kinds);
+
+    if (ip + argc >= count)
+    {
+      printf("convert: truncated instruction at %zu\n", ip);
+      goto fail;
+    }
+
+    index_of[ip] = (int)n;
+
+    Vm2Insn *insn = &list[n++];
+    insn->op = op;
+
+    for (size_t k = 0; k < argc; k++)
+    {
+      insn->args[k] = program[ip + 1 + k];
+
+      if (kinds[k] == 'r' && (insn->args[k] < 0 || insn->args[k] >= NUM_OF_REGISTERS))
+      {
+        printf("convert: bad register %d at %zu\n", insn->args[k], ip);
+        goto fail;
+      }
+    }
+
+    ip += 1 + argc;
+  }
+
+  // IF 的目标必须是某条指令的起始位置
+  for (size_t i = 0; i < n; i++)
+  {
+    if (list[i].op != IF)
+    {
+      continue;
+    }
+
+    int target = list[i].args[2];
+    if (target < 0 || (size_t)target >= count || index_of[target] < 0)
+    {
+      printf("convert: IF target %d is not an instruction\n", target);
+      goto fail;
+    }
+
+    list[i].args[2] = index_of[target];
+  }
+
+  free(index_of);
+  *insns = list;
+  *insn_count = n;
+  return 1;
+
+fail:
+  free(index_of);
+  free(list);
+  return 0;
+}
+
+// ================= 文本 -> int 数组 =================
+
+#define VM2_MAX_LABEL 32
+
+typedef struct
+{
+  char name[VM2_MAX_LABEL];
+  size_t at; // 标号定义处为 int 下标，引用处为待回填的下标
+} Label;
+
+static int lookup_name(const char *const *names, int count, const char *token)
+{
+  for (int i = 0; i < count; i++)
+  {
+    if (strcmp(names[i], token) == 0)
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+int vm2_parse_text_program(const char *text, int **program, size_t *count)
+{
+  static const char *const register_names[NUM_OF_REGISTERS] = {"A", "B", "C", "D", "E", "F", "IP", "SP"};
+
+  // 每个 token 至少占 2 个字符，按文本长度分配足够
+  size_t capacity = strlen(text) / 2 + 1;
+  int *list = malloc(sizeof(int) * capacity);
+  Label *labels = malloc(sizeof(Label) * capacity);
+  Label *refs = malloc(sizeof(Label) * capacity);
+  size_t n = 0, label_count = 0, ref_count = 0;
+  int line = 1;
+  const char *p = text;
+
+  while (*p)
+  {
+    if (*p == '#')
+    {
+      while (*p && *p != '\n')
+      {
+        p++;
+      }
+      continue;
+    }
+
+    if (*p == '\n')
+    {
+      line++;
+    }
+
+    if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == ',')
+    {
+      p++;
+      continue;
+    }
+
+    char token[VM2_MAX_LABEL];
+    size_t len = 0;
+
+    while (*p && !strchr(" \t\r\n,#", *p))
+    {
+      if (len + 1 >= sizeof(token))
+      {
+        printf("convert: token too long at line %d\n", line);
+        goto fail;
+      }
+
+      token[len++] = *p++;
+    }
+
+    token[len] = '\0';
+
+    // 标号定义
+    if (token[len - 1] == ':')
+    {
+      token[len - 1] = '\0';
+      strcpy(labels[label_count].name, token);
+      labels[label_count++].at = n;
+      continue;
+    }
+
+    char *end;
+    long value = strtol(token, &end, 0);
+    int index;
+
+    if (*end == '\0')
+    {
+      list[n++] = (int)value;
+    }
+    else if ((index = lookup_name(vm2_names, NUM_OF_INSTRUCTIONS, token)) >= 0)
+    {
+      list[n++] = index;
+    }
+    else if ((index = lookup_name(register_names, NUM_OF_REGISTERS, token)) >= 0)
+    {
+      list[n++] = index;
+    }
+    else
+    {
+      // 标号引用，读完后回填
+      strcpy(refs[ref_count].name, token);
+      refs[ref_count++].at = n;
+      list[n++] = -1;
+    }
+  }
+
+  for (size_t i = 0; i < ref_count; i++)
+  {
+    size_t k = 0;
+    while (k < label_count && strcmp(labels[k].name, refs[i].name) != 0)
+    {
+      k++;
+    }
+
+    if (k == label_count)
+    {
+      printf("convert: unknown name %s\n", refs[i].name);
+      goto fail;
+    }
+
+    list[refs[i].at] = (int)labels[k].at;
+  }
+
+  free(labels);
+  free(refs);
+  *program = list;
+  *count = n;
+  return 1;
+
+fail:
+  free(labels);
+  free(refs);
+  free(list);
+  return 0;
+}
+
+// ================= 编码 =================
+
+static size_t uleb_size(uint32_t v)
+{
+  size_t size = 1;
+  while (v >= 0x80)
+  {
+    v >>= 7;
+    size++;
+  }
+
+  return size;
+}
+
+static uint8_t *put_uleb(uint8_t *p, uint32_t v)
+{
+  while (v >= 0x80)
+  {
+    *p++ = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+
+  *p++ = (uint8_t)v;
+  return p;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+// 常量池，去重
+typedef struct
+{
+  int *values;
+  uint32_t count;
+} ConstPool;
+
+static uint32_t pool_index(ConstPool *pool, int value)
+{
+  for (uint32_t i = 0; i < pool->count; i++)
+  {
+    if (pool->values[i] == value)
+    {
+      return i;
+    }
+  }
+
+  pool->values[pool->count] = value;
+  return pool->count++;
+}
+
+// 立即数的编码值
+static uint32_t imm_code(ConstPool *pool, int value)
+{
+  if (value > -VM2_INLINE_LIMIT && value < VM2_INLINE_LIMIT)
+  {
+    uint32_t zz = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    return zz << 1;
+  }
+
+  return pool_index(pool, value) << 1 | 1;
+}
+
+// 指令长度，跳转目标按 offsets 中的当前估计计算
+static size_t insn_size(const Vm2Insn *insn, ConstPool *pool, const uint32_t *offsets)
+{
+  const char *kinds = vm2_operands[insn->op];
+  size_t size = 1;
+
+  for (int k = 0; kinds[k]; k++)
+  {
+    switch (kinds[k])
+    {
+    case 'r':
+      size += 1;
+      break;
+
+    case 'i':
+      size += uleb_size(imm_code(pool, insn->args[k]));
+      break;
+
+    case 't':
+      size += uleb_size(offsets[insn->args[k]]);
+      break;
+    }
+  }
+
+  return size;
+}
+
+uint8_t *vm2_encode(const Vm2Insn *insns, size_t insn_count, size_t entry, size_t *size)
+{
+  ConstPool pool = {malloc(sizeof(int) * (insn_count + 1)), 0};
+
+  // 每条指令的字节偏移，offsets[insn_count] 为代码区大小
+  uint32_t *offsets = calloc(insn_count + 1, sizeof(uint32_t));
+
+  // 跳转目标是变长的，反复计算布局直到偏移不再变化
+  int changed = 1;
+  while (changed)
+  {
+    changed = 0;
+    uint32_t offset = 0;
+
+    for (size_t i = 0; i < insn_count; i++)
+    {
+      if (offsets[i] != offset)
+      {
+        offsets[i] = offset;
+        changed = 1;
+      }
+
+      offset += insn_size(&insns[i], &pool, offsets);
+    }
+
+    if (offsets[insn_count] != offset)
+    {
+      offsets[insn_count] = offset;
+      changed = 1;
+    }
+  }
+
+  uint32_t code_size = offsets[insn_count];
+  size_t total = VM2_HEADER_SIZE + 4 * pool.count + code_size;
+  uint8_t *data = malloc(total);
+
+  memcpy(data, VM2_MAGIC, 4);
+  data[4] = VM2_VERSION;
+  data[5] = 0;
+  data[6] = 0;
+  data[7] = 0;
+  put_u32(data + 8, entry < insn_count ? offsets[entry] : 0);
+  put_u32(data + 12, pool.count);
+  put_u32(data + 16, code_size);
+
+  for (uint32_t i = 0; i < pool.count; i++)
+  {
+    put_u32(data + VM2_HEADER_SIZE + 4 * i, (uint32_t)pool.values[i]);
+  }
+
+  uint8_t *p = data + VM2_HEADER_SIZE + 4 * pool.count;
+
+  for (size_t i = 0; i < insn_count; i++)
+  {
+    const Vm2Insn *insn = &insns[i];
+    const char *kinds = vm2_operands[insn->op];
+
+    *p++ = (uint8_t)insn->op;
+
+    for (int k = 0; kinds[k]; k++)
+    {
+      switch (kinds[k])
+      {
+      case 'r':
+        *p++ = (uint8_t)insn->args[k];
+        break;
+
+      case 'i':
+        p = put_uleb(p, imm_code(&pool, insn->args[k]));
+        break;
+
+      case 't':
+        p = put_uleb(p, offsets[insn->args[k]]);
+        break;
+      }
+    }
+  }
+
+  free(offsets);
+  free(pool.values);
+
+  *size = total;
+  return data;
+}
+
+// ================= 载入与校验 =================
+
+// 带边界检查的 LEB128 读取，仅用于校验
+static int checked_uleb(const uint8_t **p, const uint8_t *end, uint32_t *value)
+{
+  uint32_t v = 0;
+
+  for (int shift = 0; shift < 35; shift += 7)
+  {
+    if (*p >= end)
+    {
+      return 0;
+    }
+
+    uint8_t byte = *(*p)++;
+    v |= (uint32_t)(byte & 0x7f) << shift;
+
+    if (!(byte & 0x80))
+    {
+      *value = v;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+// verify_code 对每个指令起始位置的标记
+#define INSN_START 1          // 指令起始位置
+#define INSN_TARGET 2         // 跳转目标或入口，可能从其他位置到达
+#define INSN_NONZERO_BEFORE 4 // 前一条指令压入非 0 常量
+#define INSN_VISITED 8        // 已算出栈深度
+#define INSN_QUEUED 16        // 在工作表中
+
+// 从入口出发沿顺序执行和 IF 跳转计算每条指令执行前栈深度的区间 [lo, hi]。
+// DIV 的除数为 0 时只弹出不压入，除数不是紧邻的非 0 常量时区间变宽；
+// 汇合处取并集（如内置程序跳过两条 PSH）。每次压栈的循环会使区间一直变宽直到溢出。
+// 可能栈不足、超过 VM2_STACK_SIZE 或写入 SP 时返回 0
+static int verify_stack(const Vm2Image *image, uint8_t *starts)
+{
+  int *lo = malloc(sizeof(int) * image->code_size);
+  int *hi = malloc(sizeof(int) * image->code_size);
+  uint32_t *work = malloc(sizeof(uint32_t) * image->code_size);
+  size_t work_count = 0;
+  int ok = 0;
+
+  lo[image->entry] = hi[image->entry] = 0;
+  starts[image->entry] |= INSN_VISITED | INSN_QUEUED;
+  work[work_count++] = image->entry;
+
+  while (work_count)
+  {
+    uint32_t pc = work[--work_count];
+    starts[pc] &= ~INSN_QUEUED;
+
+    const uint8_t *p = image->code + pc;
+    int op = *p;
+    int need = 0, low = lo[pc], high = hi[pc];
+
+    switch (op)
+    {
+    case PSH:
+    case STR:
+      high++;
+      low++;
+      break;
+
+    case POP:
+      need = 1;
+      low--;
+      high--;
+      break;
+
+    case ADD:
+    case SUB:
+    case MUL:
+      need = 2;
+      low--;
+      high--;
+      break;
+
+    case DIV:
+      need = 2;
+      high--;
+      low -= (starts[pc] & (INSN_NONZERO_BEFORE | INSN_TARGET)) == INSN_NONZERO_BEFORE ? 1 : 2;
+      break;
+
+    case LDR:
+      need = 1;
+      break;
+    }
+
+    if (lo[pc] < need)
+    {
+      printf("bytecode: stack underflow at %u\n", pc);
+      goto done;
+    }
+
+    if (high > VM2_STACK_SIZE)
+    {
+      printf("bytecode: stack overflow at %u\n", pc);
+      goto done;
+    }
+
+    // 栈式解释器用 registers[SP] 作栈顶指针
+    if ((op == SET || op == MOV || op == LDR) && p[1] == SP)
+    {
+      printf("bytecode: write to SP at %u\n", pc);
+      goto done;
+    }
+
+    // 后继：顺序执行的下一条，IF 另有跳转目标
+    uint32_t next[2];
+    int next_count = 0;
+
+    if (op != HLT)
+    {
+      next[next_count++] = pc + vm2_insn_size(p);
+    }
+
+    if (op == IF)
+    {
+      const uint8_t *q = p + 2;
+      vm2_read_uleb(&q);
+      next[next_count++] = vm2_read_uleb(&q);
+    }
+
+    for (int i = 0; i < next_count; i++)
+    {
+      uint32_t to = next[i];
+
+      if (!(starts[to] & INSN_VISITED))
+      {
+        starts[to] |= INSN_VISITED;
+        lo[to] = low;
+        hi[to] = high;
+      }
+      else if (low < lo[to] || high > hi[to])
+      {
+        lo[to] = low < lo[to] ? low : lo[to];
+        hi[to] = high > hi[to] ? high : hi[to];
+      }
+      else
+      {
+        continue;
+      }
+
+      if (!(starts[to] & INSN_QUEUED))
+      {
+        starts[to] |= INSN_QUEUED;
+        work[work_count++] = to;
+      }
+    }
+  }
+
+  ok = 1;
+
+done:
+  free(lo);
+  free(hi);
+  free(work);
+  return ok;
+}
+
+// 逐条检查代码区和栈深度，保证执行时无需再做边界检查
+static int verify_code(const Vm2Image *image)
+{
+  const uint8_t *code = image->code;
+  const uint8_t *end = code + image->code_size;
+
+  // 标记指令起始位置，用于检查跳转目标
+  uint8_t *starts = calloc(image->code_size + 1, 1);
+  uint32_t *targets = malloc(sizeof(uint32_t) * (image->code_size + 1));
+  size_t target_count = 0;
+  int ok = 0;
+
+  const uint8_t *p = code;
+  int op = -1;
+  while (p < end)
+  {
+    starts[p - code] |= INSN_START;
+
+    op = *p++;
+    if (op >= NUM_OF_INSTRUCTIONS)
+    {
+      printf("bytecode: unknown instruction %d at %td\n", op, p - 1 - code);
+      goto done;
+    }
+
+    const char *kinds = vm2_operands[op];
+    for (int k = 0; kinds[k]; k++)
+    {
+      uint32_t v;
+
+      switch (kinds[k])
+      {
+      case 'r':
+        if (p >= end || *p >= NUM_OF_REGISTERS)
+        {
+          printf("bytecode: bad register at %td\n", p - code);
+          goto done;
+        }
+        p++;
+        break;
+
+      case 'i':
+        if (!checked_uleb(&p, end, &v) || ((v & 1) && (v >> 1) >= image->const_count))
+        {
+          printf("bytecode: bad immediate at %td\n", p - code);
+          goto done;
+        }
+
+        // 紧随其后的 DIV 除数不为 0
+        if (op == PSH && p < end && ((v & 1) ? vm2_read_u32(image->consts + 4 * (v >> 1)) != 0 : v != 0))
+        {
+          starts[p - code] |= INSN_NONZERO_BEFORE;
+        }
+        break;
+
+      case 't':
+        if (!checked_uleb(&p, end, &v))
+        {
+          printf("bytecode: bad jump target at %td\n", p - code);
+          goto done;
+        }
+        targets[target_count++] = v;
+        break;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < target_count; i++)
+  {
+    if (targets[i] >= image->code_size || !(starts[targets[i]] & INSN_START))
+    {
+      printf("bytecode: jump target %u is not an instruction\n", targets[i]);
+      goto done;
+    }
+
+    starts[targets[i]] |= INSN_TARGET;
+  }
+
+  if (image->entry >= image->code_size || !(starts[image->entry] & INSN_START))
+  {
+    printf("bytecode: bad entry %u\n", image->entry);
+    goto done;
+  }
+
+  starts[image->entry] |= INSN_TARGET;
+
+  // 最后一条指令必须是 HLT，否则会执行到代码区外
+  if (op != HLT)
+  {
+    printf("bytecode: code does not end with HLT\n");
+    goto done;
+  }
+
+  ok = verify_stack(image, starts);
+
+done:
+  free(starts);
+  free(targets);
+  return ok;
+}
+
+int vm2_open_image(Vm2Image *image, const uint8_t *data, size_t size, int mapped)
+{
+  memset(image, 0, sizeof(*image));
+  image->data = data;
+  image->size = size;
+  image->mapped = mapped;
+
+  if (size < VM2_HEADER_SIZE || memcmp(data, VM2_MAGIC, 4) != 0)
+  {
+    printf("bytecode: bad magic\n");
+    return 0;
+  }
+
+  if ((data[4] | data[5] << 8) != VM2_VERSION)
+  {
+    printf("bytecode: unsupported version %d\n", data[4] | data[5] << 8);
+    return 0;
+  }
+
+  image->entry = vm2_read_u32(data + 8);
+  image->const_count = vm2_read_u32(data + 12);
+  image->code_size = vm2_read_u32(data + 16);
+
+  if (image->const_count > (size - VM2_HEADER_SIZE) / 4 ||
+      image->code_size != size - VM2_HEADER_SIZE - 4 * (size_t)image->const_count)
+  {
+    printf("bytecode: bad section sizes\n");
+    return 0;
+  }
+
+  image->consts = data + VM2_HEADER_SIZE;
+  image->code = image->consts + 4 * image->const_count;
+
+  return verify_code(image);
+}
+
+int vm2_map_image(Vm2Image *image, const char *path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    printf("failed to open %s\n", path);
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    printf("failed to stat %s\n", path);
+    close(fd);
+    return 0;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+  {
+    printf("failed to mmap %s\n", path);
+    return 0;
+  }
+
+  if (!vm2_open_image(image, data, st.st_size, 1))
+  {
+    vm2_close_image(image);
+    return 0;
+  }
+
+  return 1;
+}
+
+void vm2_close_image(Vm2Image *image)
+{
+  if (!image->data)
+  {
+    return;
+  }
+
+  if (image->mapped)
+  {
+    munmap((void *)image->data, image->size);
+  }
+  else
+  {
+    free((void *)image->data);
+  }
+
+  image->data = NULL;
+}
+
+int vm2_write_file(const char *path, const uint8_t *data, size_t size)
+{
+  FILE *file = fopen(path, "wb");
+  if (!file)
+  {
+    return 0;
+  }
+
+  size_t written = fwrite(data, 1, size, file);
+  fclose(file);
+
+  return written == size;
+}
+
+// ================= 解码 =================
+
+int vm2_decode(const Vm2Image *image, Vm2Insn **insns, size_t *insn_count, size_t *entry, uint32_t **offsets)
+{
+  // 指令条数不会超过代码字节数
+  Vm2Insn *list = malloc(sizeof(Vm2Insn) * image->code_size);
+  uint32_t *offset_of = malloc(sizeof(uint32_t) * (image->code_size + 1));
+
+  // 字节偏移 -> 指令序号
+  int *index_of = malloc(sizeof(int) * (image->code_size + 1));
+
+  const uint8_t *p = image->code;
+  const uint8_t *end = image->code + image->code_size;
+  size_t n = 0;
+
+  while (p < end)
+  {
+    uint32_t offset = (uint32_t)(p - image->code);
+    index_of[offset] = (int)n;
+    offset_of[n] = offset;
+
+    Vm2Insn *insn = &list[n++];
+    insn->op = *p++;
+
+    const char *kinds = vm2_operands[insn->op];
+    for (int k = 0; kinds[k]; k++)
+    {
+      switch (kinds[k])
+      {
+      case 'r':
+        insn->args[k] = *p++;
+        break;
+
+      case 'i':
+        insn->args[k] = vm2_read_imm(image, &p);
+        break;
+
+      case 't':
+        insn->args[k] = (int)vm2_read_uleb(&p);
+        break;
+      }
+    }
+  }
+
+  offset_of[n] = image->code_size;
+
+  // 跳转目标已在载入时校验过
+  for (size_t i = 0; i < n; i++)
+  {
+    if (list[i].op == IF)
+    {
+      list[i].args[2] = index_of[list[i].args[2]];
+    }
+  }
+
+  *insns = list;
+  *insn_count = n;
+  *entry = (size_t)index_of[image->entry];
+
+  if (offsets)
+  {
+    *offsets = offset_of;
+  }
+  else
+  {
+    free(offset_of);
+  }
+
+  free(index_of);
+  return 1;
+}
@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "vm_2.h"
+
+// 常量折叠与窥孔优化
+//
+// 在基本块内做符号执行：PSH 的常量和 STR 的寄存器先放在虚拟栈上，
+// SET 的常量先记在寄存器状态里，都等到真正需要时才生成指令。
+// 两个操作数都是常量的运算直接算出结果，紧接着被 POP 掉的数据不再入栈，
+// MOV/LDR 的源是已知常量时变成 SET，在被读取前又被覆盖的写入直接丢弃。
+// 块结束时把虚拟栈和寄存器写回，块间的栈与寄存器状态与原程序一致。
+
+#define OPT_MAX_VSTACK 64
+
+// 虚拟栈元素
+typedef struct
+{
+  int is_const;
+  int value; // 常量值，或寄存器编号
+} Entry;
+
+// 寄存器状态
+typedef struct
+{
+  int known; // 值已知
+  int dirty; // 值已知但还没有生成 SET
+  int value;
+} RegState;
+
+typedef struct
+{
+  Vm2Insn *code;
+  int *origin; // 每条新指令对应的原指令序号
+  size_t count;
+  size_t capacity;
+
+  int current; // 正在处理的原指令序号
+  int label;   // 块入口的原指令序号，块中生成的第一条指令对应它，-1 表示已对应
+
+  Entry vstack[OPT_MAX_VSTACK];
+  int depth;
+  RegState regs[NUM_OF_REGISTERS];
+} Optimizer;
+
+static void emit(Optimizer *o, int op, int a0, int a1, int a2)
+{
+  if (o->count == o->capacity)
+  {
+    o->capacity *= 2;
+    o->code = realloc(o->code, sizeof(Vm2Insn) * o->capacity);
+    o->origin = realloc(o->origin, sizeof(int) * o->capacity);
+  }
+
+  o->origin[o->count] = o->label >= 0 ? o->label : o->current;
+  o->label = -1;
+
+  Vm2Insn *insn = &o->code[o->count++];
+  insn->op = op;
+  insn->args[0] = a0;
+  insn->args[1] = a1;
+  insn->args[2] = a2;
+}
+
+// 生成寄存器 r 延迟的 SET
+static void materialize_reg(Optimizer *o, int r)
+{
+  if (o->regs[r].dirty)
+  {
+    emit(o, SET, r, o->regs[r].value, 0);
+    o->regs[r].dirty = 0;
+  }
+}
+
+// 将虚拟栈底部的 n 个元素真正入栈
+static void flush_stack(Optimizer *o, int n)
+{
+  for (int i = 0; i < n; i++)
+  {
+    Entry *e = &o->vstack[i];
+    if (e->is_const)
+    {
+      emit(o, PSH, e->value, 0, 0);
+    }
+    else
+    {
+      emit(o, STR, e->value, 0, 0);
+    }
+  }
+
+  memmove(o->vstack, o->vstack + n, sizeof(Entry) * (o->depth - n));
+  o->depth -= n;
+}
+
+// 块结束，写回全部状态
+static void flush(Optimizer *o)
+{
+  for (int r = 0; r < NUM_OF_REGISTERS; r++)
+  {
+    materialize_reg(o, r);
+  }
+
+  flush_stack(o, o->depth);
+}
+
+// 修改寄存器 r 之前，虚拟栈中引用 r 的元素及其下方元素必须先入栈
+static void protect_reg(Optimizer *o, int r)
+{
+  for (int i = o->depth - 1; i >= 0; i--)
+  {
+    if (!o->vstack[i].is_const && o->vstack[i].value == r)
+    {
+      flush_stack(o, i + 1);
+      return;
+    }
+  }
+}
+
+// 寄存器 r 被赋为常量，延迟生成
+static void set_const(Optimizer *o, int r, int value)
+{
+  protect_reg(o, r);
+  o->regs[r].known = 1;
+  o->regs[r].dirty = 1;
+  o->regs[r].value = value;
+}
+
+// 寄存器 r 被一条真实指令修改，之前延迟的 SET 作废
+static void set_unknown(Optimizer *o, int r)
+{
+  protect_reg(o, r);
+  o->regs[r].known = 0;
+  o->regs[r].dirty = 0;
+}
+
+static void vpush(Optimizer *o, int is_const, int value)
+{
+  if (o->depth == OPT_MAX_VSTACK)
+  {
+    flush_stack(o, 1);
+  }
+
+  o->vstack[o->depth].is_const = is_const;
+  o->vstack[o->depth].value = value;
+  o->depth++;
+}
+
+// 折叠 b op a，溢出按补码回绕。无法折叠时返回 0
+static int fold(int op, int b, int a, int *result)
+{
+  switch (op)
+  {
+  case ADD:
+    *result = (int)((unsigned)b + (unsigned)a);
+    return 1;
+
+  case SUB:
+    *result = (int)((unsigned)b - (unsigned)a);
+    return 1;
+
+  case MUL:
+    *result = (int)((unsigned)b * (unsigned)a);
+    return 1;
+
+  case DIV:
+    // 除 0 要在运行时打印异常
+    if (a == 0 || (b == INT_MIN && a == -1))
+    {
+      return 0;
+    }
+
+    *result = b / a;
+    return 1;
+  }
+
+  return 0;
+}
+
+static void optimize_insn(Optimizer *o, const Vm2Insn *insn, const int *label)
+{
+  RegState *regs = o->regs;
+
+  switch (insn->op)
+  {
+  case PSH:
+    vpush(o, 1, insn->args[0]);
+    break;
+
+  case POP:
+    if (o->depth > 0)
+    {
+      o->depth--;
+    }
+    else
+    {
+      emit(o, POP, 0, 0, 0);
+    }
+    break;
+
+  case SET:
+    set_const(o, insn->args[0], insn->args[1]);
+    break;
+
+  case MOV:
+  {
+    int dr = insn->args[0];
+    int sr = insn->args[1];
+
+    if (regs[sr].known)
+    {
+      set_const(o, dr, regs[sr].value);
+    }
+    else if (dr != sr)
+    {
+      set_unknown(o, dr);
+      emit(o, MOV, dr, sr, 0);
+    }
+    break;
+  }
+
+  case ADD:
+  case SUB:
+  case MUL:
+  case DIV:
+  {
+    int result;
+
+    if (o->depth >= 2 && o->vstack[o->depth - 1].is_const && o->vstack[o->depth - 2].is_const &&
+        fold(insn->op, o->vstack[o->depth - 2].value, o->vstack[o->depth - 1].value, &result))
+    {
+      o->depth -= 2;
+      vpush(o, 1, result);
+      set_const(o, A, result);
+      break;
+    }
+
+    // 操作数必须在真实栈上
+    flush_stack(o, o->depth);
+
+    // DIV 除 0 时不写 A，先前的值要保留
+    if (insn->op == DIV)
+    {
+      materialize_reg(o, A);
+    }
+
+    set_unknown(o, A);
+    emit(o, insn->op, 0, 0, 0);
+    break;
+  }
+
+  case STR:
+  {
+    int r = insn->args[0];
+
+    if (regs[r].known)
+    {
+      vpush(o, 1, regs[r].value);
+    }
+    else
+    {
+      vpush(o, 0, r);
+    }
+    break;
+  }
+
+  case LDR:
+  {
+    int r = insn->args[0];
+
+    if (o->depth == 0)
+    {
+      set_unknown(o, r);
+      emit(o, LDR, r, 0, 0);
+      break;
+    }
+
+    Entry top = o->vstack[o->depth - 1];
+    if (top.is_const)
+    {
+      set_const(o, r, top.value);
+    }
+    else if (top.value != r)
+    {
+      set_unknown(o, r);
+      emit(o, MOV, r, top.value, 0);
+    }
+    break;
+  }
+
+  case IF:
+  {
+    int r = insn->args[0];
+
+    // 条件恒不成立，整条删除
+    if (regs[r].known && regs[r].value != insn->args[1])
+    {
+      break;
+    }
+
+    flush(o);
+    emit(o, IF, r, insn->args[1], label[insn->args[2]]);
+    break;
+  }
+
+  case LOGR:
+    materialize_reg(o, insn->args[0]);
+    emit(o, LOGR, insn->args[0], 0, 0);
+    break;
+
+  case HLT:
+    flush(o);
+    emit(o, HLT, 0, 0, 0);
+    break;
+  }
+}
+
+size_t vm2_optimize(Vm2Insn **insns, size_t *insn_count, size_t *entry, int **origin)
+{
+  const Vm2Insn *in = *insns;
+  size_t n = *insn_count;
+
+  // IP/SP 作为操作数时栈和跳转无法静态分析
+  for (size_t i = 0; i < n; i++)
+  {
+    const char *kinds = vm2_operands[in[i].op];
+    for (int k = 0; kinds[k]; k++)
+    {
+      if (kinds[k] == 'r' && in[i].args[k] >= IP)
+      {
+        return 0;
+      }
+    }
+  }
+
+  // 基本块入口
+  uint8_t *leader = calloc(n + 1, 1);
+  uint8_t *is_target = calloc(n + 1, 1);
+
+  for (size_t i = 0; i < n; i++)
+  {
+    if (in[i].op == IF)
+    {
+      leader[in[i].args[2]] = 1;
+      is_target[in[i].args[2]] = 1;
+      leader[i + 1] = 1;
+    }
+  }
+
+  leader[*entry] = 1;
+
+  // 原指令序号 -> 新指令序号。跳转目标在后面时尚未确定，先做一遍只为得到 label
+  int *label = calloc(n + 1, sizeof(int));
+
+  Optimizer o;
+  memset(&o, 0, sizeof(o));
+  o.capacity = n + 16;
+  o.code = malloc(sizeof(Vm2Insn) * o.capacity);
+  o.origin = malloc(sizeof(int) * o.capacity);
+
+  for (int pass = 0; pass < 2; pass++)
+  {
+    o.count = 0;
+    o.depth = 0;
+    o.label = -1;
+
+    for (size_t i = 0; i < n; i++)
+    {
+      if (leader[i])
+      {
+        flush(&o);
+        label[i] = (int)o.count;
+        o.label = (int)i;
+        memset(o.regs, 0, sizeof(o.regs));
+
+        // 程序开始时寄存器全为 0，入口不是跳转目标时可以利用
+        if (i == *entry && !is_target[i])
+        {
+          for (int r = 0; r < IP; r++)
+          {
+            o.regs[r].known = 1;
+          }
+        }
+      }
+
+      o.current = (int)i;
+      optimize_insn(&o, &in[i], label);
+    }
+  }
+
+  free(leader);
+  free(is_target);
+
+  // 没有变短时保持原样
+  if (o.count >= n)
+  {
+    free(label);
+    free(o.code);
+    free(o.origin);
+    return 0;
+  }
+
+  *entry = (size_t)label[*entry];
+  free(label);
+
+  free(*insns);
+  *insns = o.code;
+  *insn_count = o.count;
+
+  if (origin)
+  {
+    *origin = o.origin;
+  }
+  else
+  {
+    free(o.origin);
+  }
+
+  return n - o.count;
+}
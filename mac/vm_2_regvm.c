@@ -0,0 +1,620 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vm_2.h"
+
+// 栈式 -> 寄存器式翻译
+//
+// 以基本块为单位，用一个虚拟栈记录还未真正入栈的数据（常量、寄存器或临时寄存器），
+// PSH/PSH/ADD 这样的序列因此变成一条 R_ADD t, c1, c2。
+// ADD/SUB/MUL/DIV 对 registers[A] 的写入同样延迟，被覆盖前没有读取就直接丢弃。
+// 基本块结束（IF、跳转目标、HLT）时把虚拟栈和 A 写回，保证块间状态与原程序一致。
+// 除数不是常量的 DIV 在除 0 时栈深度与正常路径不同，此时跳到块外的补偿代码，
+// 写回当时的状态后退回栈式解释器继续执行。
+
+// 每个基本块可用的临时寄存器个数，用完时提前写回
+#define VM2R_MAX_TEMPS 64
+
+// 虚拟栈深度上限
+#define VM2R_MAX_VSTACK 64
+
+#define TEMP_BASE NUM_OF_REGISTERS
+#define CONST_BASE (TEMP_BASE + VM2R_MAX_TEMPS)
+
+// 指令缓冲区
+typedef struct
+{
+  Vm2RInsn *code;
+  size_t count;
+  size_t capacity;
+} Buffer;
+
+typedef struct
+{
+  Vm2RProgram *out;
+  Buffer main;
+  Buffer stubs;   // 补偿代码，最后追加到主代码之后
+  Buffer *buffer; // 当前写入的缓冲区
+  size_t const_capacity;
+
+  int vstack[VM2R_MAX_VSTACK]; // 虚拟栈，元素为 cells 下标
+  int depth;
+  int consumed;  // 已从真实栈上取走、尚未调整 sp 的个数
+  int a_pending; // registers[A] 的延迟值，-1 表示无
+  int temps;     // 当前块已用的临时寄存器
+  int ip;        // 当前指令的字节偏移
+} Translator;
+
+static Vm2RInsn *emit(Translator *t, int op, int d, int a, int b)
+{
+  Buffer *buffer = t->buffer;
+  if (buffer->count == buffer->capacity)
+  {
+    buffer->capacity = buffer->capacity ? buffer->capacity * 2 : 64;
+    buffer->code = realloc(buffer->code, sizeof(Vm2RInsn) * buffer->capacity);
+  }
+
+  Vm2RInsn *insn = &buffer->code[buffer->count++];
+  insn->op = (uint8_t)op;
+  insn->d = d;
+  insn->a = a;
+  insn->b = b;
+  insn->target = 0;
+  insn->ip = t->ip;
+  return insn;
+}
+
+// 常量所在的 cell，去重
+static int const_cell(Translator *t, int value)
+{
+  Vm2RProgram *out = t->out;
+  for (size_t i = CONST_BASE; i < out->cell_count; i++)
+  {
+    if (out->cells[i] == value)
+    {
+      return (int)i;
+    }
+  }
+
+  if (out->cell_count == t->const_capacity)
+  {
+    t->const_capacity *= 2;
+    out->cells = realloc(out->cells, sizeof(int) * t->const_capacity);
+  }
+
+  out->cells[out->cell_count] = value;
+  return (int)out->cell_count++;
+}
+
+// 将虚拟栈和延迟的 A 写回，之后状态与原程序逐条执行一致
+static void flush(Translator *t)
+{
+  if (t->a_pending >= 0 && t->a_pending != A)
+  {
+    emit(t, R_MOV, A, t->a_pending, 0);
+  }
+
+  t->a_pending = -1;
+
+  if (t->consumed == 0)
+  {
+    for (int i = 0; i < t->depth; i++)
+    {
+      emit(t, R_PUSH, 0, t->vstack[i], 0);
+    }
+  }
+  else
+  {
+    for (int i = 0; i < t->depth; i++)
+    {
+      emit(t, R_STS, i + 1 - t->consumed, t->vstack[i], 0);
+    }
+
+    emit(t, R_SPADJ, 0, t->depth - t->consumed, 0);
+  }
+
+  t->depth = 0;
+  t->consumed = 0;
+  t->temps = 0;
+}
+
+// 每条指令开始前已保证余量足够，这里不会用完
+static int new_temp(Translator *t)
+{
+  return TEMP_BASE + t->temps++;
+}
+
+static void vpush(Translator *t, int cell)
+{
+  t->vstack[t->depth++] = cell;
+}
+
+// 取栈顶，pop 为 0 时只读不出栈
+static int vtop(Translator *t, int pop)
+{
+  if (t->depth > 0)
+  {
+    return pop ? t->vstack[--t->depth] : t->vstack[t->depth - 1];
+  }
+
+  // 虚拟栈为空，从真实栈上读
+  int temp = new_temp(t);
+  emit(t, R_LDS, temp, -t->consumed, 0);
+
+  if (pop)
+  {
+    t->consumed++;
+  }
+
+  return temp;
+}
+
+// 寄存器的当前值所在 cell
+static int reg_cell(Translator *t, int r)
+{
+  return (r == A && t->a_pending >= 0) ? t->a_pending : r;
+}
+
+// 写寄存器 r 之前，把虚拟栈和延迟 A 中对 r 的引用复制到临时寄存器
+static void protect_reg(Translator *t, int r)
+{
+  int temp = -1;
+
+  for (int i = 0; i < t->depth; i++)
+  {
+    if (t->vstack[i] == r)
+    {
+      if (temp < 0)
+      {
+        temp = new_temp(t);
+        emit(t, R_MOV, temp, r, 0);
+      }
+
+      t->vstack[i] = temp;
+    }
+  }
+
+  if (t->a_pending == r && r != A)
+  {
+    if (temp < 0)
+    {
+      temp = new_temp(t);
+      emit(t, R_MOV, temp, r, 0);
+    }
+
+    t->a_pending = temp;
+  }
+}
+
+// 给寄存器 r 赋值为 cell 中的值
+static void write_reg(Translator *t, int r, int cell)
+{
+  if (r == A)
+  {
+    // A 延迟写入，先前未读取的值直接作废
+    protect_reg(t, A);
+    t->a_pending = cell;
+    return;
+  }
+
+  if (cell == r)
+  {
+    return;
+  }
+
+  protect_reg(t, r);
+  emit(t, R_MOV, r, cell, 0);
+}
+
+// 为 DIVZ 生成除 0 时的补偿代码，返回其在补偿区的序号。
+// 此时两个操作数已出栈，A 保持原值，写回后从下一条指令处退回栈式解释器
+static int emit_div0_stub(Translator *t, int next_ip)
+{
+  Translator saved = *t;
+
+  t->buffer = &t->stubs;
+  int stub = (int)t->stubs.count;
+
+  flush(t);
+  emit(t, R_DIV0, 0, 0, 0);
+  emit(t, R_EXIT, 0, 0, 0)->ip = next_ip;
+
+  // 只保留补偿区的写入，恢复翻译状态
+  saved.stubs = t->stubs;
+  *t = saved;
+
+  return stub;
+}
+
+// 检查寄存器操作数，IP/SP 作为操作数时栈深度和跳转无法静态确定
+static int supported(const Vm2Insn *insn)
+{
+  const char *kinds = vm2_operands[insn->op];
+  for (int k = 0; kinds[k]; k++)
+  {
+    if (kinds[k] == 'r' && insn->args[k] >= IP)
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+int vm2r_translate(const Vm2Insn *insns, size_t insn_count, size_t entry, const uint32_t *offsets, Vm2RProgram *out)
+{
+  Translator t;
+  memset(&t, 0, sizeof(t));
+  memset(out, 0, sizeof(*out));
+
+  t.out = out;
+  t.buffer = &t.main;
+  t.a_pending = -1;
+  t.const_capacity = CONST_BASE + 16;
+  out->cells = calloc(t.const_capacity, sizeof(int));
+  out->cell_count = CONST_BASE;
+
+  // 基本块入口：跳转目标和 IF 之后的指令
+  uint8_t *leader = calloc(insn_count + 1, 1);
+
+  // 原指令序号 -> 翻译后序号
+  int *label = malloc(sizeof(int) * (insn_count + 1));
+
+  for (size_t i = 0; i < insn_count; i++)
+  {
+    if (!supported(&insns[i]))
+    {
+      free(leader);
+      free(label);
+      free(out->cells);
+      memset(out, 0, sizeof(*out));
+      return 0;
+    }
+
+    if (insns[i].op == IF)
+    {
+      leader[insns[i].args[2]] = 1;
+      leader[i + 1] = 1;
+    }
+  }
+
+  leader[entry] = 1;
+
+  for (size_t i = 0; i < insn_count; i++)
+  {
+    const Vm2Insn *insn = &insns[i];
+
+    // 块入口，或临时寄存器、虚拟栈余量不足一条指令所需时写回
+    if (leader[i] || t.temps > VM2R_MAX_TEMPS - 4 || t.depth > VM2R_MAX_VSTACK - 2)
+    {
+      flush(&t);
+    }
+
+    label[i] = (int)t.main.count;
+    t.ip = (int)offsets[i];
+
+    switch (insn->op)
+    {
+    case PSH:
+      vpush(&t, const_cell(&t, insn->args[0]));
+      break;
+
+    case POP:
+      if (t.depth > 0)
+      {
+        t.depth--;
+      }
+      else
+      {
+        t.consumed++;
+      }
+      break;
+
+    case SET:
+      write_reg(&t, insn->args[0], const_cell(&t, insn->args[1]));
+      break;
+
+    case MOV:
+      write_reg(&t, insn->args[0], reg_cell(&t, insn->args[1]));
+      break;
+
+    case ADD:
+    case SUB:
+    case MUL:
+    {
+      int a = vtop(&t, 1);
+      int b = vtop(&t, 1);
+      int temp = new_temp(&t);
+
+      // 原指令为 b op a，a 是栈顶
+      int op = insn->op == ADD ? R_ADD : insn->op == SUB ? R_SUB : R_MUL;
+      emit(&t, op, temp, b, a);
+
+      vpush(&t, temp);
+      write_reg(&t, A, temp);
+      break;
+    }
+
+    case DIV:
+    {
+      int a = vtop(&t, 1);
+      int b = vtop(&t, 1);
+      int temp = new_temp(&t);
+
+      if (a >= CONST_BASE && out->cells[a] != 0)
+      {
+        emit(&t, R_DIV, temp, b, a);
+      }
+      else
+      {
+        int stub = emit_div0_stub(&t, (int)offsets[i + 1]);
+        emit(&t, R_DIVZ, temp, b, a)->target = stub;
+      }
+
+      vpush(&t, temp);
+      write_reg(&t, A, temp);
+      break;
+    }
+
+    case STR:
+      vpush(&t, reg_cell(&t, insn->args[0]));
+      break;
+
+    case LDR:
+      write_reg(&t, insn->args[0], vtop(&t, 0));
+      break;
+
+    case IF:
+    {
+      flush(&t);
+
+      // 目标先记录原指令序号，最后统一改写
+      Vm2RInsn *jump = emit(&t, R_IF, 0, insn->args[0], const_cell(&t, insn->args[1]));
+      jump->target = insn->args[2];
+      jump->ip = (int)offsets[insn->args[2]];
+      break;
+    }
+
+    case LOGR:
+      emit(&t, R_LOG, insn->args[0], reg_cell(&t, insn->args[0]), 0);
+      break;
+
+    case HLT:
+      flush(&t);
+
+      // HLT 后 IP 指向下一条指令
+      emit(&t, R_HLT, 0, 0, 0)->ip = (int)offsets[i + 1];
+      break;
+    }
+  }
+
+  // 补偿代码追加到主代码之后，改写跳转目标
+  size_t main_count = t.main.count;
+  out->count = main_count + t.stubs.count;
+  out->code = realloc(t.main.code, sizeof(Vm2RInsn) * (out->count ? out->count : 1));
+  if (t.stubs.count)
+  {
+    memcpy(out->code + main_count, t.stubs.code, sizeof(Vm2RInsn) * t.stubs.count);
+  }
+
+  for (size_t i = 0; i < out->count; i++)
+  {
+    if (out->code[i].op == R_IF)
+    {
+      out->code[i].target = label[out->code[i].target];
+    }
+    else if (out->code[i].op == R_DIVZ)
+    {
+      out->code[i].target += (int)main_count;
+    }
+  }
+
+  out->entry = (size_t)label[entry];
+
+  free(t.stubs.code);
+  free(leader);
+  free(label);
+  return 1;
+}
+
+// 以下为各指令的处理函数，instr 为指令序号
+
+#define INSN const Vm2RInsn *insn = &((Vm2 *)core)->rprogram->code[instr]
+#define cells (((Vm2 *)core)->cells)
+#define rsp (cells[SP])
+
+static void r_mov(VmCore *core, uint32_t instr)
+{
+  INSN;
+  cells[insn->d] = cells[insn->a];
+}
+
+static void r_add(VmCore *core, uint32_t instr)
+{
+  INSN;
+  cells[insn->d] = cells[insn->a] + cells[insn->b];
+}
+
+static void r_sub(VmCore *core, uint32_t instr)
+{
+  INSN;
+  cells[insn->d] = cells[insn->a] - cells[insn->b];
+}
+
+static void r_mul(VmCore *core, uint32_t instr)
+{
+  INSN;
+  cells[insn->d] = cells[insn->a] * cells[insn->b];
+}
+
+static void r_div(VmCore *core, uint32_t instr)
+{
+  INSN;
+  cells[insn->d] = cells[insn->a] / cells[insn->b];
+}
+
+static void r_divz(VmCore *core, uint32_t instr)
+{
+  INSN;
+
+  if (cells[insn->b] == 0)
+  {
+    core->pc = insn->target;
+    return;
+  }
+
+  cells[insn->d] = cells[insn->a] / cells[insn->b];
+}
+
+static void r_lds(VmCore *core, uint32_t instr)
+{
+  INSN;
+  cells[insn->d] = ((Vm2 *)core)->stack[rsp + insn->a];
+}
+
+static void r_sts(VmCore *core, uint32_t instr)
+{
+  INSN;
+  ((Vm2 *)core)->stack[rsp + insn->d] = cells[insn->a];
+}
+
+static void r_push(VmCore *core, uint32_t instr)
+{
+  INSN;
+  ((Vm2 *)core)->stack[++rsp] = cells[insn->a];
+}
+
+static void r_spadj(VmCore *core, uint32_t instr)
+{
+  INSN;
+  rsp += insn->a;
+}
+
+static void r_if(VmCore *core, uint32_t instr)
+{
+  INSN;
+
+  if (cells[insn->a] == cells[insn->b])
+  {
+    printf("jump if:%d\n", vm2_source_ip((Vm2 *)core, (uint32_t)insn->ip));
+    core->pc = insn->target;
+  }
+}
+
+static void r_log(VmCore *core, uint32_t instr)
+{
+  INSN;
+  printf("log register_%d %d\n", insn->d, cells[insn->a]);
+}
+
+static void r_div0(VmCore *core, uint32_t instr)
+{
+  (void)core;
+  (void)instr;
+  printf("exception occur, divid 0 \n");
+}
+
+// 退出寄存器式执行，IP 还原为原字节码偏移
+static void r_exit(VmCore *core, uint32_t instr)
+{
+  INSN;
+  cells[IP] = insn->ip;
+  vm_core_halt(core);
+}
+
+static void r_hlt(VmCore *core, uint32_t instr)
+{
+  ((Vm2 *)core)->halted = 1;
+  r_exit(core, instr);
+}
+
+#undef INSN
+#undef cells
+#undef rsp
+
+static uint32_t r_fetch(VmCore *core, uint32_t pc, int *op, uint32_t *next_pc)
+{
+  *op = ((Vm2 *)core)->rprogram->code[pc].op;
+  *next_pc = pc + 1;
+  return pc;
+}
+
+static void r_dump(VmCore *core, FILE *out)
+{
+  Vm2 *vm = (Vm2 *)core;
+  for (int i = 0; i < NUM_OF_REGISTERS; i++)
+  {
+    fprintf(out, "%d ", vm->cells[i]);
+  }
+
+  fprintf(out, "\n");
+}
+
+static const char *const r_names[NUM_OF_R_OPS] = {
+    "MOV", "ADD", "SUB", "MUL", "DIV", "DIVZ", "LDS", "STS", "PUSH", "SPADJ", "IF", "LOG", "DIV0", "EXIT", "HLT"};
+
+static const VmHandler r_handlers[NUM_OF_R_OPS] = {
+    [R_MOV] = r_mov,
+    [R_ADD] = r_add,
+    [R_SUB] = r_sub,
+    [R_MUL] = r_mul,
+    [R_DIV] = r_div,
+    [R_DIVZ] = r_divz,
+    [R_LDS] = r_lds,
+    [R_STS] = r_sts,
+    [R_PUSH] = r_push,
+    [R_SPADJ] = r_spadj,
+    [R_IF] = r_if,
+    [R_LOG] = r_log,
+    [R_DIV0] = r_div0,
+    [R_EXIT] = r_exit,
+    [R_HLT] = r_hlt,
+};
+
+const VmIsa vm2r_isa = {
+    .name = "vm_2r",
+    .op_count = NUM_OF_R_OPS,
+    .op_names = r_names,
+    .handlers = r_handlers,
+    .fetch = r_fetch,
+    .dump = r_dump,
+};
+
+int vm2r_run(Vm2 *vm, const Vm2RProgram *program)
+{
+  vm->rprogram = program;
+  vm->halted = 0;
+
+  vm->cells = malloc(sizeof(int) * program->cell_count);
+  memcpy(vm->cells, program->cells, sizeof(int) * program->cell_count);
+  memcpy(vm->cells, vm->registers, sizeof(int) * NUM_OF_REGISTERS);
+
+  vm_core_set_isa(&vm->core, &vm2r_isa, (uint32_t)program->count);
+  vm->core.pc = (uint32_t)program->entry;
+  vm_core_run(&vm->core);
+
+  // 因预算停在翻译后的代码中间时，IP 取当前指令对应的字节码偏移
+  if (vm->core.stop != VM_STOP_HALT && vm->core.pc < program->count)
+  {
+    vm->cells[IP] = program->code[vm->core.pc].ip;
+  }
+
+  // 回到栈式指令集
+  memcpy(vm->registers, vm->cells, sizeof(int) * NUM_OF_REGISTERS);
+  vm_core_set_isa(&vm->core, &vm2_isa, vm->image.code_size);
+  vm->core.pc = (uint32_t)vm->registers[IP];
+
+  free(vm->cells);
+  vm->cells = NULL;
+  vm->rprogram = NULL;
+
+  return vm->halted;
+}
+
+void vm2r_free(Vm2RProgram *program)
+{
+  free(program->code);
+  free(program->cells);
+  memset(program, 0, sizeof(*program));
+}
@@ -0,0 +1,602 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "vm_core.h"
+
+static double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void vm_core_init(VmCore *vm, const VmIsa *isa, uint32_t pc_limit)
+{
+  memset(vm, 0, sizeof(*vm));
+  vm->isa = isa;
+  vm->pc_limit = pc_limit;
+  vm->engine = VM_ENGINE_PREDECODE;
+}
+
+void vm_core_free(VmCore *vm)
+{
+  vm_core_flush(vm);
+  vm_perf_close(&vm->perf);
+}
+
+// 匿名映射的预解码缓存，at 不为 NULL 时在原地替换，内容清零
+static VmSlot *map_anonymous(VmCore *vm, VmSlot *at)
+{
+  void *slots = mmap(at, (size_t)vm->pc_limit * sizeof(VmSlot), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | (at ? MAP_FIXED : 0), -1, 0);
+  return slots == MAP_FAILED ? NULL : slots;
+}
+
+void vm_core_flush(VmCore *vm)
+{
+  if (vm->slots)
+  {
+    munmap(vm->slots, (size_t)vm->pc_limit * sizeof(VmSlot));
+  }
+
+  vm->slots = NULL;
+}
+
+void vm_core_clear_slots(VmCore *vm)
+{
+  if (vm->slots && !map_anonymous(vm, vm->slots))
+  {
+    vm_core_flush(vm);
+  }
+}
+
+void vm_core_decode_range(VmCore *vm, VmSlot *slots, uint32_t start, uint32_t end)
+{
+  for (uint32_t pc = start; pc < end; pc++)
+  {
+    slots[pc].instr = vm->isa->fetch(vm, pc, &slots[pc].op, &slots[pc].next_pc);
+    slots[pc].handler = vm->isa->handlers[slots[pc].op];
+  }
+}
+
+int vm_core_map_slots(VmCore *vm, int fd)
+{
+  void *slots = mmap(NULL, (size_t)vm->pc_limit * sizeof(VmSlot), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+  if (slots == MAP_FAILED)
+  {
+    return 0;
+  }
+
+  vm_core_flush(vm);
+  vm->slots = slots;
+  return 1;
+}
+
+void vm_core_set_isa(VmCore *vm, const VmIsa *isa, uint32_t pc_limit)
+{
+  vm_core_flush(vm);
+  vm->isa = isa;
+  vm->pc_limit = pc_limit;
+  memset(vm->op_counts, 0, sizeof(vm->op_counts));
+}
+
+int vm_core_option(VmCore *vm, const char *arg)
+{
+  if (strcmp(arg, "-t") == 0)
+  {
+    vm->trace = 1;
+  }
+  else if (strcmp(arg, "-s") == 0)
+  {
+    vm->stats = 1;
+  }
+  else if (strcmp(arg, "-p") == 0)
+  {
+    if (!vm->perf.enabled)
+    {
+      vm_perf_open(&vm->perf);
+    }
+  }
+  else if (strcmp(arg, "-d") == 0)
+  {
+    vm->debug = 1;
+  }
+  else if (strncmp(arg, "-n=", 3) == 0)
+  {
+    vm->budget = strtoull(arg + 3, NULL, 10);
+  }
+  else if (strncmp(arg, "-w=", 3) == 0)
+  {
+    vm->time_budget = strtod(arg + 3, NULL);
+  }
+  else if (strcmp(arg, "-e=decode") == 0)
+  {
+    vm->engine = VM_ENGINE_DECODE;
+  }
+  else if (strcmp(arg, "-e=predecode") == 0)
+  {
+    vm->engine = VM_ENGINE_PREDECODE;
+  }
+  else
+  {
+    return 0;
+  }
+
+  return 1;
+}
+
+void vm_core_halt(VmCore *vm)
+{
+  // 停机前的输出填满了缓冲区时仍报告停机，否则嵌入方会以为可以继续执行
+  if (vm->stop_request == VM_STOP_OUTPUT)
+  {
+    vm->stop_request = VM_STOP_NONE;
+  }
+
+  vm->running = 0;
+}
+
+void vm_core_yield(VmCore *vm, void (*on_yield)(VmCore *vm))
+{
+  vm->on_yield = on_yield;
+  vm_core_stop(vm, VM_STOP_YIELD);
+}
+
+void vm_core_stop(VmCore *vm, VmStopReason reason)
+{
+  vm->stop_request = reason;
+  vm->running = 0;
+}
+
+// 借用 yield 让引擎在当前指令后退出，已有其他停止请求时它们同样会回到片之间
+void vm_core_interrupt(VmCore *vm)
+{
+  vm->irq_pending = 1;
+
+  if (!vm->stop_request)
+  {
+    vm_core_stop(vm, VM_STOP_YIELD);
+  }
+}
+
+// 片之间：交给前端处理 yield 事件和中断
+static void yield_done(VmCore *vm)
+{
+  vm->stop_request = VM_STOP_NONE;
+  vm->running = 1;
+
+  if (vm->on_yield)
+  {
+    void (*on_yield)(VmCore *vm) = vm->on_yield;
+    vm->on_yield = NULL;
+    on_yield(vm);
+  }
+}
+
+static void check_interrupt(VmCore *vm)
+{
+  if (vm->isa->interrupt && (vm->irq_pending || vm->irq_interval))
+  {
+    vm->irq_pending = 0;
+    vm->isa->interrupt(vm);
+  }
+}
+
+// 解码 pc 处的指令填入 slot
+static void decode(VmCore *vm, VmSlot *slot, uint32_t pc)
+{
+  slot->instr = vm->isa->fetch(vm, pc, &slot->op, &slot->next_pc);
+  slot->handler = vm->isa->handlers[slot->op];
+}
+
+// 预解码缓存未命中：先让前端填入（如后台预解码的结果），仍没有时解码
+static void fill(VmCore *vm, VmSlot *slot, uint32_t pc)
+{
+  if (vm->on_miss)
+  {
+    vm->on_miss(vm);
+  }
+
+  if (!slot->handler)
+  {
+    decode(vm, slot, pc);
+  }
+}
+
+void vm_core_break_handler(VmCore *vm, uint32_t instr)
+{
+  vm->pc = instr;
+  vm_core_stop(vm, VM_STOP_BREAK);
+}
+
+// 给预解码缓存打上断点补丁，op 仍为原指令的操作码，供跟踪和统计使用
+static void patch_breakpoint(VmCore *vm, uint32_t pc)
+{
+  VmSlot *slot = &vm->slots[pc];
+  uint32_t next_pc;
+
+  vm->isa->fetch(vm, pc, &slot->op, &next_pc);
+  slot->handler = vm_core_break_handler;
+  slot->instr = pc;
+  slot->next_pc = pc;
+}
+
+static void patch_breakpoints(VmCore *vm)
+{
+  for (int i = 0; i < vm->breakpoint_count; i++)
+  {
+    if (vm->breakpoints[i].isa == vm->isa && vm->breakpoints[i].pc < vm->pc_limit)
+    {
+      patch_breakpoint(vm, vm->breakpoints[i].pc);
+    }
+  }
+}
+
+int vm_core_break_set(VmCore *vm, uint32_t pc)
+{
+  if (vm->breakpoint_count == VM_MAX_BREAKPOINTS || pc >= vm->pc_limit)
+  {
+    return 0;
+  }
+
+  for (int i = 0; i < vm->breakpoint_count; i++)
+  {
+    if (vm->breakpoints[i].isa == vm->isa && vm->breakpoints[i].pc == pc)
+    {
+      return 1;
+    }
+  }
+
+  vm->breakpoints[vm->breakpoint_count++] = (VmBreakpoint){vm->isa, pc};
+
+  // 解码引擎没有可打补丁的缓存
+  vm->engine = VM_ENGINE_PREDECODE;
+
+  if (vm->slots)
+  {
+    patch_breakpoint(vm, pc);
+  }
+
+  return 1;
+}
+
+int vm_core_break_clear(VmCore *vm, uint32_t pc)
+{
+  for (int i = 0; i < vm->breakpoint_count; i++)
+  {
+    if (vm->breakpoints[i].isa == vm->isa && vm->breakpoints[i].pc == pc)
+    {
+      vm->breakpoints[i] = vm->breakpoints[--vm->breakpoint_count];
+
+      // 下次执行到时重新解码
+      if (vm->slots)
+      {
+        vm->slots[pc].handler = NULL;
+      }
+
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+VmStopReason vm_core_step(VmCore *vm)
+{
+  int op;
+  uint32_t next_pc;
+  uint32_t instr = vm->isa->fetch(vm, vm->pc, &op, &next_pc);
+
+  VM_TRACE(vm, "[%s] %04x %s\n", vm->isa->name, vm->pc, vm->isa->op_names[op]);
+
+  if (vm->stats)
+  {
+    vm->op_counts[op]++;
+  }
+
+  vm->running = 1;
+  vm->stop_request = VM_STOP_NONE;
+  vm->pc = next_pc;
+  vm->isa->handlers[op](vm, instr);
+  vm->retired++;
+
+  if (vm->stop_request == VM_STOP_YIELD)
+  {
+    yield_done(vm);
+  }
+
+  check_interrupt(vm);
+
+  if (vm->stop_request)
+  {
+    vm->stop = vm->stop_request;
+
+    // 指令等待输入，尚未执行
+    if (vm->stop == VM_STOP_INPUT)
+    {
+      vm->retired--;
+
+      if (vm->stats)
+      {
+        vm->op_counts[op]--;
+      }
+    }
+  }
+  else
+  {
+    vm->stop = vm->running ? VM_STOP_NONE : VM_STOP_HALT;
+  }
+
+  vm->running = 0;
+
+  return vm->stop;
+}
+
+// 以下引擎最多执行 slice 条指令，返回实际执行的条数
+
+// 每条指令都取指、解码
+static uint64_t run_decode(VmCore *vm, uint64_t slice)
+{
+  const VmIsa *isa = vm->isa;
+  uint64_t left = slice;
+
+  while (vm->running && left)
+  {
+    int op;
+    uint32_t next_pc;
+    uint32_t instr = isa->fetch(vm, vm->pc, &op, &next_pc);
+
+    vm->pc = next_pc;
+    isa->handlers[op](vm, instr);
+    left--;
+  }
+
+  return slice - left;
+}
+
+// 解码结果按地址缓存，代码被修改时由前端调用 vm_core_invalidate
+static uint64_t run_predecode(VmCore *vm, uint64_t slice)
+{
+  uint64_t left = slice;
+
+  while (vm->running && left)
+  {
+    VmSlot *slot = &vm->slots[vm->pc];
+    if (!slot->handler)
+    {
+      fill(vm, slot, vm->pc);
+    }
+
+    vm->pc = slot->next_pc;
+    slot->handler(vm, slot->instr);
+    left--;
+  }
+
+  return slice - left;
+}
+
+// 带跟踪和计数的慢速路径，两种引擎共用
+static uint64_t run_instrumented(VmCore *vm, uint64_t slice)
+{
+  const VmIsa *isa = vm->isa;
+  uint64_t left = slice;
+
+  while (vm->running && left)
+  {
+    VmSlot local;
+    VmSlot *slot = &local;
+    uint32_t pc = vm->pc;
+
+    if (vm->engine == VM_ENGINE_PREDECODE)
+    {
+      slot = &vm->slots[pc];
+    }
+
+    if (slot == &local)
+    {
+      decode(vm, slot, pc);
+    }
+    else if (!slot->handler)
+    {
+      fill(vm, slot, pc);
+    }
+
+    VM_TRACE(vm, "[%s] %04x %s\n", isa->name, pc, isa->op_names[slot->op]);
+
+    if (vm->stats)
+    {
+      vm->op_counts[slot->op]++;
+    }
+
+    vm->pc = slot->next_pc;
+    slot->handler(vm, slot->instr);
+    left--;
+  }
+
+  return slice - left;
+}
+
+VmStopReason vm_core_run(VmCore *vm)
+{
+  if (vm->engine == VM_ENGINE_PREDECODE && !vm->slots)
+  {
+    vm->slots = map_anonymous(vm, NULL);
+  }
+
+  if (vm->slots)
+  {
+    patch_breakpoints(vm);
+  }
+
+  uint64_t (*engine)(VmCore *, uint64_t) = run_decode;
+
+  if (vm->native && !vm->trace && !vm->breakpoint_count)
+  {
+    engine = vm->native;
+  }
+  else if (vm->trace || vm->stats)
+  {
+    engine = run_instrumented;
+  }
+  else if (vm->engine == VM_ENGINE_PREDECODE)
+  {
+    engine = run_predecode;
+  }
+
+  uint64_t retired = 0;
+  VmStopReason stop = VM_STOP_HALT;
+
+  vm->running = 1;
+  vm->stop_request = VM_STOP_NONE;
+  vm_perf_begin(&vm->perf, vm->isa->name);
+  double start = now();
+
+  // 按片执行，预算、时间和中断只在片之间检查，不增加每条指令的开销
+  while (vm->running)
+  {
+    uint64_t slice = VM_SLICE;
+
+    check_interrupt(vm);
+
+    if (vm->irq_interval && vm->irq_interval < slice)
+    {
+      slice = vm->irq_interval;
+    }
+
+    if (vm->budget)
+    {
+      if (vm->retired >= vm->budget)
+      {
+        stop = VM_STOP_BUDGET;
+        break;
+      }
+
+      if (vm->budget - vm->retired < slice)
+      {
+        slice = vm->budget - vm->retired;
+      }
+    }
+
+    uint64_t n = engine(vm, slice);
+    retired += n;
+    vm->retired += n;
+
+    if (vm->stop_request == VM_STOP_YIELD)
+    {
+      // 此时 vm->retired 恰为已执行的指令数，交给前端处理后继续
+      yield_done(vm);
+      continue;
+    }
+
+    if (vm->stop_request)
+    {
+      stop = vm->stop_request;
+
+      // 断点补丁本身、等待输入而撤销的指令都被计为了一条指令
+      if (stop == VM_STOP_BREAK || stop == VM_STOP_INPUT)
+      {
+        retired--;
+        vm->retired--;
+
+        if (vm->stats)
+        {
+          int op;
+          uint32_t next_pc;
+
+          vm->isa->fetch(vm, vm->pc, &op, &next_pc);
+          vm->op_counts[op]--;
+        }
+      }
+
+      break;
+    }
+
+    if (vm->time_budget > 0 && vm->running && vm->seconds + now() - start >= vm->time_budget)
+    {
+      stop = VM_STOP_TIMEOUT;
+      break;
+    }
+  }
+
+  vm->running = 0;
+  vm->stop = stop;
+  vm->seconds += now() - start;
+  vm_perf_end(&vm->perf, retired);
+
+  return stop;
+}
+
+void vm_core_dump(VmCore *vm, FILE *out)
+{
+  vm->isa->dump(vm, out);
+}
+
+const char *vm_core_stop_name(VmStopReason stop)
+{
+  static const char *const names[] = {
+      [VM_STOP_NONE] = "none",
+      [VM_STOP_HALT] = "halt",
+      [VM_STOP_BUDGET] = "budget",
+      [VM_STOP_TIMEOUT] = "timeout",
+      [VM_STOP_BREAK] = "break",
+      [VM_STOP_WATCH] = "watch",
+      [VM_STOP_REQUEST] = "request",
+      [VM_STOP_INPUT] = "input",
+      [VM_STOP_OUTPUT] = "output",
+      [VM_STOP_YIELD] = "yield",
+  };
+
+  return stop <= VM_STOP_YIELD ? names[stop] : "unknown";
+}
+
+void vm_core_report_stop(VmCore *vm, FILE *out)
+{
+  if (vm->stop == VM_STOP_BUDGET)
+  {
+    fprintf(out, "[%s] stopped: instruction budget of %llu exhausted at pc %04x\n",
+            vm->isa->name, (unsigned long long)vm->budget, vm->pc);
+  }
+  else if (vm->stop == VM_STOP_TIMEOUT)
+  {
+    fprintf(out, "[%s] stopped: time budget of %.3f s exhausted at pc %04x after %llu instructions\n",
+            vm->isa->name, vm->time_budget, vm->pc, (unsigned long long)vm->retired);
+  }
+  else
+  {
+    return;
+  }
+
+  vm_core_dump(vm, out);
+}
+
+void vm_core_report(VmCore *vm, FILE *out)
+{
+  if (!vm->stats && !vm->perf.enabled)
+  {
+    return;
+  }
+
+  double mips = vm->seconds > 0 ? vm->retired / vm->seconds / 1e6 : 0;
+
+  fprintf(out, "[%s] %llu instructions in %.6f s, %.2f MIPS (%s)\n",
+          vm->isa->name, (unsigned long long)vm->retired, vm->seconds, mips,
+          vm->native ? (vm->native_name ? vm->native_name : "native") : vm->engine == VM_ENGINE_PREDECODE ? "predecode" : "decode");
+
+  vm_perf_report(&vm->perf, out);
+
+  if (!vm->stats)
+  {
+    return;
+  }
+
+  for (int op = 0; op < vm->isa->op_count; op++)
+  {
+    if (vm->op_counts[op])
+    {
+      fprintf(out, "  %-6s %llu\n", vm->isa->op_names[op], (unsigned long long)vm->op_counts[op]);
+    }
+  }
+}
@@ -0,0 +1,217 @@
+#ifndef VM_CORE_H
+#define VM_CORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "vm_perf.h"
+
+// 各虚拟机共用的内核：取指/分派引擎、指令计数、跟踪、计时和嵌入接口。
+// 指令集前端只需提供取指函数和每个操作码的处理函数，
+// 机器状态结构体以 VmCore 作为第一个成员，处理函数中强转即可取回。
+
+// 操作码个数上限
+#define VM_MAX_OPS 64
+
+typedef struct VmCore VmCore;
+
+// 指令处理函数，instr 为前端 fetch 返回的值
+typedef void (*VmHandler)(VmCore *vm, uint32_t instr);
+
+// 指令集前端
+typedef struct
+{
+  const char *name;
+  int op_count;
+  const char *const *op_names;
+  const VmHandler *handlers;
+
+  // 取 pc 处的指令，写入操作码和下一条指令的地址，不修改机器状态
+  uint32_t (*fetch)(VmCore *vm, uint32_t pc, int *op, uint32_t *next_pc);
+
+  // 打印机器状态
+  void (*dump)(VmCore *vm, FILE *out);
+
+  // 读取客户机内存，供调试器查看，可为 NULL
+  uint32_t (*peek)(VmCore *vm, uint32_t address);
+
+  // 在 [address, address + len) 上设置观察点，flags 为 VM_WATCH_*，可为 NULL。成功返回 1
+  int (*watch)(VmCore *vm, uint32_t address, uint32_t len, int flags);
+
+  // 在片之间轮询中断源、投递挂起的中断，可为 NULL。见 vm_core_interrupt
+  void (*interrupt)(VmCore *vm);
+} VmIsa;
+
+#define VM_WATCH_READ 1
+#define VM_WATCH_WRITE 2
+
+// 分派引擎
+typedef enum
+{
+  VM_ENGINE_DECODE,    // 每条指令都重新取指、解码
+  VM_ENGINE_PREDECODE, // 按地址缓存解码结果
+} VmEngine;
+
+// 停止原因
+typedef enum
+{
+  VM_STOP_NONE,    // 尚未运行
+  VM_STOP_HALT,    // 某条指令调用了 vm_core_halt
+  VM_STOP_BUDGET,  // 执行的指令数达到 budget
+  VM_STOP_TIMEOUT, // 累计运行时间达到 time_budget
+  VM_STOP_BREAK,   // 执行到断点，pc 停在断点处，断点处的指令尚未执行
+  VM_STOP_WATCH,   // 访问了观察的内存，pc 为下一条指令
+  VM_STOP_REQUEST, // 嵌入方的回调调用了 vm_core_stop，或 run_until 的条件成立
+  VM_STOP_INPUT,   // 需要输入而没有，pc 停在该指令处、指令尚未执行，补充输入后再运行即可
+  VM_STOP_OUTPUT,  // 输出缓冲区已满，pc 为下一条指令，取走输出后再运行即可
+  VM_STOP_YIELD,   // 内部使用，见 vm_core_yield
+} VmStopReason;
+
+#define VM_MAX_BREAKPOINTS 32
+
+// 断点属于设置时的指令集，切换指令集（如 vm_2 翻译执行）后不生效
+typedef struct
+{
+  const VmIsa *isa;
+  uint32_t pc;
+} VmBreakpoint;
+
+// 引擎每执行这么多条指令检查一次预算和时间
+#define VM_SLICE (1 << 16)
+
+// 预解码缓存项
+typedef struct
+{
+  VmHandler handler; // NULL 表示未解码
+  uint32_t instr;
+  uint32_t next_pc;
+  int op;
+} VmSlot;
+
+struct VmCore
+{
+  const VmIsa *isa;
+  uint32_t pc;       // 程序计数器，由内核维护，处理函数可直接修改
+  uint32_t pc_limit; // 地址空间大小，预解码缓存按此分配
+  int running;
+  VmStopReason stop;
+
+  uint64_t budget;    // 指令数上限，0 表示不限
+  double time_budget; // 运行时间上限（秒），0 表示不限
+
+  VmEngine engine;
+  int trace; // 打印每条执行的指令
+  int stats; // 统计每种指令的执行次数
+
+  uint64_t retired;                // 已执行的指令数
+  uint64_t op_counts[VM_MAX_OPS];
+  double seconds;                  // 累计运行时间
+
+  // 指令集前端提供的引擎（如 lc3_aot 生成的本机代码、lc3 的轨迹引擎），设置后代替解释器执行，
+  // 接口与引擎相同：从 pc 开始最多执行 slice 条指令，返回实际执行的条数。跟踪和断点时不用
+  uint64_t (*native)(VmCore *vm, uint64_t slice);
+  const char *native_name; // 报告中的引擎名，NULL 时为 "native"
+
+  VmSlot *slots; // 预解码缓存，匿名映射或 vm_core_map_slots 映射的共享缓存
+
+  VmPerf perf; // -p 时开启的硬件计数器
+
+  int debug; // -d 时由前端进入调试器
+  VmBreakpoint breakpoints[VM_MAX_BREAKPOINTS];
+  int breakpoint_count;
+  VmStopReason stop_request; // 由处理函数通过 vm_core_stop 设置
+  void (*on_yield)(VmCore *vm);
+
+  // 不为 NULL 时在预解码缓存未命中、解码之前调用，可在此填入 slots（如后台线程预解码的结果）
+  void (*on_miss)(VmCore *vm);
+
+  // 中断：irq_pending 为唯一的标志，只在片之间检查，不增加每条指令的开销。
+  // irq_interval 非 0 时片长不超过它，由 isa->interrupt 按需要轮询的设备设置
+  int irq_pending;
+  uint64_t irq_interval;
+};
+
+// 跟踪输出，只在 -t 时打印
+#define VM_TRACE(vm, ...)             \
+  do                                  \
+  {                                   \
+    if ((vm)->trace)                  \
+    {                                 \
+      fprintf(stderr, __VA_ARGS__);   \
+    }                                 \
+  } while (0)
+
+void vm_core_init(VmCore *vm, const VmIsa *isa, uint32_t pc_limit);
+
+void vm_core_free(VmCore *vm);
+
+// 代码被整体替换，丢弃预解码缓存
+void vm_core_flush(VmCore *vm);
+
+// 清空预解码缓存但保留它的地址空间（共享缓存换成私有的空缓存），用于复用实例
+void vm_core_clear_slots(VmCore *vm);
+
+// 把 [start, end) 的指令解码到 slots，用于事先生成共享的预解码缓存
+void vm_core_decode_range(VmCore *vm, VmSlot *slots, uint32_t start, uint32_t end);
+
+// 以文件 fd 中的预解码结果（pc_limit 个 VmSlot）作为缓存，替换原有缓存。
+// 私有映射：各实例共享同一份物理内存，失效或打断点补丁时只复制写到的页。成功返回 1
+int vm_core_map_slots(VmCore *vm, int fd);
+
+// 切换指令集或代码，丢弃预解码缓存和按指令的计数
+void vm_core_set_isa(VmCore *vm, const VmIsa *isa, uint32_t pc_limit);
+
+// 解析公共命令行参数：-t 跟踪，-s 统计，-p 硬件计数器，-e=decode|predecode 选择引擎，
+// -n=N 最多执行 N 条指令，-w=SECONDS 最多运行 SECONDS 秒，-d 进入调试器。识别返回 1
+int vm_core_option(VmCore *vm, const char *arg);
+
+// 从 vm->pc 开始执行，直到某条指令调用 vm_core_halt 或预算用完。
+// 预算按累计值计算，因预算停止后提高预算再调用即可从停下处继续
+VmStopReason vm_core_run(VmCore *vm);
+
+void vm_core_halt(VmCore *vm);
+
+// 在当前指令执行完后停止，vm_core_run 返回 reason
+void vm_core_stop(VmCore *vm, VmStopReason reason);
+
+// 当前指令执行完后调用 on_yield 再继续执行，此时 vm->retired 是精确的指令数。
+// 片内的指令数只在引擎的局部变量中，需要精确计数的少见事件（如输入）用它取得
+void vm_core_yield(VmCore *vm, void (*on_yield)(VmCore *vm));
+
+// 中断源或优先级有变化，当前指令执行完后结束本片，由 isa->interrupt 检查并投递
+void vm_core_interrupt(VmCore *vm);
+
+// 执行 pc 处的一条指令，忽略该处的断点
+VmStopReason vm_core_step(VmCore *vm);
+
+// 断点：把预解码缓存中该地址的处理函数替换为 vm_core_break_handler，
+// 执行时不需要逐条比较 PC。设置断点会切换到预解码引擎。成功返回 1
+int vm_core_break_set(VmCore *vm, uint32_t pc);
+
+int vm_core_break_clear(VmCore *vm, uint32_t pc);
+
+// 断点处的补丁处理函数，instr 为断点地址
+void vm_core_break_handler(VmCore *vm, uint32_t instr);
+
+// 地址 pc 处的代码被修改，使对应的预解码结果失效，断点补丁保留。
+// 没有解码过的地址不写，共享的预解码缓存中写数据的页不会被复制
+static inline void vm_core_invalidate(VmCore *vm, uint32_t pc)
+{
+  if (vm->slots && pc < vm->pc_limit && vm->slots[pc].handler && vm->slots[pc].handler != vm_core_break_handler)
+  {
+    vm->slots[pc].handler = NULL;
+  }
+}
+
+void vm_core_dump(VmCore *vm, FILE *out);
+
+// 停止原因的名称，如 "halt"
+const char *vm_core_stop_name(VmStopReason stop);
+
+// 因预算停止时打印停止原因和机器状态
+void vm_core_report_stop(VmCore *vm, FILE *out);
+
+// 开启 -s 或 -p 时打印执行的指令数、耗时，以及每种指令的次数或硬件计数
+void vm_core_report(VmCore *vm, FILE *out);
+
+#endif
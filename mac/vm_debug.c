@@ -0,0 +1,164 @@
+#include "vm_debug.h"
+
+static void print_stop(VmCore *vm, VmStopReason stop, FILE *out)
+{
+  switch (stop)
+  {
+  case VM_STOP_BREAK:
+    fprintf(out, "[%s] breakpoint at %04x\n", vm->isa->name, vm->pc);
+    break;
+
+  case VM_STOP_WATCH:
+    fprintf(out, "[%s] watchpoint, next pc %04x\n", vm->isa->name, vm->pc);
+    break;
+
+  case VM_STOP_HALT:
+    fprintf(out, "[%s] halted after %llu instructions\n", vm->isa->name, (unsigned long long)vm->retired);
+    break;
+
+  case VM_STOP_BUDGET:
+  case VM_STOP_TIMEOUT:
+    vm_core_report_stop(vm, out);
+    break;
+
+  default:
+    fprintf(out, "[%s] pc %04x\n", vm->isa->name, vm->pc);
+    break;
+  }
+}
+
+static void examine(VmCore *vm, uint32_t address, uint32_t count, FILE *out)
+{
+  if (!vm->isa->peek)
+  {
+    fprintf(out, "memory not available for %s\n", vm->isa->name);
+    return;
+  }
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    if (i % 8 == 0)
+    {
+      fprintf(out, i ? "\n%04x:" : "%04x:", address + i);
+    }
+
+    fprintf(out, " %04x", vm->isa->peek(vm, address + i));
+  }
+
+  fprintf(out, "\n");
+}
+
+VmStopReason vm_debug_run(VmCore *vm, FILE *in, FILE *out)
+{
+  char line[128];
+  VmStopReason stop = VM_STOP_NONE;
+
+  fprintf(out, "[%s] debugger, pc %04x\n", vm->isa->name, vm->pc);
+
+  while (stop != VM_STOP_HALT)
+  {
+    fprintf(out, "(vm) ");
+    fflush(out);
+
+    if (!fgets(line, sizeof(line), in))
+    {
+      break;
+    }
+
+    char cmd = 0;
+    unsigned long a = 0, b = 0;
+    int argc = sscanf(line, " %c %lx %lu", &cmd, &a, &b);
+
+    if (argc < 1)
+    {
+      continue;
+    }
+
+    switch (cmd)
+    {
+    case 'b':
+      if (argc < 2 || !vm_core_break_set(vm, (uint32_t)a))
+      {
+        fprintf(out, "cannot set breakpoint\n");
+      }
+      break;
+
+    case 'd':
+      if (argc < 2 || !vm_core_break_clear(vm, (uint32_t)a))
+      {
+        fprintf(out, "no breakpoint at %04lx\n", a);
+      }
+      break;
+
+    case 'w':
+    case 'a':
+    {
+      int flags = cmd == 'w' ? VM_WATCH_WRITE : VM_WATCH_READ | VM_WATCH_WRITE;
+
+      if (argc < 2 || !vm->isa->watch || !vm->isa->watch(vm, (uint32_t)a, argc >= 3 ? (uint32_t)b : 1, flags))
+      {
+        fprintf(out, "cannot set watchpoint\n");
+      }
+      break;
+    }
+
+    case 's':
+    {
+      // 步数按十进制解析
+      unsigned long n = 1;
+      sscanf(line, " s %lu", &n);
+
+      // 观察点、等待输入等停止时不再继续单步
+      for (unsigned long i = 0; i < n && stop != VM_STOP_HALT; i++)
+      {
+        stop = vm_core_step(vm);
+        if (stop != VM_STOP_NONE)
+        {
+          break;
+        }
+      }
+
+      vm_core_dump(vm, out);
+      if (stop != VM_STOP_NONE)
+      {
+        print_stop(vm, stop, out);
+      }
+      break;
+    }
+
+    case 'c':
+      // 先越过当前地址的断点，这一条正常执行完才全速执行，否则报告它的停止原因
+      stop = vm_core_step(vm);
+      if (stop == VM_STOP_NONE)
+      {
+        stop = vm_core_run(vm);
+      }
+
+      print_stop(vm, stop, out);
+      break;
+
+    case 'r':
+      vm_core_dump(vm, out);
+      break;
+
+    case 'x':
+      if (argc < 2)
+      {
+        fprintf(out, "usage: x ADDR [N]\n");
+        break;
+      }
+
+      examine(vm, (uint32_t)a, argc >= 3 ? (uint32_t)b : 8, out);
+      break;
+
+    case 'q':
+      return stop;
+
+    default:
+      fprintf(out, "commands: b ADDR, d ADDR, w ADDR [N], a ADDR [N], s [N], c, r, x ADDR [N], q\n");
+      break;
+    }
+  }
+
+  return stop;
+}
@@ -0,0 +1,21 @@
+#ifndef VM_DEBUG_H
+#define VM_DEBUG_H
+
+#include <stdio.h>
+
+#include "vm_core.h"
+
+// 交互式调试器，从 in 读取命令，向 out 输出，直到客户机停机或输入 q：
+//   b ADDR       在 ADDR（十六进制）处设置断点
+//   d ADDR       删除断点
+//   w ADDR [N]   观察 ADDR 起 N 个单元的写入，默认 1
+//   a ADDR [N]   观察 ADDR 起 N 个单元的读和写
+//   s [N]        单步执行 N 条指令，默认 1
+//   c            继续执行到断点、停机或预算用完
+//   r            打印寄存器
+//   x ADDR [N]   查看 ADDR 起 N 个内存单元，默认 8
+//   q            退出
+// 返回最后一次停止的原因
+VmStopReason vm_debug_run(VmCore *vm, FILE *in, FILE *out);
+
+#endif
@@ -1,582 +1,152 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
-// 内存区
-uint16_t mem[UINT16_MAX];
+#include "lc3.h"
+#include "lc3_simd.h"
+#include "vm_debug.h"
 
-// 载入地址
-uint16_t origin;
-
-// 程序运行状态
-int running = 1;
-
-// 寄存器定义
-typedef enum
-{
-  R_R0,
-  R_R1,
-  R_R2,
-  R_R3,
-  R_R4,
-  R_R5,
-  R_R6,
-  R_R7,
-  R_PC,
-  R_COND,
-  R_COUNT
-} Registers;
-
-// 寄存器数组
-uint16_t reg[R_COUNT];
-
-// 宏便捷定义
-// PC 寄存器
-#define PC (reg[R_PC])
-
-// 标志寄存器
-#define COND (reg[R_COND])
-
-// 指令定义
-typedef enum
-{
-  OP_BR = 0,    // 条件分支
-  OP_ADD = 1,   // 加法
-  OP_LD = 2,    // load
-  OP_ST = 3,    // store
-  OP_JSR = 4,   // jump resgister
-  OP_AND = 5,   // 与运算
-  OP_LDR = 6,   // load register
-  OP_STR = 7,   // store register
-  OP_RTI = 8,   // unused
-  OP_NOT = 9,   // 取反
-  OP_LDI = 10,  // load indirect
-  OP_STI = 11,  // store indirect
-  OP_JMP = 12,  // jump
-  OP_RES = 13,  // reserved
-  OP_LEA = 14,  // load effective address
-  OP_TRAP = 15, // trap，陷阱，相当于中断
-} InstructionSet;
-
-// 标志定义
-typedef enum
-{
-  FL_POS = 1 << 0, // 正数
-  FL_ZRO = 1 << 1, // 0
-  FL_NEG = 1 << 2  //负数
-} ConditionFlags;
-
-// 中断类型
-typedef enum
-{
-  TRAP_GETC = 0x20, // 从键盘输入
-  TRAP_OUT = 0x21,  //输出字符
-  TRAP_PUTS = 0x22, // 输出字符串
-  TARP_IN = 0x23,
-  TRAP_PUTSP = 0x24,
-  TRAP_HALT = 0x25, // 退出程序
-} TrapSet;
-
-// 从内存读取数据
-uint16_t mem_read(int address)
-{
-  if (address < 0 || address >= UINT16_MAX)
-  {
-    printf("memory read error!\n");
-    exit(4);
-  }
-
-  return mem[address];
-}
-
-// 将 data 写入内存地址为 address 处
-void mem_write(uint16_t address, uint16_t data)
+// 读取整个文件，返回 malloc 的缓冲区
+static char *read_file(const char *path, size_t *size)
 {
-  if (address < 0 || address >= UINT16_MAX)
+  FILE *file = fopen(path, "rb");
+  if (!file)
   {
-    printf("memory write error!\n");
-    exit(3);
+    return NULL;
   }
 
-  mem[address] = data;
-}
+  fseek(file, 0, SEEK_END);
+  *size = ftell(file);
+  rewind(file);
 
-// 符号扩展
-uint16_t sign_extend(uint16_t x, int bit_count)
-{
-  // 最高位 1
-  if ((x >> (bit_count - 1)) & 0x1)
-  {
-    x |= 0xFFFF << bit_count;
-  }
+  char *data = malloc(*size + 1);
+  *size = fread(data, 1, *size, file);
+  data[*size] = '\0';
+  fclose(file);
 
-  return x;
+  return data;
 }
 
-// 更新标志寄存器
-void update_flags(uint16_t r)
+// 输入文件每行作为一个客户机的输入，每 LC3_LANES 个一组按 lane 并行执行，按行号顺序打印各自的输出。
+// 有客户机执行到 lane 中不支持的指令时返回 1
+static int run_batch(Lc3 *vm, const char *path)
 {
-  uint16_t value = reg[r];
-  if (value == 0)
-  {
-    COND = FL_ZRO;
-  }
-  else if ((value >> 15) & 0x1)
+  size_t size;
+  char *inputs = read_file(path, &size);
+  if (!inputs)
   {
-    // 最高位 1，负数
-    COND = FL_NEG;
+    printf("failed to read %s\n", path);
+    exit(1);
   }
-  else
-  {
-    COND = FL_POS;
-  }
-}
-
-// 加法指令，两种模式
-// add r0, r1, imm， 立即数模式
-// add r0, r1, r2，寄存器模式
-void add(int instr)
-{
-  // 取出目的寄存器 r0，9~11，占 3 位，与上 111
-  uint16_t r0 = (instr >> 9) & 0x7;
 
-  // 源寄存器 r1，6~8 位，
-  uint16_t r1 = (instr >> 6) & 0x7;
-
-  // add 模式
-  uint16_t flag = (instr >> 5) & 0x1;
-
-  // 立即数模式
-  if (flag)
-  {
-    // 低五位，取出立即数。
-    uint16_t data = instr & 0x1F;
-
-    // 符号扩展，若高位是 1，则全部补 1
-    uint16_t value = sign_extend(data, 5);
-
-    reg[r0] = reg[r1] + value;
-
-    printf("add imm dr:%d, sr:%d, value:%d\n", r0, r1, value);
-  }
-  else
+  Lc3Batch *batch = lc3_batch_create();
+  if (!batch)
   {
-    // 寄存器模式
-    // 取出源寄存器 2，低 3 位
-    uint16_t r2 = instr & 0x7;
-
-    reg[r0] = reg[r1] + reg[r2];
+    printf("out of memory\n");
+    exit(1);
   }
+  uint64_t retired = 0, steps = 0;
+  int guests = 0;
+  int status = 0;
+  const char *line = inputs;
+  clock_t start = clock();
 
-  printf("reg_%d value:%d\n", r0, reg[r0]);
-
-  // 更新标志寄存器
-  update_flags(r0);
-}
-
-// 与运算，同 add ，两种模式
-void and (uint16_t instr)
-{
-  // 取出目的寄存器 r0，9~11，占 3 位，与上 111
-  uint16_t r0 = (instr >> 9) & 0x7;
-
-  // 源寄存器 r1，6~8 位，
-  uint16_t r1 = (instr >> 6) & 0x7;
-
-  // add 模式
-  uint16_t flag = (instr >> 5) & 0x1;
-
-  // 立即数模式
-  if (flag)
+  while (line < inputs + size)
   {
-    // 低五位，取出立即数。
-    uint16_t data = instr & 0x1F;
+    const char *lines[LC3_LANES];
+    size_t lengths[LC3_LANES];
+    int lanes = 0;
 
-    printf("add imm mode, imm:%d\n", data);
+    while (lanes < LC3_LANES && line < inputs + size)
+    {
+      const char *end = memchr(line, '\n', inputs + size - line);
+      end = end ? end + 1 : inputs + size;
 
-    // 符号扩展，若高位是 1，则全部补 1
-    uint16_t value = sign_extend(data, 5);
+      lines[lanes] = line;
+      lengths[lanes++] = end - line;
+      line = end;
+    }
 
-    printf("add imm mode, sign_extend imm:%d\n", value);
+    lc3_batch_reset(batch, vm, lanes);
+    for (int l = 0; l < lanes; l++)
+    {
+      lc3_batch_set_input(batch, l, lines[l], lengths[l]);
+    }
 
-    reg[r0] = reg[r1] & value;
-  }
-  else
-  {
-    puts("add reg mode");
+    // -n 限制向量步数
+    uint32_t unfinished = lc3_batch_run(batch, vm->core.budget);
 
-    // 寄存器模式
-    // 取出源寄存器 2，低 3 位
-    uint16_t r2 = instr & 0x7;
+    for (int l = 0; l < lanes; l++)
+    {
+      printf("== guest %d ==\n", guests + l);
+      fwrite(batch->io[l].output, 1, batch->io[l].output_len, stdout);
+
+      if (batch->faulted & (1u << l))
+      {
+        printf("[lc3] stopped: instruction at pc %04x needs devices, interrupts or guest traps, "
+               "run this input without -batch\n",
+               batch->fault_pc[l]);
+        status = 1;
+      }
+
+      if (unfinished & (1u << l))
+      {
+        printf("[lc3] stopped: step budget of %llu exhausted at pc %04x\n",
+               (unsigned long long)vm->core.budget, batch->pc[l]);
+      }
+    }
 
-    reg[r0] = reg[r1] & reg[r2];
+    guests += lanes;
+    retired += batch->retired;
+    steps += batch->steps;
   }
 
-  printf("reg_%d value:%d\n", r0, reg[r0]);
-
-  // 更新标志寄存器
-  update_flags(r0);
-}
-
-// NOT r0, r1。将 r1 取反后，放入 r0
-void not(uint16_t instr)
-{
-  // 取出目的寄存器 r0，9~11，占 3 位，与上 111
-  uint16_t r0 = (instr >> 9) & 0x7;
-
-  // 源寄存器 r1，6~8 位，
-  uint16_t r1 = (instr >> 6) & 0x7;
-
-  reg[r0] = ~reg[r1];
-  update_flags(r0);
-}
-
-// 标志条件跳转
-// br cond_flag, pc_offset
-void branch(uint16_t instr)
-{
-  uint16_t cond_flag = (instr >> 9) & 0x7;
-  uint16_t pc_offset = sign_extend(instr & 0x1FF, 9);
-
-  // 传入标识与标志寄存器的值相符，N,P,Z
-  if (cond_flag & COND)
+  if (vm->core.stats)
   {
-    PC += pc_offset;
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    fprintf(stderr, "[lc3x%d] %d guests, %llu instructions in %llu steps (%.2f lanes per step), %.6f s, %.2f MIPS\n",
+            LC3_LANES, guests, (unsigned long long)retired, (unsigned long long)steps,
+            steps ? (double)retired / steps : 0, seconds, seconds > 0 ? retired / seconds / 1e6 : 0);
   }
-}
 
-// jump r
-// 跳转到寄存器中的值
-void jump(uint16_t instr)
-{
-  uint16_t r1 = (instr >> 6) & 0x7;
-  PC = reg[r1];
+  lc3_batch_destroy(batch);
+  free(inputs);
+  return status;
 }
 
-// load indirect，从内存中获取数据，放入寄存器。间接模式
-// 以 pc 寄存器作为偏移基准
-// ldi dr, pc_offset
-// [[pc+pc_offset]]，pc+pc_offset 中的内容是数据的地址。
-void load_indirect(uint16_t instr)
+// 每执行 interval 条指令保存一次检查点，写盘在后台进行，客户机只在复制内存时暂停。
+// -n 的预算仍然有效，到达预算时也保存一次，之后可以从检查点继续
+static void run_checkpointed(Lc3 *vm, const char *path, uint64_t interval)
 {
-  uint16_t pc_offset = instr & 0x1ff;
-
-  // 符号扩展
-  pc_offset = sign_extend(pc_offset, 9);
-
-  uint16_t r = (instr >> 9) & 0x7;
-
-  // 取出存储数据的地址
-  uint16_t address = mem_read(PC + pc_offset);
-
-  // 取出数据
-  uint16_t data = mem_read(address);
-
-  // 更新寄存器
-  reg[r] = data;
-
-  printf("ldi r:%d, address:%d, data:%d\n", r, address, data);
+  uint64_t budget = vm->core.budget;
 
-  // 更新标志寄存器
-  update_flags(r);
-}
-
-// 将地址放入寄存器 r
-// 以 pc 寄存器作为偏移基准
-// lea r, pc_offset
-void load_effective_address(uint16_t instr)
-{
-  uint16_t pc_offset = instr & 0x1ff;
-
-  // 符号扩展
-  pc_offset = sign_extend(pc_offset, 9);
-
-  uint16_t address = PC + pc_offset;
-
-  uint16_t r = (instr >> 9) & 0x7;
-
-  // 更新寄存器
-  reg[r] = address;
-
-  // 更新标志寄存器
-  update_flags(r);
-}
-
-// jump resgister
-// 偏移量跳转
-void jump_subroutine(uint16_t instr)
-{
-  uint16_t long_flag = (instr >> 11) & 0x1;
-
-  // R7 保存 pc 值
-  reg[R_R7] = PC;
-
-  if (long_flag)
+  for (;;)
   {
-    // long_pc_offset
-    uint16_t long_pc_offset = sign_extend(instr & 0x7ff, 11);
-    PC += long_pc_offset;
-  }
-  else
-  {
-    uint16_t r1 = (instr >> 6) & 0x7;
-    PC = reg[r1];
-  }
-}
-
-// ld r, pc_offset
-// 以 pc 寄存器作为偏移基准
-// 将距离下一条指令 pc_offset 处里的数据取出来，放入 r 中。
-void load(uint16_t instr)
-{
-  uint16_t pc_offset = sign_extend(instr & 0x1ff, 9);
-  uint16_t r0 = (instr >> 9) & 0x7;
-  reg[r0] = mem_read(PC + pc_offset);
-  update_flags(r0);
-}
-
-// ldr r0, r1, offset
-// 以 r1 作为偏移基准
-// 将距离 r1，offset 处的数据取出来，放入 r0。
-void load_register(uint16_t instr)
-{
-  uint16_t r0 = (instr >> 9) & 0x7;
-
-  uint16_t r1 = (instr >> 6) & 0x7;
-
-  uint16_t offset = sign_extend(instr & 0x3f, 6);
-
-  uint16_t address = reg[r1] + offset;
-  uint16_t value = mem_read(address);
-
-  reg[r0] = value;
-  update_flags(r0);
-}
-
-// st r, pc_offset
-// 以 pc 寄存器作为偏移基准
-// 将 r 中的数据放入距离下一条指令，pc_offset 的地址中。
-void store(uint16_t instr)
-{
-  uint16_t pc_offset = sign_extend(instr & 0x1ff, 9);
-  uint16_t r0 = (instr >> 9) & 0x7;
-
-  uint16_t address = PC + pc_offset;
-  uint16_t value = reg[r0];
-
-  mem_write(address, value);
-}
-
-// sti r, pc_offset，间接存储，pc+pc_offset 是待存储数据地址的地址。
-void store_indirect(uint16_t instr)
-{
-  uint16_t pc_offset = sign_extend(instr & 0x1ff, 9);
-  uint16_t r0 = (instr >> 9) & 0x7;
-
-  uint16_t indirect_address = PC + pc_offset;
-  uint16_t address = mem_read(indirect_address);
-
-  uint16_t value = reg[r0];
-
-  mem_write(address, value);
-}
-
-// str r0, r1, offsets
-// 以 r1 作为偏移基准
-void store_register(uint16_t instr)
-{
-  // r0
-  uint16_t r0 = (instr >> 9) & 0x7;
-
-  // r1
-  uint16_t r1 = (instr >> 6) & 0x7;
-
-  uint16_t offset = sign_extend(instr & 0x3f, 6);
-
-  uint16_t address = reg[r1] + offset;
-  uint16_t value = reg[r0];
-
-  mem_write(address, value);
-}
-
-// 将 r0 寄存器中地址处的字符串打印出来。1 个字符占 2 字节。
-void trap_puts()
-{
-  uint16_t address = reg[R_R0];
-
-  printf("trap_puts begin address:%d\n", address);
-
-  uint16_t *c = mem + address;
-
-  while (*c)
-  {
-    putc((char)*c, stdout);
-    ++c;
-  }
-
-  fflush(stdout);
-  puts("\ntrap_puts end ...");
-}
-
-// 等待输入一个字符，最后存入 r0
-void trap_getc()
-{
-  puts("trap_getc begin ...");
-
-  // 清空输入缓冲区
-  fflush(stdin);
-  reg[R_R0] = (uint16_t)getchar();
-
-  puts("trap_getc end ...");
-}
-
-// 将 r0 中的字符打印出来
-void trap_out()
-{
-  puts("trap_out begin ...");
-
-  putc((char)reg[R_R0], stdout);
-  fflush(stdout);
-
-  puts("\ntrap_out end ...");
-}
-
-// 提示输入一个字符，将字符打印，并放入 R0
-void trap_in()
-{
-  puts("trap_in begin ...");
-
-  // 清空输入缓冲区
-  fflush(stdin);
-
-  printf("Enter a character:");
-  char c = getchar();
-  putc(c, stdout);
-  reg[R_R0] = (uint16_t)c;
+    uint64_t n = interval;
 
-  puts("\ntrap_in end ...");
-}
-
-// 将 r0 地址处的字符串出来，一个字符一字节
-void trap_put_string()
-{
-  puts("trap_put_string begin ...");
-
-  uint16_t *c = mem + reg[R_R0];
-  while (*c)
-  {
-    // 低  8 位
-    char char1 = (*c) & 0xff;
-    putc(char1, stdout);
-
-    // 高 8 位
-    char char2 = (*c) >> 8;
-    if (char2)
+    if (budget && budget - vm->core.retired < n)
     {
-      putc(char2, stdout);
+      n = budget - vm->core.retired;
     }
 
-    ++c;
-  }
-
-  fflush(stdout);
-  puts("\ntrap_put_string end ...");
-}
-
-// op = 1111
-void trap(int instr)
-{
-  // trap_code，低 8 位
-  uint16_t trap_code = instr & 0xff;
-
-  switch (trap_code)
-  {
-  case TRAP_GETC:
-  {
-    trap_getc();
-    break;
-  }
-
-  case TRAP_OUT:
-  {
-    trap_out();
-    break;
-  }
-
-  case TRAP_PUTS:
-  {
-    trap_puts();
-    break;
-  }
-
-  case TARP_IN:
-  {
-    trap_in();
-    break;
-  }
-
-  case TRAP_PUTSP:
-  {
-    trap_put_string();
-    break;
-  }
-
-  case TRAP_HALT:
-  {
-    puts("Halt");
-    running = 0;
-    break;
-  }
-
-  default:
-  {
-    printf("Unknown TrapCode!\n");
-    break;
-  }
-  }
-}
-
-uint16_t swap16(uint16_t x)
-{
-  // 两个字节交换
-  return (x << 8) | (x >> 8);
-}
-
-// 文件存储是大端字节序，需转换为小端
-void read_image_file(FILE *file)
-{
-  // 读取 2 字节
-  fread(&origin, sizeof(origin), 1, file);
-
-  // 大端转小端
-  origin = swap16(origin);
-
-  uint16_t max_read = UINT16_MAX - origin;
-  uint16_t *p = mem + origin;
+    if (lc3_run(vm, n) != VM_STOP_BUDGET)
+    {
+      break;
+    }
 
-  // 读取文件内容到 p 指向的地址，以 2 字节为单位
-  size_t read = fread(p, sizeof(uint16_t), max_read, file);
+    lc3_checkpoint_save(vm, path);
 
-  // 大端转小端
-  while (read-- > 0)
-  {
-    *p = swap16(*p);
-    ++p;
+    if (budget && vm->core.retired >= budget)
+    {
+      break;
+    }
   }
-}
 
-// 读取指令文件
-int read_image(const char *image_path)
-{
-  FILE *file = fopen(image_path, "rb");
-  if (!file)
+  if (!lc3_checkpoint_wait(vm))
   {
-    return 0;
+    fprintf(stderr, "[lc3] failed to write checkpoint %s\n", path);
   }
-
-  read_image_file(file);
-
-  fclose(file);
-  return 1;
 }
 
 int main(int argc, const char *argv[])
@@ -587,129 +157,201 @@ int main(int argc, const char *argv[])
     exit(2);
   }
 
-  for (int i = 0; i < argc; i++)
+  Lc3 *vm = lc3_create();
+  const char *batch = NULL;
+  const char *checkpoint = NULL;
+  const char *restore = NULL;
+  uint64_t checkpoint_interval = 100000000;
+  int images = 0;
+  int tiered = 0;
+  int pretranslate = 0;
+  const char *scalar_only = NULL; // -batch 不支持的参数
+
+  // 先解析参数：公共参数见 vm_core_option，-batch=FILE 以 FILE 的每行为输入并行执行多个客户机，
+  // -watch=ADDR[:LEN] 报告对该范围的写入，-awatch=ADDR[:LEN] 报告读和写（地址为十六进制），
+  // -record=FILE 记录输入，-replay=FILE 从记录回放输入，
+  // -jit[=N] 把回边执行 N 次（默认 50）的循环编译成轨迹执行，
+  // -tier[=B[:N]] 分层执行，基本块进入 B 次（默认 16）后预解码，回边执行 N 次后编译成轨迹，
+  // -pretranslate 在后台线程中预解码静态可达的指令（启动线程的开销对短任务不划算，默认不做），
+  // -checkpoint=FILE[:N] 每 N 条指令（默认 1 亿）保存检查点，-restore=FILE 从检查点继续（镜像须相同），
+  // -trap=MODE 或 -trap=CODE=MODE 设置 TRAP 在宿主机上执行还是经客户机向量表（见 lc3_trap_option）
+  for (int i = 1; i < argc; i++)
   {
-    if (!read_image(argv[i]))
+    if (strncmp(argv[i], "-batch=", 7) == 0)
     {
-      printf("failed to load image %s\n", argv[i]);
-      exit(1);
+      batch = argv[i] + 7;
     }
-  }
-
-  printf("origin:%0x\n", origin);
-
-  // 设置初始值
-  PC = origin;
-
-  // 用于打印当前执行操作码
-  const char *op_list[] = {"BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR", "RTI", "NOT", "LDI", "STI", "JMP", "RES", "LEA", "TRAP"};
-
-  while (running)
-  {
-    // 读取指令
-    u_int16_t instr = mem_read(PC++);
-
-    // 指令操作码占 4 位
-    u_int16_t op = instr >> 12;
-
-    printf("\n======= exe op:%s =======\n\n", op_list[op]);
-
-    switch (op)
+    else if (strncmp(argv[i], "-record=", 8) == 0 || strncmp(argv[i], "-replay=", 8) == 0)
     {
-    case OP_ADD:
-    {
-      add(instr);
-      break;
+      scalar_only = argv[i];
+      const char *path = argv[i] + 8;
+      int ok = argv[i][3] == 'c' ? lc3_record(vm, path) : lc3_replay(vm, path);
+
+      if (!ok)
+      {
+        printf("failed to open %s\n", path);
+        exit(1);
+      }
     }
-
-    case OP_AND:
+    else if (strncmp(argv[i], "-checkpoint=", 12) == 0)
     {
-      and(instr);
-      break;
+      scalar_only = argv[i];
+      static char path[4096];
+      const char *colon = strrchr(argv[i] + 12, ':');
+
+      snprintf(path, sizeof(path), "%.*s", colon ? (int)(colon - argv[i] - 12) : (int)strlen(argv[i] + 12), argv[i] + 12);
+      checkpoint = path;
+
+      if (colon)
+      {
+        checkpoint_interval = strtoull(colon + 1, NULL, 0);
+      }
+
+      if (!*checkpoint || !checkpoint_interval)
+      {
+        printf("bad checkpoint %s\n", argv[i]);
+        exit(2);
+      }
     }
-
-    case OP_NOT:
+    else if (strcmp(argv[i], "-jit") == 0 || strncmp(argv[i], "-jit=", 5) == 0)
     {
-      not(instr);
-      break;
+      lc3_jit(vm, argv[i][4] ? strtoul(argv[i] + 5, NULL, 0) : 0);
     }
-
-    case OP_BR:
+    else if (strcmp(argv[i], "-tier") == 0 || strncmp(argv[i], "-tier=", 6) == 0)
     {
-      branch(instr);
-      break;
-    }
+      char *end = (char *)argv[i] + 5;
+      unsigned long blocks = argv[i][5] ? strtoul(argv[i] + 6, &end, 0) : 0;
+      unsigned long traces = *end == ':' ? strtoul(end + 1, NULL, 0) : 0;
 
-    case OP_JMP:
-    {
-      jump(instr);
-      break;
-    }
+      if ((*end && *end != ':') || blocks > UINT16_MAX || traces > UINT16_MAX || !lc3_tier(vm, blocks, traces))
+      {
+        printf("bad tier option %s\n", argv[i]);
+        exit(2);
+      }
 
-    case OP_JSR:
-    {
-      jump_subroutine(instr);
-      break;
+      tiered = 1;
     }
-
-    case OP_LD:
+    else if (strcmp(argv[i], "-pretranslate") == 0)
     {
-      load(instr);
-      break;
+      pretranslate = 1;
     }
-
-    case OP_LDI:
+    else if (strncmp(argv[i], "-restore=", 9) == 0)
     {
-      load_indirect(instr);
-      break;
+      restore = argv[i] + 9;
+      scalar_only = argv[i];
     }
-
-    case OP_LDR:
+    else if (strncmp(argv[i], "-trap=", 6) == 0)
     {
-      load_register(instr);
-      break;
+      if (!lc3_trap_option(vm, argv[i] + 6))
+      {
+        printf("bad trap mode %s\n", argv[i]);
+        exit(2);
+      }
     }
-
-    case OP_LEA:
+    else if (strncmp(argv[i], "-watch=", 7) == 0 || strncmp(argv[i], "-awatch=", 8) == 0)
     {
-      load_effective_address(instr);
-      break;
+      int write_only = argv[i][1] == 'w';
+      scalar_only = argv[i];
+      char *end;
+      unsigned long address = strtoul(strchr(argv[i], '=') + 1, &end, 16);
+      unsigned long len = *end == ':' ? strtoul(end + 1, NULL, 0) : 1;
+
+      if (!lc3_watch(vm, address, len, write_only ? VM_WATCH_WRITE : VM_WATCH_READ | VM_WATCH_WRITE))
+      {
+        printf("bad watchpoint %s\n", argv[i]);
+        exit(2);
+      }
     }
-
-    case OP_ST:
+    else
     {
-      store(instr);
-      break;
+      vm_core_option(&vm->core, argv[i]);
     }
+  }
 
-    case OP_STI:
-    {
-      store_indirect(instr);
-      break;
-    }
+  vm_perf_begin(&vm->core.perf, "load");
 
-    case OP_STR:
+  for (int i = 1; i < argc; i++)
+  {
+    if (argv[i][0] == '-')
     {
-      store_register(instr);
-      break;
+      continue;
     }
 
-    case OP_TRAP:
+    if (!read_image(vm, argv[i]))
     {
-      trap(instr);
-      break;
+      printf("failed to load image %s\n", argv[i]);
+      exit(1);
     }
 
-    case OP_RTI:
-    case OP_RES:
-      break;
+    images++;
+  }
 
-    default:
+  vm_perf_end(&vm->core.perf, 0);
+
+  if (!images)
+  {
+    printf("no lc3 image file ...\n");
+    exit(2);
+  }
+
+  VM_TRACE(&vm->core, "origin:%0x\n", vm->origin);
+
+  if (batch)
+  {
+    if (scalar_only)
     {
-      printf("Unknown OpCode!\n");
-    }
-    break;
+      printf("%s is not supported with -batch\n", scalar_only);
+      exit(2);
     }
+
+    int status = run_batch(vm, batch);
+    lc3_destroy(vm);
+    return status;
+  }
+
+  // 设置初始值
+  lc3_reset(vm);
+
+  // 在后台预解码静态可达的指令，与执行同时进行；分层执行时只预解码执行过的热代码
+  if (pretranslate && !tiered)
+  {
+    lc3_pretranslate(vm);
+  }
+
+  if (checkpoint || restore)
+  {
+    lc3_checkpoint_base(vm);
+  }
+
+  if (restore && !lc3_checkpoint_restore(vm, restore))
+  {
+    printf("failed to restore %s\n", restore);
+    exit(1);
+  }
+
+  if (vm->core.debug)
+  {
+    vm_debug_run(&vm->core, stdin, stderr);
   }
+  else if (checkpoint)
+  {
+    run_checkpointed(vm, checkpoint, checkpoint_interval);
+  }
+  else
+  {
+    vm_core_run(&vm->core);
+  }
+
+  vm_core_report(&vm->core, stderr);
+  vm_core_report_stop(&vm->core, stderr);
+
+  if (vm->core.stats)
+  {
+    lc3_pretranslate_report(vm, stderr);
+    lc3_jit_report(vm, stderr);
+  }
+
+  lc3_destroy(vm);
+
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,269 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vm_perf.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+static const char *const counter_names[VM_PERF_COUNT] = {
+    "cycles", "instructions", "branch-misses", "L1i-misses", "L1d-misses", "task-clock"};
+
+#ifdef __linux__
+
+#define CACHE_READ_MISS(cache) \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct
+{
+  uint32_t type;
+  uint64_t config;
+} counter_events[VM_PERF_COUNT] = {
+    [VM_PERF_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [VM_PERF_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    [VM_PERF_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    [VM_PERF_L1I_MISSES] = {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1I)},
+    [VM_PERF_L1D_MISSES] = {PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    [VM_PERF_TASK_CLOCK] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+};
+
+// 每个计数器单独打开而不组成 group，某一项不支持时不影响其他项
+static int open_counter(VmPerfCounter counter)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+
+  attr.size = sizeof(attr);
+  attr.type = counter_events[counter].type;
+  attr.config = counter_events[counter].config;
+
+  // 只统计用户态，perf_event_paranoid 为 2 时也能打开
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  // 计数器多于硬件寄存器时会分时复用，读取时按运行时间折算
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t read_counter(int fd)
+{
+  uint64_t data[3];
+
+  if (read(fd, data, sizeof(data)) != sizeof(data) || data[2] == 0)
+  {
+    return 0;
+  }
+
+  if (data[2] < data[1])
+  {
+    return (uint64_t)((double)data[0] * data[1] / data[2]);
+  }
+
+  return data[0];
+}
+
+#else
+
+static int open_counter(VmPerfCounter counter)
+{
+  errno = ENOSYS;
+  return -1;
+}
+
+static uint64_t read_counter(int fd)
+{
+  return 0;
+}
+
+#endif
+
+int vm_perf_open(VmPerf *perf)
+{
+  int available = 0;
+
+  memset(perf, 0, sizeof(*perf));
+  perf->enabled = 1;
+
+  for (int i = 0; i < VM_PERF_COUNT; i++)
+  {
+    perf->fds[i] = open_counter(i);
+
+    if (perf->fds[i] >= 0)
+    {
+      available++;
+    }
+    else if (!perf->error)
+    {
+      perf->error = errno;
+    }
+  }
+
+  return available;
+}
+
+void vm_perf_close(VmPerf *perf)
+{
+  if (!perf->enabled)
+  {
+    return;
+  }
+
+  for (int i = 0; i < VM_PERF_COUNT; i++)
+  {
+    if (perf->fds[i] >= 0)
+    {
+      close(perf->fds[i]);
+    }
+  }
+
+  perf->enabled = 0;
+}
+
+static void read_all(const VmPerf *perf, uint64_t values[VM_PERF_COUNT])
+{
+  for (int i = 0; i < VM_PERF_COUNT; i++)
+  {
+    values[i] = perf->fds[i] >= 0 ? read_counter(perf->fds[i]) : 0;
+  }
+}
+
+void vm_perf_begin(VmPerf *perf, const char *name)
+{
+  if (!perf->enabled || perf->current)
+  {
+    return;
+  }
+
+  VmPerfPhase *phase = NULL;
+
+  for (int i = 0; i < perf->phase_count; i++)
+  {
+    if (strcmp(perf->phases[i].name, name) == 0)
+    {
+      phase = &perf->phases[i];
+    }
+  }
+
+  if (!phase)
+  {
+    if (perf->phase_count == VM_PERF_MAX_PHASES)
+    {
+      return;
+    }
+
+    phase = &perf->phases[perf->phase_count++];
+    phase->name = name;
+  }
+
+  perf->current = phase;
+  read_all(perf, perf->start);
+}
+
+void vm_perf_end(VmPerf *perf, uint64_t retired)
+{
+  if (!perf->enabled || !perf->current)
+  {
+    return;
+  }
+
+  uint64_t now[VM_PERF_COUNT];
+  read_all(perf, now);
+
+  for (int i = 0; i < VM_PERF_COUNT; i++)
+  {
+    perf->current->values[i] += now[i] - perf->start[i];
+  }
+
+  perf->current->retired += retired;
+  perf->current = NULL;
+}
+
+void vm_perf_report(const VmPerf *perf, FILE *out)
+{
+  if (!perf->enabled)
+  {
+    return;
+  }
+
+  int available = 0;
+  for (int i = 0; i < VM_PERF_COUNT; i++)
+  {
+    available += perf->fds[i] >= 0;
+  }
+
+  if (!available)
+  {
+    fprintf(out, "[perf] counters unavailable: %s\n", strerror(perf->error));
+    return;
+  }
+
+  if (perf->error)
+  {
+    fprintf(out, "[perf] some counters unavailable: %s\n", strerror(perf->error));
+  }
+
+  fprintf(out, "[perf] %-10s", "phase");
+  for (int i = 0; i < VM_PERF_COUNT; i++)
+  {
+    fprintf(out, " %14s", counter_names[i]);
+  }
+  fprintf(out, " %14s\n", "guest-insns");
+
+  for (int p = 0; p < perf->phase_count; p++)
+  {
+    const VmPerfPhase *phase = &perf->phases[p];
+
+    fprintf(out, "[perf] %-10s", phase->name);
+    for (int i = 0; i < VM_PERF_COUNT; i++)
+    {
+      if (perf->fds[i] >= 0)
+      {
+        fprintf(out, " %14llu", (unsigned long long)phase->values[i]);
+      }
+      else
+      {
+        fprintf(out, " %14s", "n/a");
+      }
+    }
+    fprintf(out, " %14llu\n", (unsigned long long)phase->retired);
+
+    if (!phase->retired)
+    {
+      continue;
+    }
+
+    double n = (double)phase->retired;
+    const char *sep = " ";
+    fprintf(out, "[perf] %-10s per guest instruction:", phase->name);
+
+    if (perf->fds[VM_PERF_CYCLES] >= 0)
+    {
+      fprintf(out, "%s%.2f cycles", sep, phase->values[VM_PERF_CYCLES] / n);
+      sep = ", ";
+    }
+
+    if (perf->fds[VM_PERF_INSTRUCTIONS] >= 0)
+    {
+      fprintf(out, "%s%.2f host instructions", sep, phase->values[VM_PERF_INSTRUCTIONS] / n);
+      sep = ", ";
+    }
+
+    if (perf->fds[VM_PERF_BRANCH_MISSES] >= 0)
+    {
+      fprintf(out, "%s%.4f branch-misses", sep, phase->values[VM_PERF_BRANCH_MISSES] / n);
+      sep = ", ";
+    }
+
+    if (perf->fds[VM_PERF_TASK_CLOCK] >= 0)
+    {
+      fprintf(out, "%s%.2f ns", sep, phase->values[VM_PERF_TASK_CLOCK] / n);
+    }
+
+    fprintf(out, "\n");
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef VM_PERF_H
+#define VM_PERF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// 基于 perf_event_open 的硬件计数器，按阶段累计。
+// 计数器打不开时（容器中常见，或非 Linux）对应项记为不可用，其余照常统计。
+
+typedef enum
+{
+  VM_PERF_CYCLES,
+  VM_PERF_INSTRUCTIONS,
+  VM_PERF_BRANCH_MISSES,
+  VM_PERF_L1I_MISSES,
+  VM_PERF_L1D_MISSES,
+  VM_PERF_TASK_CLOCK, // 软件计数器，单位 ns，硬件计数器不可用时仍可用
+  VM_PERF_COUNT
+} VmPerfCounter;
+
+#define VM_PERF_MAX_PHASES 8
+
+typedef struct
+{
+  const char *name;
+  uint64_t values[VM_PERF_COUNT];
+  uint64_t retired; // 该阶段执行的客户指令数
+} VmPerfPhase;
+
+typedef struct
+{
+  int enabled;
+  int fds[VM_PERF_COUNT]; // -1 表示不可用
+  int error;              // 第一个打开失败的 errno
+
+  VmPerfPhase phases[VM_PERF_MAX_PHASES];
+  int phase_count;
+
+  VmPerfPhase *current;
+  uint64_t start[VM_PERF_COUNT];
+} VmPerf;
+
+// 打开计数器并开始计数，返回可用的计数器个数
+int vm_perf_open(VmPerf *perf);
+
+void vm_perf_close(VmPerf *perf);
+
+// 开始一个阶段，同名阶段累计。阶段不可嵌套，name 须为静态字符串
+void vm_perf_begin(VmPerf *perf, const char *name);
+
+// 结束当前阶段，retired 为该阶段执行的客户指令数
+void vm_perf_end(VmPerf *perf, uint64_t retired);
+
+// 打印每个阶段的计数，以及每条客户指令的主机周期数和分支预测失败数
+void vm_perf_report(const VmPerf *perf, FILE *out);
+
+#endif